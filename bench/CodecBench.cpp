@@ -0,0 +1,143 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * libhomegear-base is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * libhomegear-base is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libhomegear-base.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+/*
+ * Encoder and decoder benchmark: floats in the legacy mantissa/exponent format and as raw doubles (tDouble), and
+ * requests with typical event parameters. Prints nanoseconds per operation.
+ *
+ * Usage: CodecBench [iterations]
+ */
+
+#include "BinaryDecoder.h"
+#include "BinaryEncoder.h"
+#include "RpcDecoder.h"
+#include "RpcEncoder.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+
+using namespace Ipc;
+
+namespace {
+
+//Keeps the compiler from optimizing the benchmarked code away.
+volatile double sink = 0;
+
+template<typename Function>
+double nanosecondsPerOperation(size_t operations, Function function) {
+  auto startTime = std::chrono::steady_clock::now();
+  function();
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - startTime).count() / operations;
+}
+
+void benchmarkFloats(size_t iterations) {
+  std::mt19937_64 random(42);
+  std::uniform_real_distribution<double> distribution(-1000000.0, 1000000.0);
+  std::vector<double> values(iterations);
+  for (auto &value : values) value = distribution(random);
+
+  BinaryEncoder encoder;
+  BinaryDecoder decoder;
+  std::vector<char> legacy;
+  std::vector<char> raw;
+  legacy.reserve(iterations * 8);
+  raw.reserve(iterations * 8);
+
+  double legacyEncode = nanosecondsPerOperation(iterations, [&] {
+    for (auto value : values) encoder.encodeFloat(legacy, value);
+  });
+  double rawEncode = nanosecondsPerOperation(iterations, [&] {
+    for (auto value : values) encoder.encodeDouble(raw, value);
+  });
+  double legacyDecode = nanosecondsPerOperation(iterations, [&] {
+    uint32_t position = 0;
+    double sum = 0;
+    for (size_t i = 0; i < iterations; i++) sum += decoder.decodeFloat(legacy, position);
+    sink = sum;
+  });
+  double rawDecode = nanosecondsPerOperation(iterations, [&] {
+    uint32_t position = 0;
+    double sum = 0;
+    for (size_t i = 0; i < iterations; i++) sum += decoder.decodeDouble(raw, position);
+    sink = sum;
+  });
+
+  printf("float legacy      encode %7.1f ns   decode %7.1f ns\n", legacyEncode, legacyDecode);
+  printf("float tDouble     encode %7.1f ns   decode %7.1f ns\n", rawEncode, rawDecode);
+}
+
+void benchmarkRequests(size_t iterations, bool encodeDouble) {
+  //Like a broadcastEvent: event source, peer ID, channel, variable names and values.
+  PArray variables = std::make_shared<Array>();
+  PArray values = std::make_shared<Array>();
+  const char *names[] = {"STATE", "LEVEL", "TEMPERATURE", "HUMIDITY"};
+  for (uint32_t i = 0; i < 4; i++) {
+    variables->push_back(std::make_shared<Variable>(std::string(names[i])));
+    values->push_back(std::make_shared<Variable>(21.5 + i));
+  }
+  PArray parameters = std::make_shared<Array>();
+  parameters->push_back(std::make_shared<Variable>(std::string("device-1234")));
+  parameters->push_back(std::make_shared<Variable>((int64_t)1234));
+  parameters->push_back(std::make_shared<Variable>(1));
+  parameters->push_back(std::make_shared<Variable>(variables));
+  parameters->push_back(std::make_shared<Variable>(values));
+
+  RpcEncoder encoder(true);
+  encoder.setEncodeDouble(encodeDouble);
+  RpcDecoder decoder;
+  std::vector<char> packet;
+  double encode = nanosecondsPerOperation(iterations, [&] {
+    for (size_t i = 0; i < iterations; i++) {
+      packet.clear();
+      encoder.encodeRequest("broadcastEvent", parameters, packet);
+    }
+  });
+  double decode = nanosecondsPerOperation(iterations, [&] {
+    std::string methodName;
+    size_t count = 0;
+    for (size_t i = 0; i < iterations; i++) count += decoder.decodeRequest(packet, methodName)->size();
+    sink = count;
+  });
+
+  printf("request %-9s encode %7.1f ns   decode %7.1f ns   (%zu bytes)\n", encodeDouble ? "tDouble" : "legacy", encode, decode, packet.size());
+}
+
+}
+
+int main(int argc, char *argv[]) {
+  size_t iterations = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+  if (iterations == 0) iterations = 1;
+  benchmarkFloats(iterations);
+  benchmarkRequests(iterations / 10 + 1, false);
+  benchmarkRequests(iterations / 10 + 1, true);
+  return 0;
+}
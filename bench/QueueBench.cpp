@@ -0,0 +1,117 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * libhomegear-base is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * libhomegear-base is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libhomegear-base.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+/*
+ * Queue throughput benchmark: the locked queue against the lock-free MPMC ring (see IQueue::setLockFree()) for different
+ * numbers of producers and processing threads. Prints nanoseconds per entry from the first enqueue until the last entry
+ * was processed, the best of three runs.
+ *
+ * Usage: QueueBench [entries]
+ */
+
+#include "IQueue.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+using namespace Ipc;
+
+namespace {
+
+class BenchEntry : public IQueueEntry {
+ public:
+  explicit BenchEntry(uint64_t value) : value(value) {}
+  uint64_t value = 0;
+};
+
+class BenchQueue : public IQueue {
+ public:
+  BenchQueue() : IQueue(1, 4096) {}
+
+  std::atomic<uint64_t> processed{0};
+  std::atomic<uint64_t> sum{0};
+
+  void processQueueEntry(int32_t index, std::shared_ptr<IQueueEntry> &entry) override {
+    sum += static_cast<BenchEntry *>(entry.get())->value;
+    processed++;
+  }
+};
+
+double run(bool lockFree, uint32_t producers, uint32_t consumers, uint64_t entriesPerProducer) {
+  BenchQueue queue;
+  queue.setLockFree(0, lockFree);
+  queue.startQueue(0, true, consumers);
+
+  //Allocate up front, so only enqueuing and processing are measured.
+  std::vector<std::vector<std::shared_ptr<IQueueEntry>>> entries(producers);
+  for (auto &producerEntries : entries) {
+    producerEntries.reserve(entriesPerProducer);
+    for (uint64_t i = 0; i < entriesPerProducer; i++) producerEntries.push_back(std::make_shared<BenchEntry>(i));
+  }
+
+  auto startTime = std::chrono::steady_clock::now();
+  std::vector<std::thread> producerThreads;
+  for (uint32_t i = 0; i < producers; i++) {
+    producerThreads.emplace_back([&queue, &entries, i] {
+      for (auto &entry : entries[i]) queue.enqueue(0, entry, true);
+    });
+  }
+  for (auto &thread : producerThreads) thread.join();
+  uint64_t total = producers * entriesPerProducer;
+  while (queue.processed < total) std::this_thread::yield();
+  double result = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - startTime).count() / total;
+  queue.stopQueue(0);
+  return result;
+}
+
+}
+
+int main(int argc, char *argv[]) {
+  uint64_t entries = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 400000;
+  const uint32_t threadCounts[] = {1, 4, 16};
+  printf("producers  consumers  locked ns/entry  ring ns/entry\n");
+  for (auto producers : threadCounts) {
+    for (auto consumers : threadCounts) {
+      uint64_t entriesPerProducer = std::max<uint64_t>(entries / producers, 1);
+      double locked = 1e18;
+      double ring = 1e18;
+      for (int i = 0; i < 3; i++) {
+        locked = std::min(locked, run(false, producers, consumers, entriesPerProducer));
+        ring = std::min(ring, run(true, producers, consumers, entriesPerProducer));
+      }
+      printf("%9u  %9u  %15.1f  %13.1f\n", producers, consumers, locked, ring);
+    }
+  }
+  return 0;
+}
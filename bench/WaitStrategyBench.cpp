@@ -0,0 +1,128 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * libhomegear-base is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * libhomegear-base is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libhomegear-base.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+/*
+ * Wait strategy benchmark: latency from enqueue until a processing thread starts on the entry, for every WaitStrategy,
+ * with the locked queue and the lock-free ring. Entries arrive sporadically, so the processing thread is idle before
+ * each one, which is the case the strategies differ in. Also prints the CPU time the process used while waiting.
+ *
+ * Usage: WaitStrategyBench [entries] [pause between entries in microseconds]
+ */
+
+#include "IQueue.h"
+#include "LatencyHistogram.h"
+#include "WaitStrategy.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <thread>
+
+using namespace Ipc;
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+class BenchEntry : public IQueueEntry {
+ public:
+  Clock::time_point time;
+};
+
+class BenchQueue : public IQueue {
+ public:
+  BenchQueue() : IQueue(1, 1000) {}
+
+  std::atomic<int64_t> latency{-1};
+
+  void processQueueEntry(int32_t index, std::shared_ptr<IQueueEntry> &entry) override {
+    latency = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - static_cast<BenchEntry *>(entry.get())->time).count();
+  }
+};
+
+double cpuSeconds() {
+  timespec time{};
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &time);
+  return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+void run(bool lockFree, WaitStrategy strategy, const char *name, uint32_t entries, uint32_t pause) {
+  BenchQueue queue;
+  queue.setLockFree(0, lockFree);
+  queue.setWaitStrategy(0, strategy);
+  queue.startQueue(0, false, 1);
+
+  LatencyHistogram histogram;
+  auto startTime = Clock::now();
+  double startCpu = cpuSeconds();
+  for (uint32_t i = 0; i < entries; i++) {
+    //Sleeping would give the CPU to the processing thread and distort "spinning", so busy wait.
+    auto until = Clock::now() + std::chrono::microseconds(pause);
+    while (Clock::now() < until) SpinWait::pause();
+
+    queue.latency = -1;
+    auto entry = std::make_shared<BenchEntry>();
+    entry->time = Clock::now();
+    std::shared_ptr<IQueueEntry> queueEntry = entry;
+    queue.enqueue(0, queueEntry);
+    while (queue.latency < 0) std::this_thread::yield();
+    histogram.record(queue.latency);
+  }
+  //The producer is busy all the time, so everything above one core was used by the processing thread.
+  double wallTime = std::chrono::duration<double>(Clock::now() - startTime).count();
+  double cpuTime = cpuSeconds() - startCpu;
+  queue.stopQueue(0);
+
+  auto snapshot = histogram.snapshot();
+  printf("%-6s  %-8s  %8.1f  %8.1f  %8.1f  %9.0f %%\n",
+         lockFree ? "ring" : "locked",
+         name,
+         snapshot.percentile(50.0) / 1000.0,
+         snapshot.percentile(99.0) / 1000.0,
+         snapshot.max / 1000.0,
+         (cpuTime / wallTime) * 100);
+}
+
+}
+
+int main(int argc, char *argv[]) {
+  uint32_t entries = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 2000;
+  uint32_t pause = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 50;
+  if (entries == 0) entries = 1;
+  printf("queue   strategy  p50 (us)  p99 (us)  max (us)  CPU usage\n");
+  for (auto lockFree : {false, true}) {
+    run(lockFree, WaitStrategy::blocking, "blocking", entries, pause);
+    run(lockFree, WaitStrategy::adaptive, "adaptive", entries, pause);
+    run(lockFree, WaitStrategy::spinning, "spinning", entries, pause);
+  }
+  return 0;
+}
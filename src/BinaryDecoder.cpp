@@ -29,167 +29,164 @@
 */
 
 #include "BinaryDecoder.h"
+#include "Math.h"
 
 namespace Ipc {
 
-BinaryDecoder::BinaryDecoder() {
-  checkEndianness();
-}
-
-void BinaryDecoder::checkEndianness() {
-  union {
-    uint32_t i;
-    char c[4];
-  } bint = {0x01020304};
-
-  _isBigEndian = bint.c[0] == 1;
-}
-
-void BinaryDecoder::memcpyBigEndian(char *to, const char *from, const uint32_t &length) const {
-  if (_isBigEndian) memcpy(to, from, length);
-  else {
-    uint32_t last = length - 1;
-    for (uint32_t i = 0; i < length; i++) {
-      to[i] = from[last - i];
-    }
-  }
-}
-
-void BinaryDecoder::memcpyBigEndian(uint8_t *to, const uint8_t *from, const uint32_t &length) {
-  memcpyBigEndian((char *)to, (char *)from, length);
-}
-
 int32_t BinaryDecoder::decodeInteger(std::vector<char> &encodedData, uint32_t &position) {
-  int32_t integer = 0;
-  if (position + 4 > encodedData.size()) return 0;
-  memcpyBigEndian((char *)&integer, &encodedData.at(position), 4);
-  position += 4;
-  return integer;
+  return decodeInteger(ByteSpan(encodedData), position);
 }
 
 int32_t BinaryDecoder::decodeInteger(std::vector<uint8_t> &encodedData, uint32_t &position) {
+  return decodeInteger(ByteSpan(encodedData), position);
+}
+
+int32_t BinaryDecoder::decodeInteger(const ByteSpan &encodedData, uint32_t &position) {
   int32_t integer = 0;
   if (position + 4 > encodedData.size()) return 0;
-  memcpyBigEndian((char *)&integer, (char *)&encodedData.at(position), 4);
+  integer = (int32_t)Endianness::readBigEndian32(encodedData.data() + position);
   position += 4;
   return integer;
 }
 
 int64_t BinaryDecoder::decodeInteger64(std::vector<char> &encodedData, uint32_t &position) {
-  int64_t integer = 0;
-  if (position + 8 > encodedData.size()) return 0;
-  memcpyBigEndian((char *)&integer, &encodedData.at(position), 8);
-  position += 8;
-  return integer;
+  return decodeInteger64(ByteSpan(encodedData), position);
 }
 
 int64_t BinaryDecoder::decodeInteger64(std::vector<uint8_t> &encodedData, uint32_t &position) {
+  return decodeInteger64(ByteSpan(encodedData), position);
+}
+
+int64_t BinaryDecoder::decodeInteger64(const ByteSpan &encodedData, uint32_t &position) {
   int64_t integer = 0;
   if (position + 8 > encodedData.size()) return 0;
-  memcpyBigEndian((char *)&integer, (char *)&encodedData.at(position), 8);
+  integer = (int64_t)Endianness::readBigEndian64(encodedData.data() + position);
   position += 8;
   return integer;
 }
 
 uint8_t BinaryDecoder::decodeByte(std::vector<char> &encodedData, uint32_t &position) {
-  uint8_t byte = 0;
-  if (position + 1 > encodedData.size()) return 0;
-  byte = encodedData.at(position);
-  position += 1;
-  return byte;
+  return decodeByte(ByteSpan(encodedData), position);
 }
 
 uint8_t BinaryDecoder::decodeByte(std::vector<uint8_t> &encodedData, uint32_t &position) {
+  return decodeByte(ByteSpan(encodedData), position);
+}
+
+uint8_t BinaryDecoder::decodeByte(const ByteSpan &encodedData, uint32_t &position) {
   uint8_t byte = 0;
   if (position + 1 > encodedData.size()) return 0;
-  byte = encodedData.at(position);
+  byte = encodedData[position];
   position += 1;
   return byte;
 }
 
 std::string BinaryDecoder::decodeString(std::vector<char> &encodedData, uint32_t &position) {
-  int32_t stringLength = decodeInteger(encodedData, position);
-  if (position + stringLength > encodedData.size() || stringLength == 0) return "";
-  std::string string(&encodedData.at(position), stringLength);
-  position += stringLength;
-  return string;
+  return decodeString(ByteSpan(encodedData), position);
 }
 
 std::string BinaryDecoder::decodeString(std::vector<uint8_t> &encodedData, uint32_t &position) {
+  return decodeString(ByteSpan(encodedData), position);
+}
+
+std::string BinaryDecoder::decodeString(const ByteSpan &encodedData, uint32_t &position) {
   int32_t stringLength = decodeInteger(encodedData, position);
   if (position + stringLength > encodedData.size() || stringLength == 0) return "";
-  std::string string((char *)&encodedData.at(position), stringLength);
+  std::string string(encodedData.data() + position, stringLength);
   position += stringLength;
   return string;
 }
 
 std::vector<uint8_t> BinaryDecoder::decodeBinary(std::vector<char> &encodedData, uint32_t &position) {
-  std::vector<uint8_t> data;
-  int32_t length = decodeInteger(encodedData, position);
-  if (position + length > encodedData.size() || length == 0) return data;
-  data.insert(data.end(), &encodedData.at(position), &encodedData.at(position) + length);
-  position += length;
-  return data;
+  return decodeBinary(ByteSpan(encodedData), position);
 }
 
 std::vector<uint8_t> BinaryDecoder::decodeBinary(std::vector<uint8_t> &encodedData, uint32_t &position) {
+  return decodeBinary(ByteSpan(encodedData), position);
+}
+
+std::vector<uint8_t> BinaryDecoder::decodeBinary(const ByteSpan &encodedData, uint32_t &position) {
   std::vector<uint8_t> data;
   int32_t length = decodeInteger(encodedData, position);
   if (position + length > encodedData.size() || length == 0) return data;
-  data.insert(data.end(), &encodedData.at(position), &encodedData.at(position) + length);
+  data.insert(data.end(), encodedData.data() + position, encodedData.data() + position + length);
   position += length;
   return data;
 }
 
-double BinaryDecoder::decodeFloat(std::vector<char> &encodedData, uint32_t &position) {
-  if (position + 8 > encodedData.size()) return 0;
-  int32_t mantissa = 0;
-  int32_t exponent = 0;
-  memcpyBigEndian((char *)&mantissa, &encodedData.at(position), 4);
-  position += 4;
-  memcpyBigEndian((char *)&exponent, &encodedData.at(position), 4);
-  position += 4;
-  double floatValue = (double)mantissa / 0x40000000;
-  floatValue *= std::pow(2, exponent);
-  if (floatValue != 0) {
-    int32_t digits = std::lround(std::floor(std::log10(floatValue) + 1));
-    double factor = std::pow(10, 9 - digits);
-    //Round to 9 digits
-    floatValue = std::floor(floatValue * factor + 0.5) / factor;
+double BinaryDecoder::getFloatValue(int32_t mantissa, int32_t exponent) {
+  double floatValue = std::ldexp((double)mantissa / 0x40000000, exponent);
+  if (!std::isnormal(floatValue)) return floatValue;
+
+  //Round to 9 digits. The number of decimal digits is derived from the binary exponent instead of calling log10.
+  double absoluteValue = std::abs(floatValue);
+  int32_t binaryExponent = 0;
+  std::frexp(absoluteValue, &binaryExponent);
+  //absoluteValue is in [2^(binaryExponent - 1), 2^binaryExponent), so the estimate is off by at most one.
+  int32_t digits = (int32_t)std::floor((binaryExponent - 1) * 0.30102999566398120) + 1;
+  int32_t decimalExponent = 9 - digits;
+  if (decimalExponent > 0 && decimalExponent <= 308 && absoluteValue * Math::Pow10(decimalExponent) >= 1e9) decimalExponent--;
+  else if (decimalExponent <= 0 && -decimalExponent <= 308 && absoluteValue / Math::Pow10(-decimalExponent) >= 1e9) decimalExponent--;
+  else if (decimalExponent == 309 && absoluteValue * Math::Pow10(308) >= 1e8) decimalExponent--; //Values just above 1e-300.
+  if (decimalExponent > 308 || decimalExponent < -308) return floatValue;
+
+  if (decimalExponent >= 0) {
+    double factor = Math::Pow10(decimalExponent);
+    absoluteValue = std::floor(absoluteValue * factor + 0.5) / factor;
+  } else {
+    double factor = Math::Pow10(-decimalExponent);
+    absoluteValue = std::floor(absoluteValue / factor + 0.5) * factor;
   }
-  return floatValue;
+  return floatValue < 0 ? -absoluteValue : absoluteValue;
+}
+
+double BinaryDecoder::decodeFloat(std::vector<char> &encodedData, uint32_t &position) {
+  return decodeFloat(ByteSpan(encodedData), position);
 }
 
 double BinaryDecoder::decodeFloat(std::vector<uint8_t> &encodedData, uint32_t &position) {
+  return decodeFloat(ByteSpan(encodedData), position);
+}
+
+double BinaryDecoder::decodeFloat(const ByteSpan &encodedData, uint32_t &position) {
   if (position + 8 > encodedData.size()) return 0;
   int32_t mantissa = 0;
   int32_t exponent = 0;
-  memcpyBigEndian((char *)&mantissa, (char *)&encodedData.at(position), 4);
+  mantissa = (int32_t)Endianness::readBigEndian32(encodedData.data() + position);
   position += 4;
-  memcpyBigEndian((char *)&exponent, (char *)&encodedData.at(position), 4);
+  exponent = (int32_t)Endianness::readBigEndian32(encodedData.data() + position);
   position += 4;
-  double floatValue = (double)mantissa / 0x40000000;
-  if (exponent >= 0) floatValue *= (1 << exponent);
-  else floatValue /= (1 << (exponent * -1));
-  if (floatValue != 0) {
-    int32_t digits = std::lround(std::floor(std::log10(floatValue) + 1));
-    double factor = std::pow(10, 9 - digits);
-    //Round to 9 digits
-    floatValue = std::floor(floatValue * factor + 0.5) / factor;
-  }
-  return floatValue;
+  return getFloatValue(mantissa, exponent);
+}
+
+double BinaryDecoder::decodeDouble(std::vector<char> &encodedData, uint32_t &position) {
+  return decodeDouble(ByteSpan(encodedData), position);
+}
+
+double BinaryDecoder::decodeDouble(std::vector<uint8_t> &encodedData, uint32_t &position) {
+  return decodeDouble(ByteSpan(encodedData), position);
+}
+
+double BinaryDecoder::decodeDouble(const ByteSpan &encodedData, uint32_t &position) {
+  if (position + 8 > encodedData.size()) return 0;
+  double doubleValue = 0;
+  uint64_t binary64 = Endianness::readBigEndian64(encodedData.data() + position);
+  memcpy(&doubleValue, &binary64, 8);
+  position += 8;
+  return doubleValue;
 }
 
 bool BinaryDecoder::decodeBoolean(std::vector<char> &encodedData, uint32_t &position) {
-  if (position + 1 > encodedData.size()) return 0;
-  bool boolean = (bool)encodedData.at(position);
-  position += 1;
-  return boolean;
+  return decodeBoolean(ByteSpan(encodedData), position);
 }
 
 bool BinaryDecoder::decodeBoolean(std::vector<uint8_t> &encodedData, uint32_t &position) {
+  return decodeBoolean(ByteSpan(encodedData), position);
+}
+
+bool BinaryDecoder::decodeBoolean(const ByteSpan &encodedData, uint32_t &position) {
   if (position + 1 > encodedData.size()) return 0;
-  bool boolean = (bool)encodedData.at(position);
+  bool boolean = (bool)encodedData[position];
   position += 1;
   return boolean;
 }
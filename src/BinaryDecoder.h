@@ -38,11 +38,14 @@
 #include <vector>
 #include <string>
 
+#include "Endianness.h"
+#include "ByteSpan.h"
+
 namespace Ipc {
 
 class BinaryDecoder {
  public:
-  BinaryDecoder();
+  BinaryDecoder() = default;
   virtual ~BinaryDecoder() = default;
 
   virtual int32_t decodeInteger(std::vector<char> &encodedData, uint32_t &position);
@@ -59,34 +62,23 @@ class BinaryDecoder {
   virtual bool decodeBoolean(std::vector<uint8_t> &encodedData, uint32_t &position);
   virtual double decodeFloat(std::vector<char> &encodedData, uint32_t &position);
   virtual double decodeFloat(std::vector<uint8_t> &encodedData, uint32_t &position);
- private:
-  /**
-   * The result of checkEndianness() is stored in this variable. This is done through calling "init".
-   */
-  bool _isBigEndian = true;
-
-  /**
-   * Checks if the system is little or big endian.
-   */
-  void checkEndianness();
-
-  /**
-   * Copies binary values from one memory location to another reversing the byte order when the system is little endian.
-   *
-   * @param[out] to The destination array. No memory is allocated, so make sure, the array is large enough.
-   * @param[in] from The source array.
-   * @param length The number of bytes to copy.
-   */
-  void memcpyBigEndian(char *to, const char *from, const uint32_t &length) const;
+  virtual double decodeDouble(std::vector<char> &encodedData, uint32_t &position);
+  virtual double decodeDouble(std::vector<uint8_t> &encodedData, uint32_t &position);
 
+  //Span versions of the methods above. They work on any contiguous memory. The vector versions wrap these.
+  virtual int32_t decodeInteger(const ByteSpan &encodedData, uint32_t &position);
+  virtual int64_t decodeInteger64(const ByteSpan &encodedData, uint32_t &position);
+  virtual uint8_t decodeByte(const ByteSpan &encodedData, uint32_t &position);
+  virtual std::string decodeString(const ByteSpan &encodedData, uint32_t &position);
+  virtual std::vector<uint8_t> decodeBinary(const ByteSpan &encodedData, uint32_t &position);
+  virtual bool decodeBoolean(const ByteSpan &encodedData, uint32_t &position);
+  virtual double decodeFloat(const ByteSpan &encodedData, uint32_t &position);
+  virtual double decodeDouble(const ByteSpan &encodedData, uint32_t &position);
+ private:
   /**
-   * Copies binary values from one memory location to another reversing the byte order when the system is little endian.
-   *
-   * @param[out] to The destination array. No memory is allocated, so make sure, the array is large enough.
-   * @param[in] from The source array.
-   * @param length The number of bytes to copy.
+   * Converts the 2.30 fixed point mantissa and the exponent of the legacy float format to double and rounds the result to 9 significant digits.
    */
-  void memcpyBigEndian(uint8_t *to, const uint8_t *from, const uint32_t &length);
+  static double getFloatValue(int32_t mantissa, int32_t exponent);
 };
 
 }
@@ -32,55 +32,24 @@
 
 namespace Ipc {
 
-BinaryEncoder::BinaryEncoder() {
-  checkEndianness();
-}
-
-void BinaryEncoder::checkEndianness() {
-  union {
-    uint32_t i;
-    char c[4];
-  } bint = {0x01020304};
-
-  _isBigEndian = bint.c[0] == 1;
-}
-
-void BinaryEncoder::memcpyBigEndian(char *to, const char *from, const uint32_t &length) {
-  if (_isBigEndian) memcpy(to, from, length);
-  else {
-    uint32_t last = length - 1;
-    for (uint32_t i = 0; i < length; i++) {
-      to[i] = from[last - i];
-    }
-  }
-}
-
-void BinaryEncoder::memcpyBigEndian(uint8_t *to, const uint8_t *from, const uint32_t &length) {
-  memcpyBigEndian((char *)to, (char *)from, length);
-}
-
 void BinaryEncoder::encodeInteger(std::vector<char> &encodedData, int32_t integer) {
-  char result[4];
-  memcpyBigEndian(result, (char *)&integer, 4);
-  encodedData.insert(encodedData.end(), result, result + 4);
+  VectorSink<std::vector<char>> sink(encodedData);
+  encodeInteger(sink, integer);
 }
 
 void BinaryEncoder::encodeInteger(std::vector<uint8_t> &encodedData, int32_t integer) {
-  uint8_t result[4];
-  memcpyBigEndian(result, (uint8_t *)&integer, 4);
-  encodedData.insert(encodedData.end(), result, result + 4);
+  VectorSink<std::vector<uint8_t>> sink(encodedData);
+  encodeInteger(sink, integer);
 }
 
 void BinaryEncoder::encodeInteger64(std::vector<char> &encodedData, int64_t integer) {
-  char result[8];
-  memcpyBigEndian(result, (char *)&integer, 8);
-  encodedData.insert(encodedData.end(), result, result + 8);
+  VectorSink<std::vector<char>> sink(encodedData);
+  encodeInteger64(sink, integer);
 }
 
 void BinaryEncoder::encodeInteger64(std::vector<uint8_t> &encodedData, int64_t integer) {
-  char result[8];
-  memcpyBigEndian(result, (char *)&integer, 8);
-  encodedData.insert(encodedData.end(), result, result + 8);
+  VectorSink<std::vector<uint8_t>> sink(encodedData);
+  encodeInteger64(sink, integer);
 }
 
 void BinaryEncoder::encodeByte(std::vector<char> &encodedData, uint8_t byte) {
@@ -92,23 +61,23 @@ void BinaryEncoder::encodeByte(std::vector<uint8_t> &encodedData, uint8_t byte)
 }
 
 void BinaryEncoder::encodeString(std::vector<char> &encodedData, std::string &string) {
-  encodeInteger(encodedData, string.size());
-  if (string.size() > 0) encodedData.insert(encodedData.end(), string.begin(), string.end());
+  VectorSink<std::vector<char>> sink(encodedData);
+  encodeString(sink, string);
 }
 
 void BinaryEncoder::encodeString(std::vector<uint8_t> &encodedData, std::string &string) {
-  encodeInteger(encodedData, string.size());
-  if (string.size() > 0) encodedData.insert(encodedData.end(), string.begin(), string.end());
+  VectorSink<std::vector<uint8_t>> sink(encodedData);
+  encodeString(sink, string);
 }
 
 void BinaryEncoder::encodeBinary(std::vector<char> &encodedData, std::vector<uint8_t> &data) {
-  encodeInteger(encodedData, data.size());
-  if (data.size() > 0) encodedData.insert(encodedData.end(), data.begin(), data.end());
+  VectorSink<std::vector<char>> sink(encodedData);
+  encodeBinary(sink, data);
 }
 
 void BinaryEncoder::encodeBinary(std::vector<uint8_t> &encodedData, std::vector<uint8_t> &data) {
-  encodeInteger(encodedData, data.size());
-  if (data.size() > 0) encodedData.insert(encodedData.end(), data.begin(), data.end());
+  VectorSink<std::vector<uint8_t>> sink(encodedData);
+  encodeBinary(sink, data);
 }
 
 void BinaryEncoder::encodeBoolean(std::vector<char> &encodedData, bool boolean) {
@@ -119,54 +88,33 @@ void BinaryEncoder::encodeBoolean(std::vector<uint8_t> &encodedData, bool boolea
   encodedData.push_back((uint8_t)boolean);
 }
 
+void BinaryEncoder::getMantissaAndExponent(double floatValue, int32_t &mantissa, int32_t &exponent) {
+  exponent = 0;
+  mantissa = 0;
+  if (!std::isnormal(floatValue)) return;
+  //frexp returns the mantissa in [0.5, 1), which is exactly the range the format expects.
+  double temp = std::frexp(floatValue, &exponent);
+  mantissa = std::lround(temp * 0x40000000);
+}
+
 void BinaryEncoder::encodeFloat(std::vector<char> &encodedData, double floatValue) {
-  double temp = std::abs(floatValue);
-  int32_t exponent = 0;
-  int32_t mantissa = 0;
-  if (std::isnormal(temp)) {
-    if (temp != 0 && temp < 0.5) {
-      while (temp < 0.5) {
-        temp *= 2;
-        exponent--;
-      }
-    } else {
-      while (temp >= 1) {
-        temp /= 2;
-        exponent++;
-      }
-    }
-    if (floatValue < 0) { temp *= -1; }
-    mantissa = std::lround(temp * 0x40000000);
-  }
-  char data[8];
-  memcpyBigEndian(data, (char *)&mantissa, 4);
-  memcpyBigEndian(data + 4, (char *)&exponent, 4);
-  encodedData.insert(encodedData.end(), data, data + 8);
+  VectorSink<std::vector<char>> sink(encodedData);
+  encodeFloat(sink, floatValue);
 }
 
 void BinaryEncoder::encodeFloat(std::vector<uint8_t> &encodedData, double floatValue) {
-  double temp = std::abs(floatValue);
-  int32_t exponent = 0;
-  int32_t mantissa = 0;
-  if (std::isnormal(temp)) {
-    if (temp != 0 && temp < 0.5) {
-      while (temp < 0.5) {
-        temp *= 2;
-        exponent--;
-      }
-    } else {
-      while (temp >= 1) {
-        temp /= 2;
-        exponent++;
-      }
-    }
-    if (floatValue < 0) { temp *= -1; }
-    mantissa = std::lround(temp * 0x40000000);
-  }
-  char data[8];
-  memcpyBigEndian(data, (char *)&mantissa, 4);
-  memcpyBigEndian(data + 4, (char *)&exponent, 4);
-  encodedData.insert(encodedData.end(), data, data + 8);
+  VectorSink<std::vector<uint8_t>> sink(encodedData);
+  encodeFloat(sink, floatValue);
+}
+
+void BinaryEncoder::encodeDouble(std::vector<char> &encodedData, double doubleValue) {
+  VectorSink<std::vector<char>> sink(encodedData);
+  encodeDouble(sink, doubleValue);
+}
+
+void BinaryEncoder::encodeDouble(std::vector<uint8_t> &encodedData, double doubleValue) {
+  VectorSink<std::vector<uint8_t>> sink(encodedData);
+  encodeDouble(sink, doubleValue);
 }
 
 }
@@ -38,11 +38,14 @@
 #include <vector>
 #include <string>
 
+#include "Endianness.h"
+#include "ByteSink.h"
+
 namespace Ipc {
 
 class BinaryEncoder {
  public:
-  BinaryEncoder();
+  BinaryEncoder() = default;
   virtual ~BinaryEncoder() = default;
 
   void encodeInteger(std::vector<char> &encodedData, int32_t integer);
@@ -59,34 +62,74 @@ class BinaryEncoder {
   void encodeBoolean(std::vector<uint8_t> &encodedData, bool boolean);
   void encodeFloat(std::vector<char> &encodedData, double floatValue);
   void encodeFloat(std::vector<uint8_t> &encodedData, double floatValue);
- private:
-  /**
-   * The result of checkEndianness() is stored in this variable. This is done through calling "init".
-   */
-  bool _isBigEndian = true;
 
   /**
-   * Checks if the system is little or big endian.
+   * Encodes a double as raw IEEE 754 binary64 value (big endian). Only use this when the other side understands VariableType::tDouble.
    */
-  void checkEndianness();
+  void encodeDouble(std::vector<char> &encodedData, double doubleValue);
+  void encodeDouble(std::vector<uint8_t> &encodedData, double doubleValue);
 
-  /**
-   * Copies binary values from one memory location to another reversing the byte order when the system is little endian.
-   *
-   * @param[out] to The destination array. No memory is allocated, so make sure, the array is large enough.
-   * @param[in] from The source array.
-   * @param length The number of bytes to copy.
-   */
-  void memcpyBigEndian(char *to, const char *from, const uint32_t &length);
+  //Sink versions of the methods above (see ByteSink.h). The vector versions wrap these.
+  template<typename Sink>
+  void encodeInteger(Sink &sink, int32_t integer) {
+    char result[4];
+    Endianness::writeBigEndian32(result, (uint32_t)integer);
+    sink.append(result, 4);
+  }
+
+  template<typename Sink>
+  void encodeInteger64(Sink &sink, int64_t integer) {
+    char result[8];
+    Endianness::writeBigEndian64(result, (uint64_t)integer);
+    sink.append(result, 8);
+  }
 
+  template<typename Sink>
+  void encodeByte(Sink &sink, uint8_t byte) {
+    sink.push_back((char)byte);
+  }
+
+  template<typename Sink>
+  void encodeString(Sink &sink, const std::string &string) {
+    encodeInteger(sink, string.size());
+    if (!string.empty()) sink.append(string.data(), string.size());
+  }
+
+  template<typename Sink>
+  void encodeBinary(Sink &sink, const std::vector<uint8_t> &data) {
+    encodeInteger(sink, data.size());
+    if (!data.empty()) sink.append((const char *)data.data(), data.size());
+  }
+
+  template<typename Sink>
+  void encodeBoolean(Sink &sink, bool boolean) {
+    sink.push_back((char)boolean);
+  }
+
+  template<typename Sink>
+  void encodeFloat(Sink &sink, double floatValue) {
+    int32_t exponent = 0;
+    int32_t mantissa = 0;
+    getMantissaAndExponent(floatValue, mantissa, exponent);
+    char data[8];
+    Endianness::writeBigEndian32(data, (uint32_t)mantissa);
+    Endianness::writeBigEndian32(data + 4, (uint32_t)exponent);
+    sink.append(data, 8);
+  }
+
+  template<typename Sink>
+  void encodeDouble(Sink &sink, double doubleValue) {
+    char data[8];
+    uint64_t binary64;
+    memcpy(&binary64, &doubleValue, 8);
+    Endianness::writeBigEndian64(data, binary64);
+    sink.append(data, 8);
+  }
+ private:
   /**
-   * Copies binary values from one memory location to another reversing the byte order when the system is little endian.
-   *
-   * @param[out] to The destination array. No memory is allocated, so make sure, the array is large enough.
-   * @param[in] from The source array.
-   * @param length The number of bytes to copy.
+   * Splits a double into the 2.30 fixed point mantissa and the exponent of the legacy float format.
    */
-  void memcpyBigEndian(uint8_t *to, const uint8_t *from, const uint32_t &length);
+  static void getMantissaAndExponent(double floatValue, int32_t &mantissa, int32_t &exponent);
 };
 }
 #endif
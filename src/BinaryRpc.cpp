@@ -34,32 +34,12 @@ namespace Ipc {
 
 BinaryRpc::BinaryRpc() {
   _data.reserve(1024);
-  checkEndianness();
 }
 
 BinaryRpc::~BinaryRpc() {
 
 }
 
-void BinaryRpc::checkEndianness() {
-  union {
-    uint32_t i;
-    char c[4];
-  } bint = {0x01020304};
-
-  _isBigEndian = bint.c[0] == 1;
-}
-
-void BinaryRpc::memcpyBigEndian(char *to, const char *from, const uint32_t &length) {
-  if (_isBigEndian) memcpy(to, from, length);
-  else {
-    uint32_t last = length - 1;
-    for (uint32_t i = 0; i < length; i++) {
-      to[i] = from[last - i];
-    }
-  }
-}
-
 int32_t BinaryRpc::process(char *buffer, int32_t bufferLength) {
   int32_t initialBufferLength = bufferLength;
   if (bufferLength <= 0 || _finished) return 0;
@@ -80,10 +60,10 @@ int32_t BinaryRpc::process(char *buffer, int32_t bufferLength) {
   _type = (_data[3] & 1) ? Type::response : Type::request;
   if (_data[3] == 0x40 || _data[3] == 0x41) {
     _hasHeader = true;
-    memcpyBigEndian((char *)&_headerSize, _data.data() + 4, 4);
+    _headerSize = Endianness::readBigEndian32(_data.data() + 4);
     if (_headerSize > 10485760) throw BinaryRpcException("Header is larger than 10 MiB.");
   } else {
-    memcpyBigEndian((char *)&_dataSize, _data.data() + 4, 4);
+    _dataSize = Endianness::readBigEndian32(_data.data() + 4);
     if (_dataSize > 104857600) throw BinaryRpcException("Data is data larger than 100 MiB.");
   }
   if (_dataSize == 0 && _headerSize == 0) {
@@ -101,7 +81,7 @@ int32_t BinaryRpc::process(char *buffer, int32_t bufferLength) {
     _data.insert(_data.end(), buffer, buffer + sizeToInsert);
     buffer += sizeToInsert;
     bufferLength -= sizeToInsert;
-    memcpyBigEndian((char *)&_dataSize, _data.data() + 8 + _headerSize, 4);
+    _dataSize = Endianness::readBigEndian32(_data.data() + 8 + _headerSize);
     _dataSize += _headerSize + 4;
     if (_dataSize > 104857600) throw BinaryRpcException("Data is data larger than 100 MiB.");
   }
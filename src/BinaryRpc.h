@@ -34,6 +34,7 @@
 #include "Variable.h"
 #include <cstring>
 #include "IpcException.h"
+#include "Endianness.h"
 
 namespace Ipc {
 
@@ -77,25 +78,6 @@ class BinaryRpc {
   uint32_t _headerSize = 0;
   uint32_t _dataSize = 0;
   std::vector<char> _data;
-
-  /**
-   * The result of checkEndianness() is stored in this variable. This is done through calling "init".
-   */
-  bool _isBigEndian = true;
-
-  /**
-   * Checks if the system is little or big endian.
-   */
-  void checkEndianness();
-
-  /**
-   * Copies binary values from one memory location to another reversing the byte order when the system is little endian.
-   *
-   * @param[out] to The destination array. No memory is allocated, so make sure, the array is large enough.
-   * @param[in] from The source array.
-   * @param length The number of bytes to copy.
-   */
-  void memcpyBigEndian(char *to, const char *from, const uint32_t &length);
 };
 
 }
@@ -0,0 +1,72 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * libhomegear-base is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * libhomegear-base is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libhomegear-base.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#include "ByteBudget.h"
+
+namespace Ipc {
+
+ByteBudget::ByteBudget(size_t limit) : _limit(limit) {
+}
+
+bool ByteBudget::tryAcquire(size_t bytes) {
+  size_t used = _used.load(std::memory_order_relaxed);
+  do {
+    if (used != 0 && used + bytes > _limit) return false;
+  } while (!_used.compare_exchange_weak(used, used + bytes, std::memory_order_relaxed));
+  return true;
+}
+
+void ByteBudget::acquire(size_t bytes) {
+  _used.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void ByteBudget::release(size_t bytes) {
+  if (bytes == 0) return;
+  _used.fetch_sub(bytes, std::memory_order_relaxed);
+  //Pairs with the fence in waitForSpace(): Either the waiting thread sees the released bytes or we see it waiting.
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (_waiting.load(std::memory_order_relaxed) == 0) return;
+  {
+    std::lock_guard<std::mutex> waitGuard(_waitMutex);
+  }
+  _conditionVariable.notify_all();
+}
+
+bool ByteBudget::waitForSpace(uint32_t timeout) {
+  if (!exhausted()) return true;
+  std::unique_lock<std::mutex> waitLock(_waitMutex);
+  ++_waiting;
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  bool hasSpace = _conditionVariable.wait_for(waitLock, std::chrono::milliseconds(timeout), [&] { return !exhausted(); });
+  --_waiting;
+  return hasSpace;
+}
+
+}
@@ -0,0 +1,101 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * libhomegear-base is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * libhomegear-base is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libhomegear-base.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#ifndef IPCBYTEBUDGET_H_
+#define IPCBYTEBUDGET_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+namespace Ipc {
+
+/**
+ * A limit for the total size of queued entries. One budget can be shared by many queues (see
+ * TypedQueue::setByteBudget()) and many clients (see IIpcClient::setByteBudget()), e.g. to bound the memory of all IPC
+ * clients of a process. Thread safe.
+ */
+class ByteBudget {
+ public:
+  /**
+   * @param limit The budget in bytes.
+   */
+  explicit ByteBudget(size_t limit);
+  virtual ~ByteBudget() = default;
+
+  ByteBudget(const ByteBudget &) = delete;
+  ByteBudget &operator=(const ByteBudget &) = delete;
+
+  size_t limit() const { return _limit; }
+
+  /**
+   * The number of bytes acquired and not released yet. Can be larger than the limit (see acquire()).
+   */
+  size_t used() const { return _used.load(std::memory_order_relaxed); }
+
+  bool exhausted() const { return used() >= _limit; }
+
+  /**
+   * Acquires "bytes" when they fit into the budget. When nothing is acquired, any size fits, so entries larger than
+   * the budget aren't refused forever.
+   *
+   * @return Returns false when the bytes don't fit.
+   */
+  bool tryAcquire(size_t bytes);
+
+  /**
+   * Acquires "bytes" even when this exceeds the budget. For producers that are throttled otherwise (see
+   * waitForSpace()).
+   */
+  void acquire(size_t bytes);
+
+  void release(size_t bytes);
+
+  /**
+   * Waits until the budget isn't exhausted anymore.
+   *
+   * @param timeout The maximum time to wait in milliseconds.
+   * @return Returns false on timeout.
+   */
+  bool waitForSpace(uint32_t timeout);
+ private:
+  size_t _limit = 0;
+  std::atomic<size_t> _used{0};
+
+  //The counter of waiting threads tells release() whether it needs to notify.
+  std::atomic<uint32_t> _waiting{0};
+  std::mutex _waitMutex;
+  std::condition_variable _conditionVariable;
+};
+
+}
+#endif
@@ -0,0 +1,156 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * libhomegear-base is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * libhomegear-base is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libhomegear-base.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#ifndef IPCBYTESINK_H_
+#define IPCBYTESINK_H_
+
+#include "IpcException.h"
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <string>
+#include <sys/uio.h>
+
+namespace Ipc {
+
+class ByteSinkException : public IpcException {
+ public:
+  explicit ByteSinkException(const std::string &message) : IpcException(message) {}
+};
+
+/*
+ * The encoders (BinaryEncoder, RpcEncoder and JsonEncoder) write through a "sink". A sink is any class providing:
+ *
+ *   void reserve(size_t size);                   //Hint that "size" more bytes are about to be appended.
+ *   void append(const char *data, size_t size);  //Appends "size" bytes.
+ *   void push_back(char c);                      //Appends a single byte.
+ *   size_t size() const;                         //Number of bytes appended so far.
+ *
+ * Sinks only ever append, so encoding never needs to seek back into data already written.
+ */
+
+/**
+ * Sink appending to a std::vector<char>, std::vector<uint8_t> or std::string. The container is not cleared.
+ */
+template<typename Container>
+class VectorSink {
+ public:
+  explicit VectorSink(Container &container) : _container(container) {}
+
+  void reserve(size_t size) {
+    if (_container.capacity() - _container.size() < size) _container.reserve(_container.size() + size);
+  }
+  void append(const char *data, size_t size) { _container.insert(_container.end(), data, data + size); }
+  void push_back(char c) { _container.push_back(c); }
+  size_t size() const { return _container.size(); }
+ private:
+  Container &_container;
+};
+
+/**
+ * Sink writing to a caller-provided fixed size buffer. Throws ByteSinkException when the buffer is too small. As
+ * RpcEncoder reserves the exact packet size up front, this happens before anything is written.
+ */
+class BufferSink {
+ public:
+  BufferSink(char *buffer, size_t capacity) : _buffer(buffer), _capacity(capacity) {}
+  BufferSink(uint8_t *buffer, size_t capacity) : _buffer((char *)buffer), _capacity(capacity) {}
+
+  void reserve(size_t size) {
+    if (size > _capacity - _size) throw ByteSinkException("Buffer is too small: " + std::to_string(_size + size) + " bytes are needed, but only " + std::to_string(_capacity) + " are available.");
+  }
+  void append(const char *data, size_t size) {
+    reserve(size);
+    if (size > 0) memcpy(_buffer + _size, data, size);
+    _size += size;
+  }
+  void push_back(char c) {
+    reserve(1);
+    _buffer[_size++] = c;
+  }
+  size_t size() const { return _size; }
+  const char *data() const { return _buffer; }
+  void clear() { _size = 0; }
+ private:
+  char *_buffer = nullptr;
+  size_t _capacity = 0;
+  size_t _size = 0;
+};
+
+/**
+ * Sink scattering the output over a list of caller-provided buffers, e. g. to pass them to writev(). A ring buffer
+ * can be written to by passing its free space as two segments. Throws ByteSinkException when all segments are full.
+ */
+class IovecSink {
+ public:
+  IovecSink(const struct iovec *segments, size_t segmentCount) : _segments(segments), _segmentCount(segmentCount) {
+    for (size_t i = 0; i < segmentCount; i++) {
+      _capacity += segments[i].iov_len;
+    }
+  }
+
+  void reserve(size_t size) {
+    if (size > _capacity - _size) throw ByteSinkException("Segments are too small: " + std::to_string(_size + size) + " bytes are needed, but only " + std::to_string(_capacity) + " are available.");
+  }
+  void append(const char *data, size_t size) {
+    reserve(size);
+    _size += size;
+    while (size > 0) {
+      size_t bytesToCopy = _segments[_segmentIndex].iov_len - _segmentPosition;
+      if (bytesToCopy > size) bytesToCopy = size;
+      memcpy((char *)_segments[_segmentIndex].iov_base + _segmentPosition, data, bytesToCopy);
+      data += bytesToCopy;
+      size -= bytesToCopy;
+      _segmentPosition += bytesToCopy;
+      if (_segmentPosition == _segments[_segmentIndex].iov_len) {
+        _segmentIndex++;
+        _segmentPosition = 0;
+      }
+    }
+  }
+  void push_back(char c) { append(&c, 1); }
+  size_t size() const { return _size; }
+
+  /**
+   * Returns the number of segments containing data, including the last partially filled one.
+   */
+  size_t segmentsUsed() const { return _segmentPosition > 0 ? _segmentIndex + 1 : _segmentIndex; }
+ private:
+  const struct iovec *_segments = nullptr;
+  size_t _segmentCount = 0;
+  size_t _segmentIndex = 0;
+  size_t _segmentPosition = 0;
+  size_t _capacity = 0;
+  size_t _size = 0;
+};
+
+}
+#endif
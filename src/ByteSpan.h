@@ -0,0 +1,72 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * libhomegear-base is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * libhomegear-base is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libhomegear-base.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#ifndef IPCBYTESPAN_H_
+#define IPCBYTESPAN_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <string>
+#include <stdexcept>
+
+namespace Ipc {
+
+/**
+ * Read-only view of contiguous encoded data the decoders work on. It implicitly converts from std::vector<char>,
+ * std::vector<uint8_t> and std::string, so any of them can be passed to the decoders without copying. The viewed
+ * memory has to stay valid as long as the span is used.
+ */
+class ByteSpan {
+ public:
+  ByteSpan() = default;
+  ByteSpan(const void *data, size_t size) : _data((const char *)data), _size(size) {}
+  ByteSpan(const std::vector<char> &data) : _data(data.data()), _size(data.size()) {}
+  ByteSpan(const std::vector<uint8_t> &data) : _data((const char *)data.data()), _size(data.size()) {}
+  ByteSpan(const std::string &data) : _data(data.data()), _size(data.size()) {}
+
+  const char *data() const { return _data; }
+  size_t size() const { return _size; }
+  bool empty() const { return _size == 0; }
+  const char *begin() const { return _data; }
+  const char *end() const { return _data + _size; }
+
+  const char &operator[](size_t index) const { return _data[index]; }
+  const char &at(size_t index) const {
+    if (index >= _size) throw std::out_of_range("ByteSpan: Index " + std::to_string(index) + " is out of range (size is " + std::to_string(_size) + ").");
+    return _data[index];
+  }
+ private:
+  const char *_data = nullptr;
+  size_t _size = 0;
+};
+
+}
+#endif
@@ -0,0 +1,159 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * libhomegear-base is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * libhomegear-base is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libhomegear-base.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#include "Endianness.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define IPC_X86_SIMD 1
+#endif
+
+namespace Ipc {
+
+namespace {
+
+void swapArray32Scalar(uint32_t *to, const uint32_t *from, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    to[i] = __builtin_bswap32(from[i]);
+  }
+}
+
+void swapArray64Scalar(uint64_t *to, const uint64_t *from, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    to[i] = __builtin_bswap64(from[i]);
+  }
+}
+
+#ifdef IPC_X86_SIMD
+__attribute__((target("ssse3"))) void swapArray32Ssse3(uint32_t *to, const uint32_t *from, size_t count) {
+  const __m128i mask = _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m128i value = _mm_loadu_si128((const __m128i *)(from + i));
+    _mm_storeu_si128((__m128i *)(to + i), _mm_shuffle_epi8(value, mask));
+  }
+  swapArray32Scalar(to + i, from + i, count - i);
+}
+
+__attribute__((target("ssse3"))) void swapArray64Ssse3(uint64_t *to, const uint64_t *from, size_t count) {
+  const __m128i mask = _mm_set_epi8(8, 9, 10, 11, 12, 13, 14, 15, 0, 1, 2, 3, 4, 5, 6, 7);
+  size_t i = 0;
+  for (; i + 2 <= count; i += 2) {
+    __m128i value = _mm_loadu_si128((const __m128i *)(from + i));
+    _mm_storeu_si128((__m128i *)(to + i), _mm_shuffle_epi8(value, mask));
+  }
+  swapArray64Scalar(to + i, from + i, count - i);
+}
+
+__attribute__((target("avx2"))) void swapArray32Avx2(uint32_t *to, const uint32_t *from, size_t count) {
+  //vpshufb shuffles within each 128 bit lane, so both lanes use the same mask.
+  const __m256i mask = _mm256_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3,
+                                       12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m256i value = _mm256_loadu_si256((const __m256i *)(from + i));
+    _mm256_storeu_si256((__m256i *)(to + i), _mm256_shuffle_epi8(value, mask));
+  }
+  swapArray32Scalar(to + i, from + i, count - i);
+}
+
+__attribute__((target("avx2"))) void swapArray64Avx2(uint64_t *to, const uint64_t *from, size_t count) {
+  const __m256i mask = _mm256_set_epi8(8, 9, 10, 11, 12, 13, 14, 15, 0, 1, 2, 3, 4, 5, 6, 7,
+                                       8, 9, 10, 11, 12, 13, 14, 15, 0, 1, 2, 3, 4, 5, 6, 7);
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m256i value = _mm256_loadu_si256((const __m256i *)(from + i));
+    _mm256_storeu_si256((__m256i *)(to + i), _mm256_shuffle_epi8(value, mask));
+  }
+  swapArray64Scalar(to + i, from + i, count - i);
+}
+#endif
+
+typedef void (*SwapArray32Function)(uint32_t *, const uint32_t *, size_t);
+typedef void (*SwapArray64Function)(uint64_t *, const uint64_t *, size_t);
+
+SwapArray32Function getSwapArray32Function(Endianness::SimdLevel level) {
+#ifdef IPC_X86_SIMD
+  if (level == Endianness::SimdLevel::avx2) return &swapArray32Avx2;
+  if (level == Endianness::SimdLevel::ssse3) return &swapArray32Ssse3;
+#endif
+  return &swapArray32Scalar;
+}
+
+SwapArray64Function getSwapArray64Function(Endianness::SimdLevel level) {
+#ifdef IPC_X86_SIMD
+  if (level == Endianness::SimdLevel::avx2) return &swapArray64Avx2;
+  if (level == Endianness::SimdLevel::ssse3) return &swapArray64Ssse3;
+#endif
+  return &swapArray64Scalar;
+}
+
+}
+
+Endianness::SimdLevel Endianness::getSimdLevel() {
+#ifdef IPC_X86_SIMD
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) return SimdLevel::avx2;
+  if (__builtin_cpu_supports("ssse3")) return SimdLevel::ssse3;
+#endif
+  return SimdLevel::scalar;
+}
+
+void Endianness::swapArray32(uint32_t *to, const uint32_t *from, size_t count) {
+  static const SwapArray32Function swapArray = getSwapArray32Function(getSimdLevel());
+  swapArray(to, from, count);
+}
+
+void Endianness::swapArray64(uint64_t *to, const uint64_t *from, size_t count) {
+  static const SwapArray64Function swapArray = getSwapArray64Function(getSimdLevel());
+  swapArray(to, from, count);
+}
+
+void Endianness::swapArray32(uint32_t *to, const uint32_t *from, size_t count, SimdLevel level) {
+  getSwapArray32Function(level)(to, from, count);
+}
+
+void Endianness::swapArray64(uint64_t *to, const uint64_t *from, size_t count, SimdLevel level) {
+  getSwapArray64Function(level)(to, from, count);
+}
+
+void Endianness::toBigEndianArray32(uint32_t *to, const uint32_t *from, size_t count) {
+  if (isBigEndian()) {
+    if (to != from) memmove(to, from, count * 4);
+  } else swapArray32(to, from, count);
+}
+
+void Endianness::toBigEndianArray64(uint64_t *to, const uint64_t *from, size_t count) {
+  if (isBigEndian()) {
+    if (to != from) memmove(to, from, count * 8);
+  } else swapArray64(to, from, count);
+}
+
+}
@@ -0,0 +1,159 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * libhomegear-base is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * libhomegear-base is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libhomegear-base.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#ifndef IPCENDIANNESS_H_
+#define IPCENDIANNESS_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+#if defined(__BYTE_ORDER__)
+#define IPC_BIG_ENDIAN (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+#else
+#include <endian.h>
+#define IPC_BIG_ENDIAN (__BYTE_ORDER == __BIG_ENDIAN)
+#endif
+
+namespace Ipc {
+
+/**
+ * Conversion between host byte order and the big endian byte order used on the wire. The byte order is determined at
+ * compile time, so on little endian systems every conversion is a single bswap instruction.
+ */
+class Endianness {
+ public:
+  /**
+   * The instruction sets swapArray32() and swapArray64() can use.
+   */
+  enum class SimdLevel {
+    scalar,
+    ssse3,
+    avx2
+  };
+
+  static constexpr bool isBigEndian() { return IPC_BIG_ENDIAN; }
+
+  static inline uint16_t swap16(uint16_t value) { return __builtin_bswap16(value); }
+  static inline uint32_t swap32(uint32_t value) { return __builtin_bswap32(value); }
+  static inline uint64_t swap64(uint64_t value) { return __builtin_bswap64(value); }
+
+  static inline uint32_t toBigEndian32(uint32_t value) { return isBigEndian() ? value : swap32(value); }
+  static inline uint64_t toBigEndian64(uint64_t value) { return isBigEndian() ? value : swap64(value); }
+  static inline uint32_t fromBigEndian32(uint32_t value) { return toBigEndian32(value); }
+  static inline uint64_t fromBigEndian64(uint64_t value) { return toBigEndian64(value); }
+
+  /**
+   * Writes a 32 bit value in big endian byte order to an unaligned memory location.
+   *
+   * @param[out] to The destination. No memory is allocated, so make sure at least 4 bytes are available.
+   * @param value The value to write.
+   */
+  static inline void writeBigEndian32(void *to, uint32_t value) {
+    value = toBigEndian32(value);
+    memcpy(to, &value, 4);
+  }
+
+  /**
+   * Writes a 64 bit value in big endian byte order to an unaligned memory location.
+   *
+   * @param[out] to The destination. No memory is allocated, so make sure at least 8 bytes are available.
+   * @param value The value to write.
+   */
+  static inline void writeBigEndian64(void *to, uint64_t value) {
+    value = toBigEndian64(value);
+    memcpy(to, &value, 8);
+  }
+
+  /**
+   * Reads a 32 bit big endian value from an unaligned memory location.
+   */
+  static inline uint32_t readBigEndian32(const void *from) {
+    uint32_t value;
+    memcpy(&value, from, 4);
+    return fromBigEndian32(value);
+  }
+
+  /**
+   * Reads a 64 bit big endian value from an unaligned memory location.
+   */
+  static inline uint64_t readBigEndian64(const void *from) {
+    uint64_t value;
+    memcpy(&value, from, 8);
+    return fromBigEndian64(value);
+  }
+
+  /**
+   * Reverses the byte order of every element of an array. Uses AVX2 or SSSE3 shuffles when the CPU supports them.
+   *
+   * @param[out] to The destination array. May be the same as "from".
+   * @param[in] from The source array.
+   * @param count The number of elements.
+   */
+  static void swapArray32(uint32_t *to, const uint32_t *from, size_t count);
+
+  /**
+   * Reverses the byte order of every element of an array. Uses AVX2 or SSSE3 shuffles when the CPU supports them.
+   *
+   * @param[out] to The destination array. May be the same as "from".
+   * @param[in] from The source array.
+   * @param count The number of elements.
+   */
+  static void swapArray64(uint64_t *to, const uint64_t *from, size_t count);
+
+  /**
+   * Returns the best instruction set the CPU supports. swapArray32() and swapArray64() use this one.
+   */
+  static SimdLevel getSimdLevel();
+
+  /**
+   * Same as swapArray32() and swapArray64(), but with the given instruction set, e.g. to compare the implementations in
+   * tests. The CPU must support "level" (see getSimdLevel()).
+   */
+  static void swapArray32(uint32_t *to, const uint32_t *from, size_t count, SimdLevel level);
+  static void swapArray64(uint64_t *to, const uint64_t *from, size_t count, SimdLevel level);
+
+  /**
+   * Converts an array of integers from host byte order to big endian. Does nothing but copy on big endian systems.
+   */
+  static void toBigEndianArray32(uint32_t *to, const uint32_t *from, size_t count);
+  static void toBigEndianArray64(uint64_t *to, const uint64_t *from, size_t count);
+
+  /**
+   * Converts an array of big endian integers to host byte order. Does nothing but copy on big endian systems.
+   */
+  static void fromBigEndianArray32(uint32_t *to, const uint32_t *from, size_t count) { toBigEndianArray32(to, from, count); }
+  static void fromBigEndianArray64(uint64_t *to, const uint64_t *from, size_t count) { toBigEndianArray64(to, from, count); }
+ private:
+  Endianness() = delete;
+};
+
+}
+#endif
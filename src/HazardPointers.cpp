@@ -0,0 +1,87 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * libhomegear-base is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * libhomegear-base is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libhomegear-base.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#include "HazardPointers.h"
+
+namespace Ipc {
+
+namespace {
+
+struct Record {
+  std::atomic<const void *> pointer{nullptr};
+  std::atomic_bool used{false};
+  Record *next = nullptr;
+};
+
+//Records are never freed, so isProtected() can walk the list without locking. There are as many as threads ever used
+//hazard pointers at the same time.
+std::atomic<Record *> records{nullptr};
+
+Record *acquireRecord() {
+  for (Record *record = records.load(); record; record = record->next) {
+    bool used = false;
+    if (!record->used.load(std::memory_order_relaxed) && record->used.compare_exchange_strong(used, true)) return record;
+  }
+  Record *record = new Record();
+  record->used = true;
+  Record *head = records.load();
+  do {
+    record->next = head;
+  } while (!records.compare_exchange_weak(head, record));
+  return record;
+}
+
+class ThreadRecord {
+ public:
+  ThreadRecord() : record(acquireRecord()) {}
+
+  ~ThreadRecord() {
+    record->pointer.store(nullptr);
+    record->used.store(false, std::memory_order_release);
+  }
+
+  Record *record;
+};
+
+}
+
+std::atomic<const void *> &HazardPointers::slot() {
+  static thread_local ThreadRecord threadRecord;
+  return threadRecord.record->pointer;
+}
+
+bool HazardPointers::isProtected(const void *pointer) {
+  for (Record *record = records.load(); record; record = record->next) {
+    if (record->pointer.load() == pointer) return true;
+  }
+  return false;
+}
+
+}
@@ -0,0 +1,61 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * libhomegear-base is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * libhomegear-base is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libhomegear-base.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#ifndef IPCHAZARDPOINTERS_H_
+#define IPCHAZARDPOINTERS_H_
+
+#include <atomic>
+
+namespace Ipc {
+
+/**
+ * One hazard pointer per thread, shared by all users in the process. A reader stores the pointer it is about to use in
+ * slot() and sets it back to nullptr when done. A writer doesn't free a replaced object while isProtected() returns
+ * true for it. Each thread only has one slot, so it can only protect one object at a time. Slots are reused by later
+ * threads.
+ */
+class HazardPointers {
+ public:
+  HazardPointers() = delete;
+
+  /**
+   * Returns the hazard pointer of the calling thread. Stores need to be sequentially consistent, followed by loading
+   * the published pointer again, so the writer either sees the hazard pointer or the reader sees the new object.
+   */
+  static std::atomic<const void *> &slot();
+
+  /**
+   * Returns true when any thread's hazard pointer is "pointer".
+   */
+  static bool isProtected(const void *pointer);
+};
+
+}
+#endif
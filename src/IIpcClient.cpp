@@ -37,6 +37,21 @@
 
 namespace Ipc {
 
+namespace {
+
+//Set while the thread processes a request from Homegear (on a queue or pool thread of any client), see mainThread().
+thread_local bool processingRequest = false;
+
+class ProcessingRequestGuard {
+ public:
+  ProcessingRequestGuard() : _previous(processingRequest) { processingRequest = true; }
+  ~ProcessingRequestGuard() { processingRequest = _previous; }
+ private:
+  bool _previous;
+};
+
+}
+
 IIpcClient::IIpcClient(std::string socketPath) : IQueue(2, 100000) {
   _socketPath = std::move(socketPath);
 
@@ -44,16 +59,67 @@ IIpcClient::IIpcClient(std::string socketPath) : IQueue(2, 100000) {
   _rpcDecoder = std::unique_ptr<RpcDecoder>(new RpcDecoder());
   _rpcEncoder = std::unique_ptr<RpcEncoder>(new RpcEncoder(true));
 
-  _localRpcMethods.emplace("ping", std::bind(&IIpcClient::ping, this, std::placeholders::_1));
-  _localRpcMethods.emplace("broadcastEvent", std::bind(&IIpcClient::broadcastEvent, this, std::placeholders::_1));
-  _localRpcMethods.emplace("broadcastServiceMessage", std::bind(&IIpcClient::broadcastServiceMessage, this, std::placeholders::_1));
-  _localRpcMethods.emplace("broadcastNewDevices", std::bind(&IIpcClient::broadcastNewDevices, this, std::placeholders::_1));
-  _localRpcMethods.emplace("broadcastDeleteDevices", std::bind(&IIpcClient::broadcastDeleteDevices, this, std::placeholders::_1));
-  _localRpcMethods.emplace("broadcastUpdateDevice", std::bind(&IIpcClient::broadcastUpdateDevice, this, std::placeholders::_1));
-  _localRpcMethods.emplace("broadcastVariableProfileStateChanged", std::bind(&IIpcClient::broadcastVariableProfileStateChanged, this, std::placeholders::_1));
-  _localRpcMethods.emplace("broadcastUiNotificationCreated", std::bind(&IIpcClient::broadcastUiNotificationCreated, this, std::placeholders::_1));
-  _localRpcMethods.emplace("broadcastUiNotificationRemoved", std::bind(&IIpcClient::broadcastUiNotificationRemoved, this, std::placeholders::_1));
-  _localRpcMethods.emplace("broadcastUiNotificationAction", std::bind(&IIpcClient::broadcastUiNotificationAction, this, std::placeholders::_1));
+  registerRpcMethod("ping", &IIpcClient::ping);
+  registerRpcMethod("broadcastEvent", &IIpcClient::broadcastEvent);
+  registerRpcMethod("broadcastServiceMessage", &IIpcClient::broadcastServiceMessage);
+  registerRpcMethod("broadcastNewDevices", &IIpcClient::broadcastNewDevices);
+  registerRpcMethod("broadcastDeleteDevices", &IIpcClient::broadcastDeleteDevices);
+  registerRpcMethod("broadcastUpdateDevice", &IIpcClient::broadcastUpdateDevice);
+  registerRpcMethod("broadcastVariableProfileStateChanged", &IIpcClient::broadcastVariableProfileStateChanged);
+  registerRpcMethod("broadcastUiNotificationCreated", &IIpcClient::broadcastUiNotificationCreated);
+  registerRpcMethod("broadcastUiNotificationRemoved", &IIpcClient::broadcastUiNotificationRemoved);
+  registerRpcMethod("broadcastUiNotificationAction", &IIpcClient::broadcastUiNotificationAction);
+
+  //Device changes and UI notifications must not wait behind a flood of events.
+  setRpcMethodPriority("broadcastEvent", RpcPriority::low);
+  setRpcMethodPriority("broadcastNewDevices", RpcPriority::high);
+  setRpcMethodPriority("broadcastDeleteDevices", RpcPriority::high);
+  setRpcMethodPriority("broadcastUiNotificationCreated", RpcPriority::high);
+  setRpcMethodPriority("broadcastUiNotificationRemoved", RpcPriority::high);
+  setRpcMethodPriority("broadcastUiNotificationAction", RpcPriority::high);
+
+  ThreadOptions threadOptions;
+  threadOptions.name = "ipc-reader";
+  setThreadOptions(ThreadGroup::reader, threadOptions);
+  threadOptions.name = "ipc-request";
+  setThreadOptions(ThreadGroup::requests, threadOptions);
+  threadOptions.name = "ipc-response";
+  setThreadOptions(ThreadGroup::responses, threadOptions);
+
+  PriorityOptions priorityOptions;
+  priorityOptions.laneCount = 3;
+  priorityOptions.starvationLimit = 100;
+  setPriorityOptions(0, priorityOptions);
+
+  //Packet ID and the result of ping()
+  auto pingResponse = std::make_shared<Array>();
+  pingResponse->reserve(2);
+  pingResponse->emplace_back(Variable::createPlaceholder());
+  pingResponse->emplace_back(std::make_shared<Variable>());
+  _pingResponse = _rpcEncoder->prepareResponse(std::make_shared<Variable>(pingResponse));
+}
+
+void IIpcClient::registerRpcMethod(const std::string &methodName, std::function<PVariable(PArray &parameters)> method, bool runInline) {
+  LocalRpcMethod localMethod;
+  localMethod.function = std::move(method);
+  localMethod.runInline = runInline;
+  addLocalRpcMethod(methodName, localMethod);
+}
+
+void IIpcClient::addLocalRpcMethod(const std::string &methodName, LocalRpcMethod &localMethod) {
+  std::lock_guard<std::mutex> localRpcMethodsGuard(_localRpcMethodsMutex);
+  LocalRpcMethod existingMethod;
+  if (_localRpcMethods.find(methodName, existingMethod)) localMethod.priority = existingMethod.priority;
+  _localRpcMethods.insert(methodName, localMethod);
+}
+
+bool IIpcClient::setRpcMethodPriority(const std::string &methodName, RpcPriority priority) {
+  std::lock_guard<std::mutex> localRpcMethodsGuard(_localRpcMethodsMutex);
+  LocalRpcMethod localMethod;
+  if (!_localRpcMethods.find(methodName, localMethod)) return false;
+  localMethod.priority = priority;
+  _localRpcMethods.insert(methodName, localMethod);
+  return true;
 }
 
 IIpcClient::~IIpcClient() {
@@ -152,6 +218,10 @@ void IIpcClient::connect() {
       } else break;
     }
     _closed = false;
+    //Unless enabled by setEncodeDouble(), raw doubles are only used after the server sent one itself. The server might
+    //have changed, so start over.
+    _rpcDecoder->resetDoubleReceived();
+    _rpcEncoder->setEncodeDouble(_encodeDouble);
 
     if (_maintenanceThread.joinable()) _maintenanceThread.join();
     _maintenanceThread = std::thread(&IIpcClient::init, this);
@@ -166,6 +236,23 @@ void IIpcClient::connect() {
   }
 }
 
+void IIpcClient::setEncodeDouble(bool value) {
+  _encodeDouble = value;
+  _rpcEncoder->setEncodeDouble(value || _rpcDecoder->doubleReceived());
+}
+
+void IIpcClient::setByteBudget(std::shared_ptr<ByteBudget> budget) {
+  _byteBudget = budget;
+  //Only accounted, so received packets are never dropped. The socket is throttled instead (see mainThread()).
+  setByteBudget(0, budget, false);
+  setByteBudget(1, std::move(budget), false);
+}
+
+void IIpcClient::setThreadOptions(ThreadGroup group, const ThreadOptions &options) {
+  if (group == ThreadGroup::reader) _readerThreadOptions = options;
+  else setThreadOptions(group == ThreadGroup::requests ? 0 : 1, options);
+}
+
 void IIpcClient::start() {
   start(10);
 }
@@ -182,6 +269,35 @@ void IIpcClient::start(size_t processingThreadCount) {
     Ipc::Output::printDebug("Debug: Socket path is " + _socketPath);
 
     if (_mainThread.joinable()) _mainThread.join();
+    _activeByteBudget = _byteBudget;
+    _activeReaderThreadOptions = _readerThreadOptions;
+    _mainThread = std::thread(&IIpcClient::mainThread, this);
+  }
+  catch (const std::exception &ex) {
+    Ipc::Output::printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+  catch (...) {
+    Ipc::Output::printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+  }
+}
+
+void IIpcClient::start(std::shared_ptr<ThreadPool> threadPool, uint32_t maxConcurrency) {
+  try {
+    if (!threadPool) {
+      start();
+      return;
+    }
+
+    _stopped = false;
+
+    startQueue(0, false, std::move(threadPool), maxConcurrency);
+    startQueue(1, false, 1);
+
+    Ipc::Output::printDebug("Debug: Socket path is " + _socketPath);
+
+    if (_mainThread.joinable()) _mainThread.join();
+    _activeByteBudget = _byteBudget;
+    _activeReaderThreadOptions = _readerThreadOptions;
     _mainThread = std::thread(&IIpcClient::mainThread, this);
   }
   catch (const std::exception &ex) {
@@ -194,6 +310,10 @@ void IIpcClient::start(size_t processingThreadCount) {
 
 void IIpcClient::mainThread() {
   try {
+    _activeReaderThreadOptions.apply();
+    //The object is fully constructed here, so overrides are visible.
+    _inlinePing = !pingOverridden();
+
     connect();
 
     std::vector<char> buffer(1024);
@@ -209,6 +329,13 @@ void IIpcClient::mainThread() {
         }
       }
 
+      if (_activeByteBudget && _activeByteBudget->exhausted() && !_activeByteBudget->waitForSpace(10)) {
+        //When nothing was processed for a while and processing threads wait for a response to invoke(), the budget
+        //might only be freed by that response, so the socket is read anyway then. invoke() called by other threads
+        //doesn't block processing, so reading stays throttled for them.
+        if (_blockedProcessingThreads == 0) continue;
+      }
+
       timeval timeout{};
       timeout.tv_sec = 0;
       timeout.tv_usec = 100000;
@@ -246,8 +373,11 @@ void IIpcClient::mainThread() {
         while (processedBytes < bytesRead) {
           processedBytes += _binaryRpc->process(&buffer[processedBytes], bytesRead - processedBytes);
           if (_binaryRpc->isFinished()) {
-            std::shared_ptr<IQueueEntry> queueEntry = std::make_shared<QueueEntry>(_binaryRpc->getData());
-            if (!enqueue(_binaryRpc->getType() == BinaryRpc::Type::request ? 0 : 1, queueEntry)) printQueueFullError("Error: Could not queue RPC request. Queue is full.");
+            if (_binaryRpc->getType() == BinaryRpc::Type::request) queueRequest(_binaryRpc->getData());
+            else {
+              std::shared_ptr<IQueueEntry> queueEntry = std::make_shared<QueueEntry>(_binaryRpc->getData());
+              if (!enqueue(1, queueEntry)) printQueueFullError("Error: Could not queue RPC request. Queue is full.");
+            }
             _binaryRpc->reset();
           }
         }
@@ -270,38 +400,29 @@ void IIpcClient::mainThread() {
 void IIpcClient::processQueueEntry(int32_t index, std::shared_ptr<IQueueEntry> &entry) {
   try {
     if (_disposing) return;
-    std::shared_ptr<QueueEntry> queueEntry;
-    queueEntry = std::dynamic_pointer_cast<QueueEntry>(entry);
+    //Both queues only contain QueueEntry objects (see mainThread()), so no dynamic_cast is needed here or in the hooks.
+    QueueEntry *queueEntry = static_cast<QueueEntry *>(entry.get());
     if (!queueEntry) return;
 
     if (index == 0) {
-      std::string methodName;
-      PArray parameters = _rpcDecoder->decodeRequest(queueEntry->packet, methodName);
-
-      if (parameters->size() < 2) {
-        Ipc::Output::printError("Error: Wrong parameter count while calling method " + methodName);
-        return;
-      }
-      auto localMethodIterator = _localRpcMethods.find(methodName);
-      if (localMethodIterator == _localRpcMethods.end()) {
-        Ipc::Output::printError("Warning: RPC method not found: " + methodName);
-        PVariable error = Variable::createError(-32601, ": Requested method not found.");
-        sendResponse(parameters->at(0), error);
-        return;
-      }
-
-      Ipc::Output::printInfo("Info: Server is calling RPC method: " + methodName);
-
-      PVariable result = localMethodIterator->second(parameters->at(1)->arrayValue);
-      sendResponse(parameters->at(0), result);
+      ProcessingRequestGuard processingRequestGuard;
+      const LocalRpcMethod *localMethod = queueEntry->methodFound ? &queueEntry->method : nullptr;
+      if (queueEntry->event) processCoalescedEvent(*queueEntry->event, localMethod);
+      else processRequest(queueEntry->packet, localMethod);
     } else {
-      PVariable response = _rpcDecoder->decodeResponse(queueEntry->packet);
-      if (response->arrayValue->size() < 3) {
+      //Only the thread and packet ID are decoded here. The result is decoded by the waiting thread (see IpcResponse).
+      ByteSpan packet(queueEntry->packet);
+      uint32_t position = 8;
+      uint32_t count = 0;
+      if (!_rpcDecoder->decodeArrayStart(packet, position, count) || count < 3) {
         Ipc::Output::printError("Error: Response has wrong array size.");
         return;
       }
-      pthread_t threadId = response->arrayValue->at(0)->integerValue64;
-      int32_t packetId = response->arrayValue->at(1)->integerValue;
+      int64_t threadIdValue = 0;
+      int32_t packetId = 0;
+      _rpcDecoder->decodeTyped(packet, position, threadIdValue);
+      _rpcDecoder->decodeTyped(packet, position, packetId);
+      pthread_t threadId = threadIdValue;
 
       std::lock_guard<std::mutex> requestInfoGuard(_requestInfoMutex);
       auto requestIterator = _requestInfo.find(threadId);
@@ -314,7 +435,8 @@ void IIpcClient::processQueueEntry(int32_t index, std::shared_ptr<IQueueEntry> &
           if (responseIterator != _rpcResponses[threadId].end()) {
             PIpcResponse element = responseIterator->second;
             if (element) {
-              element->response = response;
+              element->packet = std::move(queueEntry->packet);
+              element->resultPosition = count == 3 ? position : 0;
               element->packetId = packetId;
               element->finished = true;
             }
@@ -334,6 +456,272 @@ void IIpcClient::processQueueEntry(int32_t index, std::shared_ptr<IQueueEntry> &
   }
 }
 
+bool IIpcClient::getQueueEntryKey(int32_t index, std::shared_ptr<IQueueEntry> &entry, uint64_t &key) {
+  if (index != 0) return false;
+  QueueEntry *queueEntry = static_cast<QueueEntry *>(entry.get());
+  if (!queueEntry || !queueEntry->hasKey) return false;
+  key = queueEntry->key;
+  return true;
+}
+
+uint32_t IIpcClient::getQueueEntryPriority(int32_t index, std::shared_ptr<IQueueEntry> &entry) {
+  if (index != 0) return 0;
+  QueueEntry *queueEntry = static_cast<QueueEntry *>(entry.get());
+  return (uint32_t)(queueEntry ? queueEntry->method.priority : RpcPriority::normal);
+}
+
+bool IIpcClient::getQueueEntryCoalescingKey(int32_t index, std::shared_ptr<IQueueEntry> &entry, uint64_t &key) {
+  if (index != 0) return false;
+  QueueEntry *queueEntry = static_cast<QueueEntry *>(entry.get());
+  if (!queueEntry || !queueEntry->isEvent) return false;
+  key = (queueEntry->key * 0x9E3779B97F4A7C15ull) ^ (uint32_t)queueEntry->channel;
+  return true;
+}
+
+bool IIpcClient::decodeCoalescedEvent(QueueEntry &entry) {
+  try {
+    if (entry.event) return true;
+    ByteSpan methodName;
+    PArray parameters = _rpcDecoder->decodeRequest(ByteSpan(entry.packet), methodName);
+    if (_rpcDecoder->doubleReceived() && !_rpcEncoder->getEncodeDouble()) _rpcEncoder->setEncodeDouble(true);
+    if (parameters->size() < 2 || parameters->at(1)->type != VariableType::tArray) return false;
+    PArray &eventParameters = parameters->at(1)->arrayValue;
+    if (eventParameters->size() != 5 || eventParameters->at(3)->type != VariableType::tArray || eventParameters->at(4)->type != VariableType::tArray) return false;
+    if (eventParameters->at(3)->arrayValue->size() != eventParameters->at(4)->arrayValue->size()) return false;
+
+    std::unique_ptr<CoalescedEvent> event(new CoalescedEvent());
+    event->eventSource = eventParameters->at(0)->stringValue;
+    event->peerId = eventParameters->at(1)->integerValue64;
+    event->channel = eventParameters->at(2)->integerValue;
+    event->parameters = eventParameters;
+    event->packetIds.push_back(parameters->at(0));
+    entry.event = std::move(event);
+    return true;
+  }
+  catch (const std::exception &ex) {
+    Ipc::Output::printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+  catch (...) {
+    Ipc::Output::printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+  }
+  return false;
+}
+
+bool IIpcClient::mergeQueueEntries(int32_t index, std::shared_ptr<IQueueEntry> &queuedEntry, std::shared_ptr<IQueueEntry> &entry) {
+  QueueEntry *queuedQueueEntry = static_cast<QueueEntry *>(queuedEntry.get());
+  QueueEntry *queueEntry = static_cast<QueueEntry *>(entry.get());
+  if (!queuedQueueEntry || !queueEntry || !queuedQueueEntry->isEvent || !queueEntry->isEvent) return false;
+  if (queuedQueueEntry->key != queueEntry->key || queuedQueueEntry->channel != queueEntry->channel) return false;
+  if (!decodeCoalescedEvent(*queuedQueueEntry) || !decodeCoalescedEvent(*queueEntry)) return false;
+  CoalescedEvent &queuedEvent = *queuedQueueEntry->event;
+  CoalescedEvent &event = *queueEntry->event;
+  if (queuedEvent.eventSource != event.eventSource) return false;
+
+  PArray &queuedVariables = queuedEvent.parameters->at(3)->arrayValue;
+  PArray &queuedValues = queuedEvent.parameters->at(4)->arrayValue;
+  PArray &variables = event.parameters->at(3)->arrayValue;
+  PArray &values = event.parameters->at(4)->arrayValue;
+  for (size_t i = 0; i < variables->size(); i++) {
+    const std::string &variable = variables->at(i)->stringValue;
+    bool found = false;
+    for (size_t j = 0; j < queuedVariables->size(); j++) {
+      if (queuedVariables->at(j)->stringValue == variable) {
+        queuedValues->at(j) = values->at(i);
+        found = true;
+        break;
+      }
+    }
+    if (!found) {
+      queuedVariables->push_back(variables->at(i));
+      queuedValues->push_back(values->at(i));
+    }
+  }
+  queuedEvent.packetIds.insert(queuedEvent.packetIds.end(), event.packetIds.begin(), event.packetIds.end());
+  return true;
+}
+
+size_t IIpcClient::getQueueEntrySize(int32_t index, std::shared_ptr<IQueueEntry> &entry) {
+  QueueEntry *queueEntry = static_cast<QueueEntry *>(entry.get());
+  return queueEntry ? queueEntry->packet.size() : 0;
+}
+
+void IIpcClient::processCoalescedEvent(CoalescedEvent &event, const LocalRpcMethod *localMethod) {
+  if (!localMethod) {
+    Ipc::Output::printError("Warning: RPC method not found: broadcastEvent");
+    PVariable error = Variable::createError(-32601, ": Requested method not found.");
+    for (auto &packetId : event.packetIds) {
+      sendResponse(packetId, error);
+    }
+    return;
+  }
+
+  if (Ipc::Output::getLogLevel() >= 4) Ipc::Output::printInfo("Info: Server is calling RPC method: broadcastEvent (" + std::to_string(event.packetIds.size()) + " coalesced)");
+
+  PVariable result;
+  try {
+    result = localMethod->member ? (this->*localMethod->member)(event.parameters) : localMethod->function(event.parameters);
+  }
+  catch (const std::exception &ex) {
+    Ipc::Output::printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    result = Variable::createError(-32500, "Unknown application error.");
+  }
+  catch (...) {
+    Ipc::Output::printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    result = Variable::createError(-32500, "Unknown application error.");
+  }
+  for (auto &packetId : event.packetIds) {
+    sendResponse(packetId, result);
+  }
+}
+
+void IIpcClient::queueRequest(std::vector<char> &packet) {
+  LocalRpcMethod localMethod;
+  bool methodFound = false;
+  ByteSpan methodName;
+  try {
+    methodName = _rpcDecoder->decodeMethodName(packet);
+    methodFound = _localRpcMethods.find(methodName.data(), methodName.size(), localMethod);
+    if (methodFound && localMethod.member == static_cast<RpcMethod>(&IIpcClient::ping) && _inlinePing && processPing(packet, methodName)) return;
+    if (methodFound && localMethod.runInline && processInlineRequest(packet, localMethod)) return;
+  }
+  catch (const std::exception &ex) {
+    Ipc::Output::printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+  catch (...) {
+    Ipc::Output::printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+  }
+
+  std::shared_ptr<QueueEntry> queueEntry = std::make_shared<QueueEntry>(packet);
+  queueEntry->methodFound = methodFound;
+  queueEntry->method = std::move(localMethod);
+  try {
+    if (methodName.size() == 14 && memcmp(methodName.data(), "broadcastEvent", 14) == 0) {
+      //Packet ID, [eventSource, peerId, channel, variables, values]
+      std::tuple<int64_t, std::tuple<std::string, int64_t, int32_t>> parameters;
+      _rpcDecoder->decodeTypedParameters(packet, methodName, parameters);
+      queueEntry->hasKey = true;
+      queueEntry->key = (uint64_t)std::get<1>(std::get<1>(parameters));
+      queueEntry->isEvent = true;
+      queueEntry->channel = std::get<2>(std::get<1>(parameters));
+    } else if (methodName.size() == 21 && memcmp(methodName.data(), "broadcastUpdateDevice", 21) == 0) {
+      //Packet ID, [peerId, channel, hint]
+      std::tuple<int64_t, std::tuple<int64_t>> parameters;
+      _rpcDecoder->decodeTypedParameters(packet, methodName, parameters);
+      queueEntry->hasKey = true;
+      queueEntry->key = (uint64_t)std::get<0>(std::get<1>(parameters));
+    }
+  }
+  catch (const std::exception &ex) {
+    Ipc::Output::printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+  catch (...) {
+    Ipc::Output::printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+  }
+
+  std::shared_ptr<IQueueEntry> entry = std::move(queueEntry);
+  if (!enqueue(0, entry)) printQueueFullError("Error: Could not queue RPC request. Queue is full.");
+}
+
+void IIpcClient::processRequest(std::vector<char> &packet) {
+  ByteSpan methodName = _rpcDecoder->decodeMethodName(packet);
+  //The handler is copied, so the method table isn't referenced while the method runs.
+  LocalRpcMethod localMethod;
+  bool methodFound = _localRpcMethods.find(methodName.data(), methodName.size(), localMethod);
+  processRequest(packet, methodFound ? &localMethod : nullptr);
+}
+
+void IIpcClient::processRequest(std::vector<char> &packet, const LocalRpcMethod *localMethod) {
+  //The method name is only copied to a string for logging.
+  ByteSpan methodName;
+  PArray parameters = _rpcDecoder->decodeRequest(packet, methodName);
+  if (_rpcDecoder->doubleReceived() && !_rpcEncoder->getEncodeDouble()) _rpcEncoder->setEncodeDouble(true); //Server supports raw doubles
+
+  if (parameters->size() < 2) {
+    Ipc::Output::printError("Error: Wrong parameter count while calling method " + std::string(methodName.data(), methodName.size()));
+    return;
+  }
+  if (!localMethod) {
+    Ipc::Output::printError("Warning: RPC method not found: " + std::string(methodName.data(), methodName.size()));
+    PVariable error = Variable::createError(-32601, ": Requested method not found.");
+    sendResponse(parameters->at(0), error);
+    return;
+  }
+
+  if (Ipc::Output::getLogLevel() >= 4) Ipc::Output::printInfo("Info: Server is calling RPC method: " + std::string(methodName.data(), methodName.size()));
+
+  PArray &methodParameters = parameters->at(1)->arrayValue;
+  PVariable result;
+  try {
+    result = localMethod->member ? (this->*localMethod->member)(methodParameters) : localMethod->function(methodParameters);
+  }
+  catch (const std::exception &ex) {
+    Ipc::Output::printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    result = Variable::createError(-32500, "Unknown application error.");
+  }
+  catch (...) {
+    Ipc::Output::printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    result = Variable::createError(-32500, "Unknown application error.");
+  }
+  sendResponse(parameters->at(0), result);
+}
+
+bool IIpcClient::processInlineRequest(std::vector<char> &packet, const LocalRpcMethod &localMethod) {
+  try {
+    processRequest(packet, &localMethod);
+    return true;
+  }
+  catch (const std::exception &ex) {
+    Ipc::Output::printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+  catch (...) {
+    Ipc::Output::printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+  }
+  //Let the queued path handle the packet, so the request isn't lost.
+  return false;
+}
+
+bool IIpcClient::processPing(std::vector<char> &packet, const ByteSpan &methodName) {
+  try {
+    //Packet ID, []
+    std::tuple<PVariable> parameters;
+    _rpcDecoder->decodeTypedParameters(packet, methodName, parameters);
+    if (!std::get<0>(parameters)) return false;
+    if (Ipc::Output::getLogLevel() >= 4) Ipc::Output::printInfo("Info: Server is calling RPC method: ping");
+
+    //Only used by the reader thread.
+    static thread_local PArray slotValues = std::make_shared<Array>(1);
+    slotValues->at(0) = std::move(std::get<0>(parameters));
+    std::vector<char> &data = getFrameBuffer();
+    _rpcEncoder->encodePrepared(*_pingResponse, slotValues, data);
+    send(data);
+    return true;
+  }
+  catch (const std::exception &ex) {
+    Ipc::Output::printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+  catch (...) {
+    Ipc::Output::printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+  }
+  return false;
+}
+
+bool IIpcClient::pingOverridden() {
+#if defined(__GNUC__) && !defined(__clang__)
+  //GCC can resolve a virtual member function pointer for an object, which gives the final overrider.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpmf-conversions"
+  typedef PVariable (*PingFunction)(IIpcClient *, PArray &);
+  return (PingFunction)(this->*(&IIpcClient::ping)) != (PingFunction)(&IIpcClient::ping);
+#pragma GCC diagnostic pop
+#else
+  return true;
+#endif
+}
+
+PVariable IIpcClient::ping(PArray &parameters) {
+  return std::make_shared<Variable>();
+}
+
 PVariable IIpcClient::send(std::vector<char> &data) {
   try {
     int32_t totallySentBytes = 0;
@@ -358,97 +746,178 @@ PVariable IIpcClient::send(std::vector<char> &data) {
   return std::make_shared<Variable>();
 }
 
+PPreparedPacket IIpcClient::prepare(const std::string &methodName, const PArray &parameterTemplate) {
+  //Thread ID, packet ID and the parameters like in invoke()
+  auto array = std::make_shared<Array>();
+  array->reserve(3);
+  array->emplace_back(Variable::createPlaceholder());
+  array->emplace_back(Variable::createPlaceholder());
+  array->emplace_back(std::make_shared<Variable>(parameterTemplate ? parameterTemplate : std::make_shared<Array>()));
+  return _rpcEncoder->prepareRequest(methodName, array);
+}
+
 PVariable IIpcClient::invoke(const std::string &methodName, const PArray &parameters, int32_t timeout) {
-  try {
-    if (_closed || _stopped || _disposing) {
-      Ipc::Output::printWarning("Warning: Can't invoke method " + methodName + " as there is no open IPC connection.");
-      return Variable::createError(-32500, "Unknown application error.");
-    }
+  return invokePacket(methodName, nullptr, parameters, timeout);
+}
+
+PVariable IIpcClient::invoke(const PPreparedPacket &call, const PArray &values, int32_t timeout) {
+  if (!call || !call->isRequest()) {
+    Ipc::Output::printError("Error: invoke was called with an invalid prepared call.");
+    return Variable::createError(-32500, "Unknown application error.");
+  }
+  size_t valueCount = values ? values->size() : 0;
+  if (valueCount + 2 != call->getSlotCount()) {
+    Ipc::Output::printError("Error: Wrong number of values for prepared call to " + call->getMethodName() + ". Expected " + std::to_string(call->getSlotCount() - 2) + ", got " + std::to_string(valueCount) + ".");
+    return Variable::createError(-32602, "Invalid parameters.");
+  }
+  return invokePacket(call->getMethodName(), call, values, timeout);
+}
 
+PVariable IIpcClient::invokePacket(const std::string &methodName, const PPreparedPacket &preparedCall, const PArray &parameters, int32_t timeout) {
+  try {
     auto threadId = pthread_self();
-    PRequestInfo requestInfo;
-    std::unique_lock<std::mutex> requestInfoGuard(_requestInfoMutex);
-    auto requestInfoIterator = _requestInfo.emplace(std::piecewise_construct, std::make_tuple(threadId), std::make_tuple(std::make_shared<RequestInfo>()));
-    if (requestInfoIterator.second) requestInfo = requestInfoIterator.first->second;
-    if (!requestInfo) {
-      Ipc::Output::printError("Critical: Could not insert request struct into map.");
-      return Ipc::Variable::createError(-32500, "Unknown application error.");
+    int32_t packetId = nextPacketId();
+    std::vector<char> &data = getFrameBuffer();
+    if (preparedCall) {
+      //Slot values: Thread ID, packet ID and the values of the placeholders in the parameters. The array and the ID
+      //variables are reused by the thread.
+      static thread_local PArray slotValues;
+      if (!slotValues) {
+        slotValues = std::make_shared<Array>();
+        slotValues->emplace_back(std::make_shared<Variable>((int64_t)0));
+        slotValues->emplace_back(std::make_shared<Variable>((int32_t)0));
+      }
+      slotValues->resize(2);
+      slotValues->at(0)->integerValue64 = (int64_t)threadId;
+      slotValues->at(1)->integerValue = packetId;
+      if (parameters) slotValues->insert(slotValues->end(), parameters->begin(), parameters->end());
+      _rpcEncoder->encodePrepared(*preparedCall, slotValues, data);
+      slotValues->resize(2);
+    } else {
+      //Thread ID, packet ID and the parameters. Encoded directly instead of wrapping them in Variables.
+      VectorSink<std::vector<char>> sink(data);
+      _rpcEncoder->encodeTypedRequest(methodName, std::tuple<int64_t, int32_t, const PArray &>((int64_t)threadId, packetId, parameters), sink);
     }
-    requestInfoGuard.unlock();
 
-    int32_t packetId;
-    {
-      std::lock_guard<std::mutex> packetIdGuard(_packetIdMutex);
-      packetId = _currentPacketId++;
-    }
-    auto array = std::make_shared<Array>();
-    array->reserve(3);
-    array->emplace_back(std::move(std::make_shared<Variable>((int64_t)threadId)));
-    array->emplace_back(std::move(std::make_shared<Variable>(packetId)));
-    array->emplace_back(std::move(std::make_shared<Variable>(parameters)));
-    std::vector<char> data;
-    _rpcEncoder->encodeRequest(methodName, array, data);
-
-    PIpcResponse response;
-    {
-      std::lock_guard<std::mutex> responseGuard(_rpcResponsesMutex);
-      auto result = _rpcResponses[threadId].emplace(packetId, std::make_shared<IpcResponse>());
-      if (result.second) response = result.first->second;
-    }
-    if (!response) {
-      Ipc::Output::printError("Critical: Could not insert response struct into map.");
-      return Variable::createError(-32500, "Unknown application error.");
-    }
+    return invokeEncoded(methodName, packetId, data, timeout);
+  }
+  catch (const std::exception &ex) {
+    Ipc::Output::printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+  catch (...) {
+    Ipc::Output::printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+  }
+  return Variable::createError(-32500, "Unknown application error.");
+}
 
-    PVariable result = send(data);
-    if (result->errorStruct) {
-      std::lock_guard<std::mutex> responseGuard(_rpcResponsesMutex);
-      _rpcResponses[threadId].erase(packetId);
-      if (_rpcResponses[threadId].empty()) _rpcResponses.erase(threadId);
-      return result;
-    }
+PVariable IIpcClient::invokeEncoded(const std::string &methodName, int32_t packetId, std::vector<char> &data, int32_t timeout) {
+  PVariable error;
+  PIpcResponse response = sendRequest(methodName, packetId, data, timeout, error);
+  if (!response) return error;
+
+  PVariable result;
+  uint32_t position = response->resultPosition;
+  _rpcDecoder->decodeTyped(ByteSpan(response->packet), position, result);
+  if (_rpcDecoder->doubleReceived() && !_rpcEncoder->getEncodeDouble()) _rpcEncoder->setEncodeDouble(true); //Server supports raw doubles
+  return result;
+}
+
+std::vector<char> &IIpcClient::getFrameBuffer() {
+  //Don't keep the memory of unusually large packets in every thread.
+  static const size_t maxRetainedCapacity = 1024 * 1024;
+  static thread_local std::vector<char> buffer;
+  if (buffer.capacity() > maxRetainedCapacity) std::vector<char>().swap(buffer);
+  buffer.clear();
+  return buffer;
+}
+
+int32_t IIpcClient::nextPacketId() {
+  std::lock_guard<std::mutex> packetIdGuard(_packetIdMutex);
+  return _currentPacketId++;
+}
+
+PIpcResponse IIpcClient::sendRequest(const std::string &methodName, int32_t packetId, std::vector<char> &data, int32_t timeout, PVariable &error) {
+  if (_closed || _stopped || _disposing) {
+    Ipc::Output::printWarning("Warning: Can't invoke method " + methodName + " as there is no open IPC connection.");
+    error = Variable::createError(-32500, "Unknown application error.");
+    return PIpcResponse();
+  }
 
+  auto threadId = pthread_self();
+  PRequestInfo requestInfo;
+  std::unique_lock<std::mutex> requestInfoGuard(_requestInfoMutex);
+  auto requestInfoIterator = _requestInfo.emplace(std::piecewise_construct, std::make_tuple(threadId), std::make_tuple(std::make_shared<RequestInfo>()));
+  if (requestInfoIterator.second) requestInfo = requestInfoIterator.first->second;
+  if (!requestInfo) {
+    Ipc::Output::printError("Critical: Could not insert request struct into map.");
+    error = Variable::createError(-32500, "Unknown application error.");
+    return PIpcResponse();
+  }
+  requestInfoGuard.unlock();
+
+  PIpcResponse response;
+  {
+    std::lock_guard<std::mutex> responseGuard(_rpcResponsesMutex);
+    auto result = _rpcResponses[threadId].emplace(packetId, std::make_shared<IpcResponse>());
+    if (result.second) response = result.first->second;
+  }
+  if (!response) {
+    Ipc::Output::printError("Critical: Could not insert response struct into map.");
+    requestInfoGuard.lock();
+    _requestInfo.erase(threadId);
+    error = Variable::createError(-32500, "Unknown application error.");
+    return PIpcResponse();
+  }
+
+  PVariable result = send(data);
+  if (!result->errorStruct) {
+    //Counted while waiting, so mainThread() keeps reading the response when the byte budget is exhausted.
+    bool blocksProcessing = processingRequest;
+    if (blocksProcessing) _blockedProcessingThreads++;
     auto startTime = HelperFunctions::getTime();
+    //Polling is bounded, so slow responses and timeouts are always handled by the wait on the condition variable.
+    auto spinEndTime = std::chrono::steady_clock::now() + std::chrono::milliseconds(1);
+    SpinWait spinWait(_invokeWaitStrategy);
+    while (!response->finished && !_closed && !_stopped && !_disposing && spinWait.next()) {
+      if (std::chrono::steady_clock::now() >= spinEndTime) break;
+    }
+
     std::unique_lock<std::mutex> waitLock(requestInfo->waitMutex);
     while (!requestInfo->conditionVariable.wait_for(waitLock, std::chrono::milliseconds(1000), [&] {
       return response->finished || _closed || _stopped || _disposing || (timeout > 0 && HelperFunctions::getTime() - startTime > timeout);
     }));
+    if (blocksProcessing) _blockedProcessingThreads--;
 
-    if (!response->finished || response->response->arrayValue->size() != 3 || response->packetId != packetId) {
+    if (!response->finished || response->resultPosition == 0 || response->packetId != packetId) {
       Ipc::Output::printError("Error: No response received to RPC request. Method: " + methodName);
       result = Variable::createError(-1, "No response received.");
-    } else result = response->response->arrayValue->at(2);
-
-    {
-      std::lock_guard<std::mutex> responseGuard(_rpcResponsesMutex);
-      _rpcResponses[threadId].erase(packetId);
-      if (_rpcResponses[threadId].empty()) _rpcResponses.erase(threadId);
-    }
-
-    {
-      requestInfoGuard.lock();
-      _requestInfo.erase(threadId);
     }
+  }
 
-    return result;
+  {
+    std::lock_guard<std::mutex> responseGuard(_rpcResponsesMutex);
+    _rpcResponses[threadId].erase(packetId);
+    if (_rpcResponses[threadId].empty()) _rpcResponses.erase(threadId);
   }
-  catch (const std::exception &ex) {
-    Ipc::Output::printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+
+  {
+    requestInfoGuard.lock();
+    _requestInfo.erase(threadId);
   }
-  catch (...) {
-    Ipc::Output::printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+
+  if (result->errorStruct) {
+    error = result;
+    return PIpcResponse();
   }
-  return Variable::createError(-32500, "Unknown application error.");
+  return response;
 }
 
 void IIpcClient::sendResponse(PVariable packetId, PVariable variable) {
   try {
-    auto array = std::make_shared<Variable>(VariableType::tArray);
-    array->arrayValue->reserve(2);
-    array->arrayValue->emplace_back(std::move(packetId));
-    array->arrayValue->emplace_back(std::move(variable));
-    std::vector<char> data;
-    _rpcEncoder->encodeResponse(array, data);
+    //Packet ID and result. Encoded directly instead of wrapping them in an array Variable.
+    std::vector<char> &data = getFrameBuffer();
+    VectorSink<std::vector<char>> sink(data);
+    _rpcEncoder->encodeTypedResponse(std::tuple<const PVariable &, const PVariable &>(packetId, variable), sink);
 
     send(data);
   }
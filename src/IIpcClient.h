@@ -38,6 +38,8 @@
 #include "Output.h"
 #include "RpcEncoder.h"
 #include "RpcDecoder.h"
+#include "RpcTraits.h"
+#include "RpcMethodTable.h"
 #include "BinaryRpc.h"
 
 #include <sys/un.h>
@@ -47,13 +49,62 @@
 #include <thread>
 #include <mutex>
 #include <string>
+#include <cstring>
 #include <unordered_map>
 #include <functional>
 
 namespace Ipc {
 
+/**
+ * Thrown by the typed versions of IIpcClient::invoke() when the call fails or the server returns an error.
+ */
+class RpcErrorException : public IpcException {
+ public:
+  RpcErrorException(int32_t faultCode, const std::string &faultString) : IpcException(faultString), _faultCode(faultCode) {}
+
+  int32_t getFaultCode() const { return _faultCode; }
+ private:
+  int32_t _faultCode = 0;
+};
+
+/**
+ * True when the arguments of IIpcClient::invoke(methodName, arguments...) are meant for
+ * invoke(const std::string&, const PArray&, int32_t): a single argument convertible to PArray (including nullptr), or
+ * such an argument followed by an integral timeout. The variadic invoke() is disabled for these, as it would be an
+ * exact match and silently encode them as parameters.
+ */
+template<typename... Arguments>
+struct IsRpcParameterArray : std::false_type {};
+
+template<typename Parameters>
+struct IsRpcParameterArray<Parameters> : std::is_convertible<const Parameters &, PArray> {};
+
+template<typename Parameters, typename Timeout>
+struct IsRpcParameterArray<Parameters, Timeout>
+    : std::integral_constant<bool, std::is_convertible<const Parameters &, PArray>::value && std::is_integral<Timeout>::value> {};
+
 class IIpcClient : public IQueue {
  public:
+  typedef PVariable (IIpcClient::*RpcMethod)(PArray &parameters);
+
+  /**
+   * The priority lanes of the request queue. Queued requests of a higher priority are always processed first.
+   */
+  enum class RpcPriority : uint32_t {
+    high = 0,
+    normal = 1,
+    low = 2
+  };
+
+  /**
+   * The threads of a client (see setThreadOptions()).
+   */
+  enum class ThreadGroup {
+    reader,    //Reads from the socket and runs inline methods (see registerRpcMethod()).
+    requests,  //Process requests from Homegear. Not used with start(std::shared_ptr<ThreadPool>, uint32_t).
+    responses  //Process responses to invoke().
+  };
+
   explicit IIpcClient(std::string socketPath);
   ~IIpcClient() override;
   virtual void dispose();
@@ -61,8 +112,174 @@ class IIpcClient : public IQueue {
   static std::string version();
   bool connected() { return !_closed; }
   PVariable invoke(const std::string &methodName, const PArray &parameters, int32_t timeout = 0);
+
+  /**
+   * Pre-encodes calls to "methodName" for use with invoke(const PPreparedPacket&, ...). Use this for calls in hot loops
+   * where most parameters are constant. Parameters created with Variable::createPlaceholder() are placeholders for the values
+   * passed to invoke(). Placeholders can also be nested in arrays and structs.
+   *
+   * @param methodName The RPC method to call.
+   * @param parameterTemplate The parameters. Don't modify them afterwards.
+   * @return The prepared call. It can be used by multiple threads at the same time.
+   */
+  PPreparedPacket prepare(const std::string &methodName, const PArray &parameterTemplate);
+
+  /**
+   * Calls a method prepared with prepare().
+   *
+   * @param call The prepared call.
+   * @param values One value for each placeholder in the order the placeholders appear in the template.
+   * @param timeout See invoke(const std::string&, const PArray&, int32_t).
+   */
+  PVariable invoke(const PPreparedPacket &call, const PArray &values, int32_t timeout = 0);
+
+  /**
+   * Calls "methodName" and decodes the result directly into "Result" using RpcTraits (see RpcTraits.h), e.g.
+   * invoke<std::vector<std::string>>("listMethods", parameters). No Variables are created for the result.
+   *
+   * @throws RpcErrorException When the call fails or the server returns an error.
+   */
+  template<typename Result>
+  Result invoke(const std::string &methodName, const PArray &parameters, int32_t timeout = 0) {
+    return invokeTyped<Result>(methodName, parameters, timeout);
+  }
+
+  /**
+   * Like invoke<Result>(const std::string&, const PArray&, int32_t), but the elements of "parameters" are encoded using
+   * RpcTraits as well, e.g. invoke<PVariable>("setValue", std::make_tuple(peerId, channel, std::string("STATE"), true)).
+   *
+   * @throws RpcErrorException When the call fails or the server returns an error.
+   */
+  template<typename Result, typename... Parameters>
+  Result invoke(const std::string &methodName, const std::tuple<Parameters...> &parameters, int32_t timeout = 0) {
+    return invokeTyped<Result>(methodName, parameters, timeout);
+  }
+
+  /**
+   * Calls "methodName" with "arguments" as parameters, e.g. invoke("setValue", peerId, channel, "STATE", true). The
+   * arguments are encoded directly using RpcTraits, so no Variables are created for them. Use
+   * invoke(const std::string&, const PArray&, int32_t) when the parameters are only known at runtime and
+   * invokeWithTimeout() to set a timeout. For a typed result use invoke<Result>(methodName, std::make_tuple(arguments...)).
+   * A single PArray or nullptr argument calls invoke(const std::string&, const PArray&, int32_t) instead (see
+   * IsRpcParameterArray).
+   */
+  template<typename... Arguments>
+  typename std::enable_if<!IsRpcParameterArray<Arguments...>::value, PVariable>::type invoke(const std::string &methodName, const Arguments &... arguments) {
+    return invokeWithTimeout(methodName, 0, arguments...);
+  }
+
+  /**
+   * Like invoke(const std::string&, const Arguments&...), but waits at most "timeout" milliseconds for the response,
+   * e.g. invokeWithTimeout("setValue", 5000, peerId, channel, "STATE", true). 0 waits until the response arrives or
+   * the connection is closed.
+   */
+  template<typename... Arguments>
+  PVariable invokeWithTimeout(const std::string &methodName, int32_t timeout, const Arguments &... arguments) {
+    try {
+      int32_t packetId = nextPacketId();
+      std::vector<char> &data = getFrameBuffer();
+      VectorSink<std::vector<char>> sink(data);
+      //Thread ID, packet ID and the parameters like in invoke()
+      std::tuple<int64_t, int32_t, std::tuple<const Arguments &...>> request((int64_t)pthread_self(), packetId, std::tuple<const Arguments &...>(arguments...));
+      _rpcEncoder->encodeTypedRequest(methodName, request, sink);
+      return invokeEncoded(methodName, packetId, data, timeout);
+    }
+    catch (const std::exception &ex) {
+      Ipc::Output::printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch (...) {
+      Ipc::Output::printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+    return Variable::createError(-32500, "Unknown application error.");
+  }
+
+  /**
+   * Registers a local RPC method the server can call. An existing method with the same name is replaced. This can be
+   * called at any time, also while requests are processed. Registering copies the method table, so register all
+   * methods at startup where possible.
+   *
+   * @param methodName The name of the method.
+   * @param method A member function of this client, e.g. registerRpcMethod("myMethod", &MyClient::myMethod).
+   * @param runInline Runs the method directly on the thread reading from the socket instead of queueing it. Requests
+   * to inline methods are never delayed by a backlog of other requests and don't wake up a processing thread. Only
+   * use this for methods that return immediately. They must never call invoke(), because the response can't be read
+   * while the method is running.
+   */
+  template<typename Client>
+  void registerRpcMethod(const std::string &methodName, PVariable (Client::*method)(PArray &parameters), bool runInline = false) {
+    LocalRpcMethod localMethod;
+    localMethod.member = static_cast<RpcMethod>(method);
+    localMethod.runInline = runInline;
+    addLocalRpcMethod(methodName, localMethod);
+  }
+
+  /**
+   * Registers a local RPC method implemented by "method". See registerRpcMethod(const std::string&, PVariable (Client::*)(PArray&), bool).
+   */
+  void registerRpcMethod(const std::string &methodName, std::function<PVariable(PArray &parameters)> method, bool runInline = false);
+
+  /**
+   * Sets the priority of requests to the local RPC method "methodName". The default is RpcPriority::normal.
+   * broadcastEvent has RpcPriority::low and broadcastNewDevices, broadcastDeleteDevices and the UI notifications have
+   * RpcPriority::high. The priority is kept when the method is registered again. Requests with an ordering key (see
+   * getQueueEntryKey()) go to the lane of queued requests with the same key, e.g. broadcastUpdateDevice waits behind
+   * the queued events of its peer.
+   *
+   * @return Returns false when the method is not registered.
+   */
+  bool setRpcMethodPriority(const std::string &methodName, RpcPriority priority);
+
+  /**
+   * Sets how invoke() waits for the response (see WaitStrategy). The default is WaitStrategy::blocking. invoke() polls
+   * for at most 1 ms, also with WaitStrategy::spinning, and then blocks until the response arrives. Use
+   * setWaitStrategy() to set the strategy of the processing threads.
+   */
+  void setInvokeWaitStrategy(WaitStrategy strategy) { _invokeWaitStrategy = strategy; }
+
+  /**
+   * Sends floats as raw IEEE 754 doubles (VariableType::tDouble) from the start of each connection. Only enable this
+   * when Homegear is known to decode tDouble. By default floats are sent in the lossy legacy format until the server
+   * sends a tDouble itself. A server opts in by answering setPid (or any other request) with a tDouble value. The
+   * client then uses tDouble until it reconnects.
+   */
+  void setEncodeDouble(bool value);
+
+  using IQueue::setByteBudget;
+
+  /**
+   * Accounts the packets queued by this client in "budget", which can be shared with other clients. When the budget
+   * is exhausted, the client stops reading from the socket until packets were processed, so Homegear's sends block
+   * instead of the client buffering an unbounded backlog. While an RPC method called by Homegear waits for the response
+   * to invoke(), the socket is still read when no packet was processed for 10 ms, so these methods don't deadlock. Takes effect at the next
+   * call to start(). nullptr removes the budget.
+   */
+  void setByteBudget(std::shared_ptr<ByteBudget> budget);
+
+  using IQueue::setThreadOptions;
+
+  /**
+   * Sets the name, CPU affinity and scheduling policy of a group of threads (see ThreadOptions), e.g. to run the reader
+   * on a dedicated core with SCHED_FIFO. The threads are named "ipc-reader", "ipc-request-<number>" and
+   * "ipc-response-<number>" by default. Takes effect at the next call to start().
+   */
+  void setThreadOptions(ThreadGroup group, const ThreadOptions &options);
+
   virtual void start();
+
+  /**
+   * Connects to Homegear and starts "processingThreadCount" threads each for requests and responses. Call
+   * setScalingOptions(0, options) first to let the number of request threads follow the load instead. Then
+   * "processingThreadCount" is the initial count.
+   */
   virtual void start(size_t processingThreadCount);
+
+  /**
+   * Processes requests from Homegear with tasks posted to "threadPool" (at most "maxConcurrency" at a time) instead of
+   * threads of its own, so several clients can share the threads of one pool (see ThreadPool::getDefault()). Responses
+   * to invoke() are still processed by one dedicated thread, so RPC methods calling invoke() never wait for tasks of
+   * the pool. With start() a client uses 20 processing threads, with this overload it uses one.
+   */
+  virtual void start(std::shared_ptr<ThreadPool> threadPool, uint32_t maxConcurrency = 10);
   virtual void stop();
  protected:
   struct RequestInfo {
@@ -71,6 +288,35 @@ class IIpcClient : public IQueue {
   };
   typedef std::shared_ptr<RequestInfo> PRequestInfo;
 
+  /**
+   * A local RPC method. Either "member" or "function" is set. Member functions are called directly without the
+   * overhead of std::function.
+   */
+  struct LocalRpcMethod {
+    RpcMethod member = nullptr;
+    std::function<PVariable(PArray &parameters)> function;
+    bool runInline = false;
+    RpcPriority priority = RpcPriority::normal;
+  };
+
+  /**
+   * A broadcastEvent request decoded for coalescing (see setCoalescing()). Events of the same peer, channel and event
+   * source queued later are merged into it. Every merged request is answered with the result of the single call. It is
+   * only created when an event is merged. Events that were never merged are processed like other requests.
+   */
+  struct CoalescedEvent {
+    int64_t peerId = 0;
+    int32_t channel = -1;
+    std::string eventSource;
+    PArray parameters;
+    std::vector<PVariable> packetIds;
+  };
+
+  /**
+   * A packet in the request (index 0) or response queue (index 1). Only entries of this type may be queued. For
+   * requests, the method, ordering key and channel are resolved once by queueRequest() before queueing, so the queue's
+   * hooks and the processing thread don't decode the packet again.
+   */
   class QueueEntry : public IQueueEntry {
    public:
     QueueEntry() = default;
@@ -78,36 +324,188 @@ class IIpcClient : public IQueue {
     ~QueueEntry() override = default;
 
     std::vector<char> packet;
+    bool methodFound = false;
+    LocalRpcMethod method; //A copy of the registered method, valid when "methodFound" is true.
+    bool hasKey = false;
+    uint64_t key = 0; //The peer ID of broadcastEvent and broadcastUpdateDevice.
+    bool isEvent = false; //Set for broadcastEvent requests with the parameters needed for coalescing.
+    int32_t channel = -1;
+    std::unique_ptr<CoalescedEvent> event;
   };
 
   std::mutex _disposeMutex;
-  bool _disposing = false;
+  std::atomic_bool _disposing{false};
   std::string _socketPath;
   int32_t _fileDescriptor = -1;
   int64_t _lastGargabeCollection = 0;
   std::atomic_bool _stopped{true};
+  std::shared_ptr<ByteBudget> _byteBudget;
+  std::shared_ptr<ByteBudget> _activeByteBudget; //Set from _byteBudget on start, read by mainThread().
+  ThreadOptions _readerThreadOptions;
+  ThreadOptions _activeReaderThreadOptions; //Set from _readerThreadOptions on start, read by mainThread().
   std::atomic_bool _closed{true};
+  std::atomic<WaitStrategy> _invokeWaitStrategy{WaitStrategy::blocking};
+  std::atomic_bool _encodeDouble{false};
   std::mutex _sendMutex;
   std::mutex _rpcResponsesMutex;
   std::unordered_map<pthread_t, std::unordered_map<int32_t, PIpcResponse>> _rpcResponses;
-  std::map<std::string, std::function<PVariable(PArray &parameters)>> _localRpcMethods;
+  std::mutex _localRpcMethodsMutex; //Serializes read-modify-write updates of _localRpcMethods. Lookups don't lock.
+  RpcMethodTable<LocalRpcMethod> _localRpcMethods;
   std::thread _mainThread;
   std::thread _maintenanceThread;
   std::mutex _requestInfoMutex;
   std::map<pthread_t, PRequestInfo> _requestInfo;
+  std::atomic<uint32_t> _blockedProcessingThreads{0}; //Threads processing a request from Homegear and waiting in invoke(), read by mainThread().
   std::mutex _packetIdMutex;
   int32_t _currentPacketId = 0;
 
   std::unique_ptr<BinaryRpc> _binaryRpc;
   std::unique_ptr<RpcDecoder> _rpcDecoder;
   std::unique_ptr<RpcEncoder> _rpcEncoder;
+  PPreparedPacket _pingResponse; //The response to ping with the packet ID as slot.
+  bool _inlinePing = false; //Set by mainThread() when ping() isn't overridden.
 
   void init();
   void connect();
   void mainThread();
   void sendResponse(PVariable packetId, PVariable variable);
+  PVariable invokePacket(const std::string &methodName, const PPreparedPacket &preparedCall, const PArray &parameters, int32_t timeout);
+  int32_t nextPacketId();
+
+  /**
+   * Returns an empty buffer to encode a packet into. The buffer belongs to the calling thread and keeps its capacity
+   * between calls, so encoding usually doesn't allocate. It is only valid until the next call on the same thread.
+   */
+  static std::vector<char> &getFrameBuffer();
+
+  /**
+   * Sends the encoded request "data" and decodes the result to a Variable.
+   */
+  PVariable invokeEncoded(const std::string &methodName, int32_t packetId, std::vector<char> &data, int32_t timeout);
+
+  /**
+   * Sends the encoded request "data" and waits for the response.
+   *
+   * @return Returns the response or nullptr when no response was received. In this case "error" is set.
+   */
+  PIpcResponse sendRequest(const std::string &methodName, int32_t packetId, std::vector<char> &data, int32_t timeout, PVariable &error);
+
+  /**
+   * Encodes the request with RpcTraits and decodes the result into "Result". "Parameters" needs to be encoded as array
+   * (e.g. PArray or std::tuple).
+   */
+  template<typename Result, typename Parameters>
+  Result invokeTyped(const std::string &methodName, const Parameters &parameters, int32_t timeout) {
+    int32_t packetId = nextPacketId();
+    std::vector<char> &data = getFrameBuffer();
+    VectorSink<std::vector<char>> sink(data);
+    //Thread ID, packet ID and the parameters like in invoke()
+    _rpcEncoder->encodeTypedRequest(methodName, std::tuple<int64_t, int32_t, const Parameters &>((int64_t)pthread_self(), packetId, parameters), sink);
+
+    PVariable error;
+    PIpcResponse response = sendRequest(methodName, packetId, data, timeout, error);
+    if (!response) throw RpcErrorException(error->structValue->at("faultCode")->integerValue, error->structValue->at("faultString")->stringValue);
+
+    ByteSpan packet(response->packet);
+    int32_t faultCode = 0;
+    std::string faultString;
+    if (_rpcDecoder->decodeFault(packet, response->resultPosition, faultCode, faultString)) throw RpcErrorException(faultCode, faultString);
+
+    Result result{};
+    uint32_t position = response->resultPosition;
+    _rpcDecoder->decodeTyped(packet, position, result);
+    if (_rpcDecoder->doubleReceived() && !_rpcEncoder->getEncodeDouble()) _rpcEncoder->setEncodeDouble(true); //Server supports raw doubles
+    return result;
+  }
 
   void processQueueEntry(int32_t index, std::shared_ptr<IQueueEntry> &entry) override;
+
+  /**
+   * Keys broadcastEvent and broadcastUpdateDevice requests by their peer ID, so the events of one peer are processed in
+   * order even when the request queue has multiple processing threads. Events of different peers are still processed
+   * in parallel. The key is decoded by queueRequest(). Override this to change the key or return false to disable
+   * ordering.
+   */
+  bool getQueueEntryKey(int32_t index, std::shared_ptr<IQueueEntry> &entry, uint64_t &key) override;
+
+  /**
+   * Puts requests into the lane of their method's priority (see setRpcMethodPriority()).
+   */
+  uint32_t getQueueEntryPriority(int32_t index, std::shared_ptr<IQueueEntry> &entry) override;
+
+  /**
+   * When coalescing is enabled for the request queue with setCoalescing(0, true), broadcastEvent requests are keyed
+   * by peer ID and channel. A queued event absorbs newer events of the same peer and channel: values of variables it
+   * already contains are replaced, other variables are appended. This keeps the latest value of each variable, but
+   * events of one channel can be delivered before older events of other channels of the same peer.
+   */
+  bool getQueueEntryCoalescingKey(int32_t index, std::shared_ptr<IQueueEntry> &entry, uint64_t &key) override;
+
+  bool mergeQueueEntries(int32_t index, std::shared_ptr<IQueueEntry> &queuedEntry, std::shared_ptr<IQueueEntry> &entry) override;
+
+  /**
+   * Decodes the parameters of the broadcastEvent request "entry" into its CoalescedEvent, unless this was done before.
+   *
+   * @return Returns false when the request can't be decoded or doesn't have the parameters of broadcastEvent.
+   */
+  bool decodeCoalescedEvent(QueueEntry &entry);
+
+  /**
+   * Returns the size of the packet for the byte budget (see setByteBudget()).
+   */
+  size_t getQueueEntrySize(int32_t index, std::shared_ptr<IQueueEntry> &entry) override;
+
+  /**
+   * Calls broadcastEvent for a coalesced event and answers all requests merged into it. Exceptions thrown by the method
+   * are answered with an error response to every request.
+   *
+   * @param localMethod The method resolved when the first event was queued or nullptr when it is unknown.
+   */
+  void processCoalescedEvent(CoalescedEvent &event, const LocalRpcMethod *localMethod);
+
+  /**
+   * Adds or replaces a local RPC method. The priority of a replaced method is kept.
+   */
+  void addLocalRpcMethod(const std::string &methodName, LocalRpcMethod &localMethod);
+
+  /**
+   * Resolves the method and ordering key of the request "packet" on the reader thread. Requests to inline methods are
+   * processed directly, the others are queued.
+   */
+  void queueRequest(std::vector<char> &packet);
+
+  /**
+   * Calls the local method requested by "packet" and sends the response. Exceptions thrown by the method are answered
+   * with an error response.
+   */
+  void processRequest(std::vector<char> &packet);
+
+  /**
+   * Like processRequest(std::vector<char>&), but calls "localMethod", which was resolved before, instead of looking
+   * the method up. nullptr answers the request with an unknown method error.
+   */
+  void processRequest(std::vector<char> &packet, const LocalRpcMethod *localMethod);
+
+  /**
+   * Processes "packet" directly on the reader thread. "localMethod" is the inline method (see registerRpcMethod())
+   * resolved by queueRequest().
+   *
+   * @return Returns false when the packet needs to be queued, because it couldn't be decoded here.
+   */
+  bool processInlineRequest(std::vector<char> &packet, const LocalRpcMethod &localMethod);
+
+  /**
+   * Answers the ping request "packet" with _pingResponse. Only the packet ID is decoded and encoded. "methodName" is
+   * the span returned by decodeMethodName().
+   *
+   * @return Returns false when the packet needs to be queued, because it couldn't be decoded here.
+   */
+  bool processPing(std::vector<char> &packet, const ByteSpan &methodName);
+
+  /**
+   * Returns true when ping() is overridden by a subclass or when this can't be determined.
+   */
+  bool pingOverridden();
   PVariable send(std::vector<char> &data);
 
   virtual void onConnect() = 0;
@@ -115,7 +513,12 @@ class IIpcClient : public IQueue {
   virtual void onDisconnect() {};
 
   // {{{ RPC methods
-  virtual Ipc::PVariable ping(Ipc::PArray &parameters) { return std::make_shared<Ipc::Variable>(); }
+  /**
+   * Answered directly on the thread reading from the socket with a pre-encoded response, unless this is overridden or
+   * "ping" is registered again. Overrides are processed like other requests. Overrides can only be detected with GCC,
+   * with other compilers ping is always queued.
+   */
+  virtual Ipc::PVariable ping(Ipc::PArray &parameters);
   virtual Ipc::PVariable broadcastEvent(Ipc::PArray &parameters) { return std::make_shared<Ipc::Variable>(); }
   virtual Ipc::PVariable broadcastServiceMessage(Ipc::PArray &parameters) { return std::make_shared<Ipc::Variable>(); }
   virtual Ipc::PVariable broadcastNewDevices(Ipc::PArray &parameters) { return std::make_shared<Ipc::Variable>(); }
@@ -28,13 +28,11 @@
  * files in the program, then also delete it here.
 */
 
+
 #ifndef IPCIQUEUE_H_
 #define IPCIQUEUE_H_
 
-#include "IQueueBase.h"
-
-#include <vector>
-#include <iostream>
+#include "TypedQueue.h"
 
 namespace Ipc {
 class IQueueEntry {
@@ -43,28 +41,54 @@ class IQueueEntry {
   virtual ~IQueueEntry() {};
 };
 
-class IQueue : public IQueueBase {
+class IQueue;
+extern template class TypedQueue<IQueue, std::shared_ptr<IQueueEntry>>;
+
+/**
+ * TypedQueue for polymorphic entries with virtual hooks. Each entry is a separate allocation. Queues with only one
+ * entry type should derive from TypedQueue directly.
+ */
+class IQueue : public TypedQueue<IQueue, std::shared_ptr<IQueueEntry>> {
+  friend class TypedQueue<IQueue, std::shared_ptr<IQueueEntry>>;
  public:
-  IQueue(uint32_t queueCount, uint32_t bufferSize);
-  virtual ~IQueue();
-  void startQueue(int32_t index, bool waitWhenFull, uint32_t processingThreadCount);
-  void stopQueue(int32_t index);
+  IQueue(uint32_t queueCount, uint32_t bufferSize) : TypedQueue(queueCount, bufferSize) {}
+  virtual ~IQueue() {}
+
   bool enqueue(int32_t index, std::shared_ptr<IQueueEntry> &entry, bool waitWhenFull = false);
   virtual void processQueueEntry(int32_t index, std::shared_ptr<IQueueEntry> &entry) = 0;
-  bool queueEmpty(int32_t index);
- private:
-  int32_t _bufferSize = 10000;
-  std::vector<int32_t> _bufferHead;
-  std::vector<int32_t> _bufferTail;
-  std::vector<int32_t> _bufferCount;
-  std::vector<bool> _waitWhenFull;
-  std::vector<std::vector<std::shared_ptr<IQueueEntry>>> _buffer;
-  std::unique_ptr<std::mutex[]> _queueMutex = nullptr;
-  std::vector<std::vector<std::shared_ptr<std::thread>>> _processingThread;
-  std::unique_ptr<std::condition_variable[]> _produceConditionVariable = nullptr;
-  std::unique_ptr<std::condition_variable[]> _processingConditionVariable = nullptr;
 
-  void process(int32_t index);
+  /**
+   * Processes a batch of entries dequeued together (see setBatchSize()). Override this to handle many entries at once,
+   * e.g. to store them in one database transaction. Entries need to be processed in the given order, as a batch can
+   * contain several entries with the same ordering key. The default implementation calls processQueueEntry() for each
+   * entry.
+   */
+  virtual void processQueueEntries(int32_t index, std::vector<std::shared_ptr<IQueueEntry>> &entries);
+ protected:
+  /**
+   * See TypedQueue::getQueueEntryKey().
+   */
+  virtual bool getQueueEntryKey(int32_t index, std::shared_ptr<IQueueEntry> &entry, uint64_t &key) { return false; }
+
+  /**
+   * See TypedQueue::getQueueEntryPriority().
+   */
+  virtual uint32_t getQueueEntryPriority(int32_t index, std::shared_ptr<IQueueEntry> &entry) { return 0; }
+
+  /**
+   * See TypedQueue::getQueueEntryCoalescingKey().
+   */
+  virtual bool getQueueEntryCoalescingKey(int32_t index, std::shared_ptr<IQueueEntry> &entry, uint64_t &key) { return false; }
+
+  /**
+   * See TypedQueue::getQueueEntrySize().
+   */
+  virtual size_t getQueueEntrySize(int32_t index, std::shared_ptr<IQueueEntry> &entry) { return 0; }
+
+  /**
+   * See TypedQueue::mergeQueueEntries().
+   */
+  virtual bool mergeQueueEntries(int32_t index, std::shared_ptr<IQueueEntry> &queuedEntry, std::shared_ptr<IQueueEntry> &entry) { return false; }
 };
 
 }
@@ -42,6 +42,10 @@ IQueueBase::IQueueBase(uint32_t queueCount) {
   _droppedEntries = 0;
 }
 
+int64_t IQueueBase::steadyTime() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
 void IQueueBase::printQueueFullError(const std::string& message) {
   uint32_t droppedEntries = ++_droppedEntries;
   if (HelperFunctions::getTime() - _lastQueueFullError > 10000) {
@@ -31,21 +31,239 @@
 #ifndef IPCIQUEUEBASE_H_
 #define IPCIQUEUEBASE_H_
 
+#include "LatencyHistogram.h"
+
 #include <atomic>
 #include <memory>
 #include <condition_variable>
 #include <thread>
 #include <vector>
 #include <cstdint>
+#include <string>
 
 namespace Ipc {
 class IQueueBase {
  public:
+  /**
+   * Configures the priority lanes of a queue. Each lane is a FIFO. Entries are put into a lane by
+   * getQueueEntryPriority().
+   */
+  struct PriorityOptions {
+    /**
+     * The number of lanes. Lane 0 has the highest priority.
+     */
+    uint32_t laneCount = 1;
+
+    /**
+     * When empty, lanes are served by strict priority. Otherwise lanes are served by weighted round robin with one
+     * weight per lane, e.g. {8, 1} processes up to eight entries of lane 0 for each entry of lane 1. Missing weights
+     * and weights of 0 count as 1.
+     */
+    std::vector<uint32_t> weights;
+
+    /**
+     * Strict priority only: a waiting lane that was passed over this many times in a row is served next, so lower
+     * lanes are never starved completely. 0 disables this.
+     */
+    uint32_t starvationLimit = 0;
+  };
+
+  /**
+   * What enqueue() does when the queue is full.
+   */
+  enum class OverloadPolicy : int32_t {
+    /**
+     * Refuse the new entry. The default.
+     */
+    dropNewest = 0,
+
+    /**
+     * Drop the oldest queued entry of all lanes to make room, so the freshest entries are kept. Entries waiting for
+     * their ordering key can't be dropped. When only those are left, the new entry is refused.
+     */
+    dropOldest = 1,
+
+    /**
+     * Wait for free space until the timeout of OverloadOptions passes. Then refuse the new entry.
+     */
+    block = 2,
+
+    /**
+     * Drop the oldest entry of the lowest lane holding entries of a lower priority than the new entry (see
+     * PriorityOptions). When there is none, the new entry is refused.
+     */
+    shedByPriority = 3
+  };
+
+  struct OverloadOptions {
+    OverloadPolicy policy = OverloadPolicy::dropNewest;
+
+    /**
+     * The maximum time in milliseconds enqueue() waits for free space when it blocks, i.e. for OverloadPolicy::block
+     * and for calls with "waitWhenFull" set. 0 waits until there is space or the queue is stopped.
+     */
+    uint32_t timeout = 0;
+  };
+
+  /**
+   * The entries dropped by each overload policy (see OverloadOptions). All of them are also counted in
+   * QueueMetrics::dropped.
+   */
+  struct OverloadMetrics {
+    /**
+     * The number of new entries enqueue() refused because the queue was full.
+     */
+    uint64_t rejected = 0;
+
+    /**
+     * The number of queued entries dropped by OverloadPolicy::dropOldest.
+     */
+    uint64_t evicted = 0;
+
+    /**
+     * The number of queued entries dropped by OverloadPolicy::shedByPriority.
+     */
+    uint64_t shed = 0;
+
+    /**
+     * The number of calls to enqueue() that had to wait for free space and the number of those that gave up after the
+     * timeout.
+     */
+    uint64_t blocked = 0;
+    uint64_t timedOut = 0;
+  };
+
+  /**
+   * Lets the number of processing threads follow the load (see setScalingOptions()). A thread is added when the
+   * queue backs up. A thread exits after it found the queue empty for "idleTime". Adding is quick and removing is
+   * slow, so the thread count doesn't follow every burst down and up again.
+   */
+  struct ScalingOptions {
+    /**
+     * The range of the thread count. A "maxThreads" of 0 disables scaling, so the queue keeps the thread count passed
+     * to startQueue(). This is the default.
+     */
+    uint32_t minThreads = 1;
+    uint32_t maxThreads = 0;
+
+    /**
+     * A thread is added when more than this many entries per thread are queued. Entries waiting for their ordering
+     * key aren't counted.
+     */
+    uint32_t depthPerThread = 100;
+
+    /**
+     * A thread is also added when an entry waited longer than this in milliseconds. 0 only uses the depth.
+     */
+    uint32_t waitTime = 50;
+
+    /**
+     * The minimum time between adding two threads in milliseconds, so a new thread can take effect first.
+     */
+    uint32_t scaleUpInterval = 100;
+
+    /**
+     * The time in milliseconds a thread needs to find the queue empty before it exits. Checked about once per second.
+     */
+    uint32_t idleTime = 10000;
+  };
+
+  struct ScalingMetrics {
+    /**
+     * The number of running processing threads and the maximum since the start.
+     */
+    uint32_t threads = 0;
+    uint32_t peakThreads = 0;
+
+    /**
+     * The number of threads added because of the queue depth or the wait time and the number of those added because
+     * of the wait time.
+     */
+    uint64_t scaleUps = 0;
+    uint64_t scaleUpsByWaitTime = 0;
+
+    /**
+     * The number of threads that exited because they were idle.
+     */
+    uint64_t scaleDowns = 0;
+  };
+
+  struct LaneMetrics {
+    uint32_t depth = 0;
+    uint32_t highWatermark = 0;
+    uint64_t enqueued = 0;
+    uint64_t dequeued = 0;
+  };
+
+  struct CoalescingMetrics {
+    /**
+     * The number of queued entries that newer entries can still be merged into.
+     */
+    uint32_t pending = 0;
+
+    /**
+     * The number of entries merged into a queued entry instead of being queued.
+     */
+    uint64_t merged = 0;
+
+    /**
+     * The number of entries with the coalescing key of a queued entry that mergeQueueEntries() refused to merge.
+     */
+    uint64_t refused = 0;
+  };
+
+  struct QueueMetrics {
+    /**
+     * The number of entries queued and not processed yet, including entries waiting for their ordering key.
+     */
+    uint32_t depth = 0;
+    uint32_t highWatermark = 0;
+    uint64_t enqueued = 0;
+
+    /**
+     * The number of entries passed to processQueueEntries().
+     */
+    uint64_t dequeued = 0;
+
+    /**
+     * The number of entries dropped because the queue was full (see OverloadMetrics) plus the entries discarded by
+     * stopQueue().
+     */
+    uint64_t dropped = 0;
+
+    /**
+     * The bytes allocated for storing queued entries (see SegmentedFifo and MpmcRing). Memory allocated by the entries
+     * themselves, e.g. for packets, is not included.
+     */
+    uint64_t memoryUsage = 0;
+
+    /**
+     * The total size of the queued entries as returned by getQueueEntrySize() (see setByteLimit()).
+     */
+    uint64_t bytes = 0;
+
+    /**
+     * The time from enqueue() until the entry is passed to processQueueEntries() in nanoseconds.
+     */
+    LatencyHistogram::Snapshot waitTime;
+
+    /**
+     * The processing time per entry in nanoseconds. For batches this is the time of processQueueEntries() divided by
+     * the number of entries.
+     */
+    LatencyHistogram::Snapshot processingTime;
+  };
+
   IQueueBase(uint32_t queueCount);
   virtual ~IQueueBase() {}
 
   void printQueueFullError(const std::string& message);
  protected:
+  /**
+   * Returns the time of the monotonic clock in nanoseconds.
+   */
+  static int64_t steadyTime();
+
   int32_t _queueCount = 2;
   std::unique_ptr<std::atomic_bool[]> _stopProcessingThread;
 
@@ -34,6 +34,7 @@
 #include "Variable.h"
 
 #include <atomic>
+#include <vector>
 
 namespace Ipc {
 
@@ -41,7 +42,17 @@ class IpcResponse {
  public:
   std::atomic_bool finished{false};
   int32_t packetId = 0;
-  PVariable response;
+
+  /**
+   * The response packet. The result is decoded by the thread waiting for the response, as only that thread knows the
+   * type to decode it to.
+   */
+  std::vector<char> packet;
+
+  /**
+   * The position of the result in "packet" or "0" when the response is invalid.
+   */
+  uint32_t resultPosition = 0;
 };
 
 typedef std::shared_ptr<IpcResponse> PIpcResponse;
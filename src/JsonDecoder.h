@@ -34,6 +34,7 @@
 #include "Variable.h"
 #include "Math.h"
 #include "IpcException.h"
+#include "ByteSpan.h"
 #include <cmath>
 #if __GNUC__ > 4
 #include <codecvt>
@@ -55,29 +56,21 @@ class JsonDecoder {
   static PVariable decode(const std::string &json, uint32_t &bytesRead);
   static PVariable decode(const std::vector<char> &json);
   static PVariable decode(const std::vector<char> &json, uint32_t &bytesRead);
+  static PVariable decode(const ByteSpan &json);
+  static PVariable decode(const ByteSpan &json, uint32_t &bytesRead);
 
   static std::string decodeString(const std::string &s);
  private:
-  static inline bool posValid(const std::string &json, uint32_t pos);
-  static inline bool posValid(const std::vector<char> &json, uint32_t pos);
-  static void skipWhitespace(const std::string &json, uint32_t &pos);
-  static void skipWhitespace(const std::vector<char> &json, uint32_t &pos);
-  static void decodeObject(const std::string &json, uint32_t &pos, PVariable &variable);
-  static void decodeObject(const std::vector<char> &json, uint32_t &pos, PVariable &variable);
-  static void decodeArray(const std::string &json, uint32_t &pos, PVariable &variable);
-  static void decodeArray(const std::vector<char> &json, uint32_t &pos, PVariable &variable);
-  static void decodeString(const std::string &json, uint32_t &pos, PVariable &value);
-  static void decodeString(const std::vector<char> &json, uint32_t &pos, PVariable &value);
-  static void decodeString(const std::string &json, uint32_t &pos, std::string &s);
-  static void decodeString(const std::vector<char> &json, uint32_t &pos, std::string &s);
-  static bool decodeValue(const std::string &json, uint32_t &pos, PVariable &value);
-  static bool decodeValue(const std::vector<char> &json, uint32_t &pos, PVariable &value);
-  static void decodeBoolean(const std::string &json, uint32_t &pos, PVariable &value);
-  static void decodeBoolean(const std::vector<char> &json, uint32_t &pos, PVariable &value);
-  static void decodeNull(const std::string &json, uint32_t &pos, PVariable &value);
-  static void decodeNull(const std::vector<char> &json, uint32_t &pos, PVariable &value);
-  static bool decodeNumber(const std::string &json, uint32_t &pos, PVariable &value);
-  static bool decodeNumber(const std::vector<char> &json, uint32_t &pos, PVariable &value);
+  static inline bool posValid(const ByteSpan &json, uint32_t pos);
+  static void skipWhitespace(const ByteSpan &json, uint32_t &pos);
+  static void decodeObject(const ByteSpan &json, uint32_t &pos, PVariable &variable);
+  static void decodeArray(const ByteSpan &json, uint32_t &pos, PVariable &variable);
+  static void decodeString(const ByteSpan &json, uint32_t &pos, PVariable &value);
+  static void decodeString(const ByteSpan &json, uint32_t &pos, std::string &s);
+  static bool decodeValue(const ByteSpan &json, uint32_t &pos, PVariable &value);
+  static void decodeBoolean(const ByteSpan &json, uint32_t &pos, PVariable &value);
+  static void decodeNull(const ByteSpan &json, uint32_t &pos, PVariable &value);
+  static bool decodeNumber(const ByteSpan &json, uint32_t &pos, PVariable &value);
 };
 
 }
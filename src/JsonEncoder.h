@@ -32,6 +32,7 @@
 #define IPCJSONENCODER_H_
 
 #include "Variable.h"
+#include "ByteSink.h"
 #include <cmath>
 #include <sstream>
 #include <iomanip>
@@ -41,6 +42,8 @@
 
 namespace Ipc {
 
+class RpcTraitsBase;
+
 class JsonEncoder {
  public:
   JsonEncoder();
@@ -50,28 +53,144 @@ class JsonEncoder {
   std::vector<char> getVector(const PVariable variable);
 
   std::string encodeString(const std::string &s);
+
+  /**
+   * Encodes "variable" like getVector() and appends the JSON to "sink" (see ByteSink.h). The sink is not cleared.
+   */
+  template<typename Sink>
+  void encode(const PVariable &variable, Sink &sink) {
+    if (!variable) return;
+    switch (variable->type) {
+      case VariableType::tStruct: encodeStruct(variable, sink);
+        break;
+      case VariableType::tArray: encodeArray(variable, sink);
+        break;
+      default: sink.push_back('[');
+        encodeValue(variable, sink);
+        sink.push_back(']');
+        break;
+    }
+  }
+
+  /**
+   * Encodes "value" using RpcTraits and appends the JSON to "sink". Contrary to encode(), values which are neither
+   * arrays nor structs are not wrapped in an array. Defined in RpcTraits.h, include it to use this method.
+   */
+  template<typename T, typename Sink>
+  void encodeTyped(const T &value, Sink &sink);
  private:
+  friend class RpcTraitsBase;
+
   int32_t _requestId = 1;
 
   std::string toString(double number);
   void encodeValue(const PVariable &variable, std::ostringstream &s);
-  void encodeValue(const PVariable &variable, std::vector<char> &s);
   void encodeArray(const PVariable &variable, std::ostringstream &s);
-  void encodeArray(const PVariable &variable, std::vector<char> &s);
   void encodeStruct(const PVariable &variable, std::ostringstream &s);
-  void encodeStruct(const PVariable &variable, std::vector<char> &s);
   void encodeBoolean(const PVariable &variable, std::ostringstream &s);
-  void encodeBoolean(const PVariable &variable, std::vector<char> &s);
   void encodeInteger(const PVariable &variable, std::ostringstream &s);
-  void encodeInteger(const PVariable &variable, std::vector<char> &s);
   void encodeInteger64(const PVariable &variable, std::ostringstream &s);
-  void encodeInteger64(const PVariable &variable, std::vector<char> &s);
   void encodeFloat(const PVariable &variable, std::ostringstream &s);
-  void encodeFloat(const PVariable &variable, std::vector<char> &s);
   void encodeString(const PVariable &variable, std::ostringstream &s);
-  void encodeString(const PVariable &variable, std::vector<char> &s);
   void encodeVoid(const PVariable &variable, std::ostringstream &s);
-  void encodeVoid(const PVariable &variable, std::vector<char> &s);
+  template<typename Sink>
+  void encodeValue(const PVariable &variable, Sink &s) {
+    switch (variable->type) {
+      case VariableType::tArray: encodeArray(variable, s);
+        break;
+      case VariableType::tStruct: encodeStruct(variable, s);
+        break;
+      case VariableType::tBoolean: encodeBoolean(variable, s);
+        break;
+      case VariableType::tInteger: encodeInteger(variable, s);
+        break;
+      case VariableType::tInteger64: encodeInteger64(variable, s);
+        break;
+      case VariableType::tFloat: encodeFloat(variable, s);
+        break;
+      case VariableType::tDouble: encodeFloat(variable, s);
+        break;
+      case VariableType::tBase64: encodeString(variable, s);
+        break;
+      case VariableType::tString: encodeString(variable, s);
+        break;
+      case VariableType::tVoid: encodeVoid(variable, s);
+        break;
+      case VariableType::tVariant: encodeVoid(variable, s);
+        break;
+      case VariableType::tBinary: encodeVoid(variable, s);
+        break;
+    }
+  }
+
+  template<typename Sink>
+  void encodeArray(const PVariable &variable, Sink &s) {
+    s.push_back('[');
+    if (!variable->arrayValue->empty()) {
+      encodeValue(variable->arrayValue->at(0), s);
+      for (std::vector<PVariable>::iterator i = ++variable->arrayValue->begin(); i != variable->arrayValue->end(); ++i) {
+        s.push_back(',');
+        encodeValue(*i, s);
+      }
+    }
+    s.push_back(']');
+  }
+
+  template<typename Sink>
+  void encodeStruct(const PVariable &variable, Sink &s) {
+    s.push_back('{');
+    if (!variable->structValue->empty()) {
+      s.push_back('"');
+      s.append(variable->structValue->begin()->first.data(), variable->structValue->begin()->first.size());
+      s.append("\":", 2);
+      encodeValue(variable->structValue->begin()->second, s);
+      for (std::map<std::string, PVariable>::iterator i = ++variable->structValue->begin(); i != variable->structValue->end(); ++i) {
+        s.append(",\"", 2);
+        std::string key = encodeString(i->first);
+        s.append(key.data(), key.size());
+        s.append("\":", 2);
+        encodeValue(i->second, s);
+      }
+    }
+    s.push_back('}');
+  }
+
+  template<typename Sink>
+  void encodeBoolean(const PVariable &variable, Sink &s) {
+    if (variable->booleanValue) s.append("true", 4);
+    else s.append("false", 5);
+  }
+
+  template<typename Sink>
+  void encodeInteger(const PVariable &variable, Sink &s) {
+    std::string value(std::to_string(variable->integerValue));
+    s.append(value.data(), value.size());
+  }
+
+  template<typename Sink>
+  void encodeInteger64(const PVariable &variable, Sink &s) {
+    std::string value(std::to_string(variable->integerValue64));
+    s.append(value.data(), value.size());
+  }
+
+  template<typename Sink>
+  void encodeFloat(const PVariable &variable, Sink &s) {
+    std::string value(toString(variable->floatValue));
+    s.append(value.data(), value.size());
+  }
+
+  template<typename Sink>
+  void encodeString(const PVariable &variable, Sink &s) {
+    std::string value(encodeString(variable->stringValue));
+    s.push_back('"');
+    s.append(value.data(), value.size());
+    s.push_back('"');
+  }
+
+  template<typename Sink>
+  void encodeVoid(const PVariable &variable, Sink &s) {
+    s.append("null", 4);
+  }
 };
 
 }
@@ -0,0 +1,103 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * libhomegear-base is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * libhomegear-base is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libhomegear-base.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#include "LatencyHistogram.h"
+
+namespace Ipc {
+
+LatencyHistogram::LatencyHistogram() {
+  reset();
+}
+
+size_t LatencyHistogram::bucketIndex(uint64_t value) {
+  const uint64_t subBucketCount = 1u << subBucketBits;
+  if (value < subBucketCount) return value;
+  uint32_t exponent = 63 - __builtin_clzll(value);
+  //The bits below the leading one select the sub bucket.
+  size_t index = (exponent - subBucketBits + 1) * subBucketCount + ((value >> (exponent - subBucketBits)) & (subBucketCount - 1));
+  return index < bucketCount ? index : bucketCount - 1;
+}
+
+uint64_t LatencyHistogram::bucketLowerBound(size_t index) {
+  const uint64_t subBucketCount = 1u << subBucketBits;
+  if (index < subBucketCount) return index;
+  uint32_t exponent = index / subBucketCount + subBucketBits - 1;
+  return (subBucketCount + index % subBucketCount) << (exponent - subBucketBits);
+}
+
+uint64_t LatencyHistogram::bucketUpperBound(size_t index) {
+  if (index + 1 >= bucketCount) return UINT64_MAX;
+  return bucketLowerBound(index + 1) - 1;
+}
+
+void LatencyHistogram::record(uint64_t value, uint64_t count) {
+  _buckets[bucketIndex(value)].fetch_add(count, std::memory_order_relaxed);
+  _sum.fetch_add(value * count, std::memory_order_relaxed);
+  uint64_t max = _max.load(std::memory_order_relaxed);
+  while (value > max && !_max.compare_exchange_weak(max, value, std::memory_order_relaxed));
+}
+
+LatencyHistogram::Snapshot LatencyHistogram::snapshot() const {
+  Snapshot snapshot;
+  snapshot.buckets.resize(bucketCount);
+  for (size_t i = 0; i < bucketCount; i++) {
+    snapshot.buckets[i] = _buckets[i].load(std::memory_order_relaxed);
+    snapshot.count += snapshot.buckets[i];
+  }
+  snapshot.sum = _sum.load(std::memory_order_relaxed);
+  snapshot.max = _max.load(std::memory_order_relaxed);
+  return snapshot;
+}
+
+void LatencyHistogram::reset() {
+  for (auto &bucket : _buckets) {
+    bucket.store(0, std::memory_order_relaxed);
+  }
+  _sum.store(0, std::memory_order_relaxed);
+  _max.store(0, std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::Snapshot::percentile(double percentile) const {
+  if (count == 0) return 0;
+  uint64_t rank = (uint64_t)(percentile / 100.0 * count + 0.5);
+  if (rank == 0) rank = 1;
+  if (rank > count) rank = count;
+  uint64_t seen = 0;
+  for (size_t i = 0; i < buckets.size(); i++) {
+    seen += buckets[i];
+    if (seen >= rank) {
+      uint64_t upperBound = bucketUpperBound(i);
+      return upperBound < max ? upperBound : max;
+    }
+  }
+  return max;
+}
+
+}
@@ -0,0 +1,97 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * libhomegear-base is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * libhomegear-base is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libhomegear-base.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#ifndef IPCLATENCYHISTOGRAM_H_
+#define IPCLATENCYHISTOGRAM_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace Ipc {
+
+/**
+ * Log-linear histogram of durations in nanoseconds. Every power of two is split into eight buckets of equal width, so
+ * a value is known to within 12.5 % up to about two hours. Larger values land in the last bucket. Recording takes a
+ * few relaxed atomic operations and no lock, so it can stay enabled all the time.
+ */
+class LatencyHistogram {
+ public:
+  static const size_t bucketCount = 328;
+
+  struct Snapshot {
+    /**
+     * The number of values per bucket, see bucketLowerBound().
+     */
+    std::vector<uint64_t> buckets;
+    uint64_t count = 0;
+    uint64_t sum = 0;
+    uint64_t max = 0;
+
+    uint64_t mean() const { return count > 0 ? sum / count : 0; }
+
+    /**
+     * Returns the upper bound of the bucket containing the given percentile, e.g. percentile(99.0).
+     */
+    uint64_t percentile(double percentile) const;
+  };
+
+  LatencyHistogram();
+
+  /**
+   * Records "count" values of "value" nanoseconds.
+   */
+  void record(uint64_t value, uint64_t count = 1);
+
+  /**
+   * Copies the counters. Values recorded at the same time might be counted partially, e.g. in "count" but not yet
+   * in "sum".
+   */
+  Snapshot snapshot() const;
+
+  /**
+   * Not thread-safe with record().
+   */
+  void reset();
+
+  static size_t bucketIndex(uint64_t value);
+  static uint64_t bucketLowerBound(size_t index);
+  static uint64_t bucketUpperBound(size_t index);
+ private:
+  static const uint32_t subBucketBits = 3;
+
+  std::atomic<uint64_t> _buckets[bucketCount];
+  std::atomic<uint64_t> _sum{0};
+  std::atomic<uint64_t> _max{0};
+};
+
+}
+#endif
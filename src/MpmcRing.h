@@ -0,0 +1,221 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * libhomegear-base is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * libhomegear-base is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libhomegear-base.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#ifndef IPCMPMCRING_H_
+#define IPCMPMCRING_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <utility>
+
+namespace Ipc {
+
+/**
+ * Bounded lock-free multi-producer multi-consumer FIFO (Dmitry Vyukov's sequence number ring). Each cell carries a
+ * sequence number telling producers and consumers whether it is free or filled for their current position, so push()
+ * and pop() only need one CAS on the shared position. Cells and positions are padded to cache lines to avoid false
+ * sharing. The capacity is rounded up to a power of two. Cells are allocated in segments of up to 64 cells when the
+ * producers first reach them, so a ring that never fills up stays small. Segments are freed by the destructor.
+ */
+template<typename T>
+class MpmcRing {
+ public:
+  explicit MpmcRing(size_t minimumCapacity) {
+    size_t capacity = 2;
+    while (capacity < minimumCapacity) capacity <<= 1;
+    _mask = capacity - 1;
+    _segmentSize = capacity < maxSegmentSize ? capacity : maxSegmentSize;
+    size_t segmentCount = capacity / _segmentSize;
+    _segments.reset(new std::atomic<Cell *>[segmentCount]);
+    _segmentStorage.reset(new char *[segmentCount]);
+    for (size_t i = 0; i < segmentCount; i++) {
+      _segments[i].store(nullptr, std::memory_order_relaxed);
+      _segmentStorage[i] = nullptr;
+    }
+    _enqueuePosition.store(0, std::memory_order_relaxed);
+    _dequeuePosition.store(0, std::memory_order_relaxed);
+  }
+
+  ~MpmcRing() {
+    for (size_t i = 0; i < capacity() / _segmentSize; i++) {
+      Cell *cells = _segments[i].load(std::memory_order_relaxed);
+      if (!cells) continue;
+      for (size_t j = 0; j < _segmentSize; j++) {
+        cells[j].~Cell();
+      }
+      delete[] _segmentStorage[i];
+    }
+  }
+
+  MpmcRing(const MpmcRing &) = delete;
+  MpmcRing &operator=(const MpmcRing &) = delete;
+
+  size_t capacity() const { return _mask + 1; }
+
+  /**
+   * The number of bytes allocated for cells.
+   */
+  size_t memoryUsage() const { return _allocatedSegments.load(std::memory_order_relaxed) * segmentBytes(); }
+
+  /**
+   * Moves "value" into the ring.
+   *
+   * @return Returns false when the ring is full. "value" is unchanged in this case.
+   */
+  bool push(T &value) {
+    Cell *cell;
+    size_t position = _enqueuePosition.load(std::memory_order_relaxed);
+    while (true) {
+      cell = getCell(position, true);
+      size_t sequence = cell->sequence.load(std::memory_order_acquire);
+      intptr_t difference = (intptr_t)sequence - (intptr_t)position;
+      if (difference == 0) {
+        if (_enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) break;
+      } else if (difference < 0) return false; //Full
+      else position = _enqueuePosition.load(std::memory_order_relaxed);
+    }
+    cell->value = std::move(value);
+    cell->sequence.store(position + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * Moves the oldest element into "value".
+   *
+   * @return Returns false when the ring is empty.
+   */
+  bool pop(T &value) {
+    Cell *cell;
+    size_t position = _dequeuePosition.load(std::memory_order_relaxed);
+    while (true) {
+      cell = getCell(position, false);
+      if (!cell) return false; //Empty, nothing was pushed into this segment yet
+      size_t sequence = cell->sequence.load(std::memory_order_acquire);
+      intptr_t difference = (intptr_t)sequence - (intptr_t)(position + 1);
+      if (difference == 0) {
+        if (_dequeuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) break;
+      } else if (difference < 0) return false; //Empty
+      else position = _dequeuePosition.load(std::memory_order_relaxed);
+    }
+    value = std::move(cell->value);
+    cell->value = T();
+    cell->sequence.store(position + _mask + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * The number of elements pushed so far.
+   */
+  uint64_t pushed() const { return _enqueuePosition.load(std::memory_order_relaxed); }
+
+  /**
+   * The number of elements popped so far.
+   */
+  uint64_t popped() const { return _dequeuePosition.load(std::memory_order_relaxed); }
+
+  /**
+   * The number of elements in the ring. Only a snapshot while other threads push or pop.
+   */
+  size_t size() const {
+    size_t dequeuePosition = _dequeuePosition.load(std::memory_order_relaxed);
+    size_t enqueuePosition = _enqueuePosition.load(std::memory_order_relaxed);
+    return enqueuePosition > dequeuePosition ? enqueuePosition - dequeuePosition : 0;
+  }
+ private:
+  static const size_t cacheLineSize = 64;
+  static const size_t maxSegmentSize = 64;
+
+  struct alignas(64) Cell {
+    std::atomic<size_t> sequence;
+    T value;
+  };
+
+  //_segmentStorage holds the unaligned allocations. Only read by the destructor.
+  std::unique_ptr<std::atomic<Cell *>[]> _segments;
+  std::unique_ptr<char *[]> _segmentStorage;
+  std::atomic<size_t> _allocatedSegments{0};
+  size_t _segmentSize = 0;
+  size_t _mask = 0;
+
+  char _padding1[cacheLineSize];
+  std::atomic<size_t> _enqueuePosition;
+  char _padding2[cacheLineSize - sizeof(std::atomic<size_t>)];
+  std::atomic<size_t> _dequeuePosition;
+  char _padding3[cacheLineSize - sizeof(std::atomic<size_t>)];
+
+  size_t segmentBytes() const { return _segmentSize * sizeof(Cell) + cacheLineSize; }
+
+  /**
+   * Returns the cell of "position". When its segment wasn't allocated yet, the segment is allocated if "allocate" is
+   * true and nullptr is returned otherwise.
+   */
+  Cell *getCell(size_t position, bool allocate) {
+    size_t index = position & _mask;
+    std::atomic<Cell *> &segment = _segments[index / _segmentSize];
+    Cell *cells = segment.load(std::memory_order_acquire);
+    if (!cells) {
+      if (!allocate) return nullptr;
+      cells = allocateSegment(index / _segmentSize);
+    }
+    return &cells[index % _segmentSize];
+  }
+
+  /**
+   * Allocates segment "segmentIndex". Producers only look at the cell of the current enqueue position, so segments are
+   * allocated during the first lap and the cells start with the sequence numbers of the first lap. When two producers
+   * race, the loser frees its segment.
+   */
+  Cell *allocateSegment(size_t segmentIndex) {
+    //new[] doesn't honor the alignment of Cell before C++17, so the cells are aligned manually.
+    char *storage = new char[segmentBytes()];
+    Cell *cells = reinterpret_cast<Cell *>(((uintptr_t)storage + cacheLineSize - 1) & ~(uintptr_t)(cacheLineSize - 1));
+    for (size_t i = 0; i < _segmentSize; i++) {
+      new(&cells[i]) Cell();
+      cells[i].sequence.store(segmentIndex * _segmentSize + i, std::memory_order_relaxed);
+    }
+    Cell *expected = nullptr;
+    if (_segments[segmentIndex].compare_exchange_strong(expected, cells, std::memory_order_acq_rel)) {
+      _segmentStorage[segmentIndex] = storage;
+      _allocatedSegments.fetch_add(1, std::memory_order_relaxed);
+      return cells;
+    }
+    for (size_t i = 0; i < _segmentSize; i++) {
+      cells[i].~Cell();
+    }
+    delete[] storage;
+    return expected;
+  }
+};
+
+}
+#endif
@@ -52,6 +52,7 @@ class Output {
   virtual ~Output();
 
   static void setLogLevel(int32_t value);
+  static int32_t getLogLevel() { return _logLevel; }
 
   /**
    * Prints an error message with filename, line number and function name.
@@ -0,0 +1,87 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * libhomegear-base is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * libhomegear-base is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libhomegear-base.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#ifndef IPCPREPAREDPACKET_H_
+#define IPCPREPAREDPACKET_H_
+
+#include "Variable.h"
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace Ipc {
+
+/**
+ * A request or response pre-encoded by RpcEncoder::prepareRequest() or RpcEncoder::prepareResponse(). Everything
+ * constant is encoded once. Placeholders in the template (see Variable::createPlaceholder()) are "slots" which
+ * RpcEncoder::encodePrepared() fills in order with the values passed to it. Slots can be nested in arrays and structs.
+ *
+ * The template is kept, as the constant bytes are encoded again when the encoder's float or integer encoding changes.
+ * Don't modify it after preparing.
+ */
+class PreparedPacket {
+ public:
+  PreparedPacket() = default;
+  virtual ~PreparedPacket() = default;
+
+  bool isRequest() const { return _isRequest; }
+  const std::string &getMethodName() const { return _methodName; }
+  size_t getSlotCount() const { return _slotCount; }
+ private:
+  friend class RpcEncoder;
+
+  struct Encoding {
+    bool forceInteger64 = false;
+    bool encodeDouble = false;
+
+    /**
+     * The complete packet without the slot values. The length field (bytes 4 to 7) is not set.
+     */
+    std::vector<char> data;
+
+    /**
+     * Positions in "data" to insert the slot values at.
+     */
+    std::vector<uint32_t> slots;
+  };
+
+  bool _isRequest = false;
+  std::string _methodName;
+  PVariable _template;
+  size_t _slotCount = 0;
+  mutable std::mutex _encodingMutex;
+  mutable std::shared_ptr<const Encoding> _encoding; //Only access with std::atomic_load and std::atomic_store.
+};
+
+typedef std::shared_ptr<PreparedPacket> PPreparedPacket;
+
+}
+#endif
@@ -29,6 +29,7 @@
 */
 
 #include "RpcDecoder.h"
+#include "RpcTraits.h"
 #include "Math.h"
 
 namespace Ipc {
@@ -38,23 +39,30 @@ RpcDecoder::RpcDecoder() {
 }
 
 std::shared_ptr<RpcHeader> RpcDecoder::decodeHeader(std::vector<char> &packet) {
-  std::shared_ptr<RpcHeader> header = std::make_shared<RpcHeader>();
-  if (!(packet.size() < 12 || packet.at(3) == 0x40 || packet.at(3) == 0x41)) return header;
-  uint32_t position = 4;
-  uint32_t headerSize = 0;
-  headerSize = _decoder->decodeInteger(packet, position);
-  if (headerSize < 4) return header;
-  uint32_t parameterCount = _decoder->decodeInteger(packet, position);
-  for (uint32_t i = 0; i < parameterCount; i++) {
-    std::string field = _decoder->decodeString(packet, position);
-    HelperFunctions::toLower(field);
-    std::string value = _decoder->decodeString(packet, position);
-    if (field == "authorization") header->authorization = value;
-  }
-  return header;
+  return decodeHeader(ByteSpan(packet));
+}
+
+std::shared_ptr<std::vector<std::shared_ptr<Variable>>> RpcDecoder::decodeRequest(std::vector<char> &packet, std::string &methodName) {
+  return decodeRequest(ByteSpan(packet), methodName);
+}
+
+std::shared_ptr<Variable> RpcDecoder::decodeResponse(std::vector<char> &packet, uint32_t offset) {
+  return decodeResponse(ByteSpan(packet), offset);
 }
 
 std::shared_ptr<RpcHeader> RpcDecoder::decodeHeader(std::vector<uint8_t> &packet) {
+  return decodeHeader(ByteSpan(packet));
+}
+
+std::shared_ptr<std::vector<std::shared_ptr<Variable>>> RpcDecoder::decodeRequest(std::vector<uint8_t> &packet, std::string &methodName) {
+  return decodeRequest(ByteSpan(packet), methodName);
+}
+
+std::shared_ptr<Variable> RpcDecoder::decodeResponse(std::vector<uint8_t> &packet, uint32_t offset) {
+  return decodeResponse(ByteSpan(packet), offset);
+}
+
+std::shared_ptr<RpcHeader> RpcDecoder::decodeHeader(const ByteSpan &packet) {
   std::shared_ptr<RpcHeader> header = std::make_shared<RpcHeader>();
   if (!(packet.size() < 12 || packet.at(3) == 0x40 || packet.at(3) == 0x41)) return header;
   uint32_t position = 4;
@@ -71,12 +79,19 @@ std::shared_ptr<RpcHeader> RpcDecoder::decodeHeader(std::vector<uint8_t> &packet
   return header;
 }
 
-std::shared_ptr<std::vector<std::shared_ptr<Variable>>> RpcDecoder::decodeRequest(std::vector<char> &packet, std::string &methodName) {
+std::shared_ptr<std::vector<std::shared_ptr<Variable>>> RpcDecoder::decodeRequest(const ByteSpan &packet, std::string &methodName) {
+  ByteSpan methodNameSpan;
+  std::shared_ptr<std::vector<std::shared_ptr<Variable>>> parameters = decodeRequest(packet, methodNameSpan);
+  methodName.assign(methodNameSpan.data(), methodNameSpan.size());
+  return parameters;
+}
+
+std::shared_ptr<std::vector<std::shared_ptr<Variable>>> RpcDecoder::decodeRequest(const ByteSpan &packet, ByteSpan &methodName) {
   uint32_t position = 4;
   uint32_t headerSize = 0;
   if (packet.at(3) == 0x40 || packet.at(3) == 0x41) headerSize = _decoder->decodeInteger(packet, position) + 4;
   position = 8 + headerSize;
-  methodName = _decoder->decodeString(packet, position);
+  methodName = decodeStringSpan(packet, position);
   uint32_t parameterCount = _decoder->decodeInteger(packet, position);
   std::shared_ptr<std::vector<std::shared_ptr<Variable>>> parameters = std::make_shared<std::vector<std::shared_ptr<Variable>>>();
   if (parameterCount > 100) return parameters;
@@ -86,38 +101,19 @@ std::shared_ptr<std::vector<std::shared_ptr<Variable>>> RpcDecoder::decodeReques
   return parameters;
 }
 
-std::shared_ptr<std::vector<std::shared_ptr<Variable>>> RpcDecoder::decodeRequest(std::vector<uint8_t> &packet, std::string &methodName) {
+ByteSpan RpcDecoder::decodeMethodName(const ByteSpan &packet) {
   uint32_t position = 4;
   uint32_t headerSize = 0;
   if (packet.at(3) == 0x40 || packet.at(3) == 0x41) headerSize = _decoder->decodeInteger(packet, position) + 4;
   position = 8 + headerSize;
-  methodName = _decoder->decodeString(packet, position);
-  uint32_t parameterCount = _decoder->decodeInteger(packet, position);
-  std::shared_ptr<std::vector<std::shared_ptr<Variable>>> parameters = std::make_shared<std::vector<std::shared_ptr<Variable>>>();
-  if (parameterCount > 100) return parameters;
-  for (uint32_t i = 0; i < parameterCount; i++) {
-    parameters->push_back(decodeParameter(packet, position));
-  }
-  return parameters;
+  return decodeStringSpan(packet, position);
 }
 
-std::shared_ptr<Variable> RpcDecoder::decodeResponse(std::vector<char> &packet, uint32_t offset) {
+std::shared_ptr<Variable> RpcDecoder::decodeResponse(const ByteSpan &packet, uint32_t offset) {
   uint32_t position = offset + 8;
   std::shared_ptr<Variable> response = decodeParameter(packet, position);
   if (packet.size() < 4) return response; //response is Void when packet is empty.
-  if (packet.at(3) == 0xFF) {
-    response->errorStruct = true;
-    if (response->structValue->find("faultCode") == response->structValue->end()) response->structValue->insert(StructElement("faultCode", std::make_shared<Variable>(-1)));
-    if (response->structValue->find("faultString") == response->structValue->end()) response->structValue->insert(StructElement("faultString", std::make_shared<Variable>(std::string("undefined"))));
-  }
-  return response;
-}
-
-std::shared_ptr<Variable> RpcDecoder::decodeResponse(std::vector<uint8_t> &packet, uint32_t offset) {
-  uint32_t position = offset + 8;
-  std::shared_ptr<Variable> response = decodeParameter(packet, position);
-  if (packet.size() < 4) return response; //response is Void when packet is empty.
-  if (packet.at(3) == 0xFF) {
+  if ((uint8_t)packet.at(3) == 0xFF) {
     response->errorStruct = true;
     if (response->structValue->find("faultCode") == response->structValue->end()) response->structValue->insert(StructElement("faultCode", std::make_shared<Variable>(-1)));
     if (response->structValue->find("faultString") == response->structValue->end()) response->structValue->insert(StructElement("faultString", std::make_shared<Variable>(std::string("undefined"))));
@@ -136,15 +132,45 @@ void RpcDecoder::decodeResponse(PVariable &variable, uint32_t offset) {
   }
 }
 
-VariableType RpcDecoder::decodeType(std::vector<char> &packet, uint32_t &position) {
-  return (VariableType)_decoder->decodeInteger(packet, position);
+bool RpcDecoder::decodeArrayStart(const ByteSpan &data, uint32_t &position, uint32_t &count) {
+  uint32_t arrayPosition = position;
+  if (decodeType(data, arrayPosition) != VariableType::tArray) return false;
+  count = _decoder->decodeInteger(data, arrayPosition);
+  position = arrayPosition;
+  return true;
+}
+
+bool RpcDecoder::decodeFault(const ByteSpan &data, uint32_t position, int32_t &faultCode, std::string &faultString) {
+  if (decodeType(data, position) != VariableType::tStruct) return false;
+  if (_decoder->decodeInteger(data, position) != 2) return false;
+  bool faultCodeFound = false;
+  bool faultStringFound = false;
+  for (int32_t i = 0; i < 2; i++) {
+    std::string name = _decoder->decodeString(data, position);
+    if (name == "faultCode") {
+      decodeTyped(data, position, faultCode);
+      faultCodeFound = true;
+    } else if (name == "faultString") {
+      decodeTyped(data, position, faultString);
+      faultStringFound = true;
+    } else return false;
+  }
+  return faultCodeFound && faultStringFound;
 }
 
-VariableType RpcDecoder::decodeType(std::vector<uint8_t> &packet, uint32_t &position) {
+VariableType RpcDecoder::decodeType(const ByteSpan &packet, uint32_t &position) {
   return (VariableType)_decoder->decodeInteger(packet, position);
 }
 
-std::shared_ptr<Variable> RpcDecoder::decodeParameter(std::vector<char> &packet, uint32_t &position) {
+ByteSpan RpcDecoder::decodeStringSpan(const ByteSpan &packet, uint32_t &position) {
+  int32_t stringLength = _decoder->decodeInteger(packet, position);
+  if (stringLength <= 0 || position > packet.size() || (uint32_t)stringLength > packet.size() - position) return ByteSpan();
+  ByteSpan string(packet.data() + position, stringLength);
+  position += stringLength;
+  return string;
+}
+
+std::shared_ptr<Variable> RpcDecoder::decodeParameter(const ByteSpan &packet, uint32_t &position) {
   VariableType type = decodeType(packet, position);
   std::shared_ptr<Variable> variable = std::make_shared<Variable>(type);
   if (type == VariableType::tVoid) {
@@ -170,46 +196,9 @@ std::shared_ptr<Variable> RpcDecoder::decodeParameter(std::vector<char> &packet,
     variable->integerValue = (int32_t)std::lround(variable->floatValue);
     variable->integerValue64 = std::llround(variable->floatValue);
     variable->booleanValue = (bool)variable->floatValue;
-  } else if (type == VariableType::tBoolean) {
-    variable->booleanValue = _decoder->decodeBoolean(packet, position);
-    variable->integerValue = (int32_t)variable->booleanValue;
-    variable->integerValue64 = (int64_t)variable->booleanValue;
-  } else if (type == VariableType::tBinary) {
-    variable->binaryValue = _decoder->decodeBinary(packet, position);
-  } else if (type == VariableType::tArray) {
-    variable->arrayValue = decodeArray(packet, position);
-  } else if (type == VariableType::tStruct) {
-    variable->structValue = decodeStruct(packet, position);
-    if (variable->structValue->size() == 2 && variable->structValue->find("faultCode") != variable->structValue->end() && variable->structValue->find("faultString") != variable->structValue->end()) {
-      variable->errorStruct = true;
-    }
-  }
-  return variable;
-}
-
-std::shared_ptr<Variable> RpcDecoder::decodeParameter(std::vector<uint8_t> &packet, uint32_t &position) {
-  VariableType type = decodeType(packet, position);
-  std::shared_ptr<Variable> variable = std::make_shared<Variable>(type);
-  if (type == VariableType::tVoid) {
-    //Nothing
-  } else if (type == VariableType::tString || type == VariableType::tBase64) {
-    variable->stringValue = _decoder->decodeString(packet, position);
-    variable->integerValue64 = Math::getNumber64(variable->stringValue);
-    variable->integerValue = (int32_t)variable->integerValue64;
-    variable->booleanValue = !variable->stringValue.empty() && variable->stringValue != "0" && variable->stringValue != "false" && variable->stringValue != "f";
-
-  } else if (type == VariableType::tInteger) {
-    variable->integerValue = _decoder->decodeInteger(packet, position);
-    variable->integerValue64 = variable->integerValue;
-    variable->booleanValue = (bool)variable->integerValue;
-    variable->floatValue = variable->integerValue;
-  } else if (type == VariableType::tInteger64) {
-    variable->integerValue64 = _decoder->decodeInteger64(packet, position);
-    variable->integerValue = (int32_t)variable->integerValue64;
-    variable->booleanValue = (bool)variable->integerValue64;
-    variable->floatValue = variable->integerValue64;
-  } else if (type == VariableType::tFloat) {
-    variable->floatValue = _decoder->decodeFloat(packet, position);
+  } else if (type == VariableType::tDouble) {
+    _doubleReceived = true;
+    variable->floatValue = _decoder->decodeDouble(packet, position);
     variable->integerValue = (int32_t)std::lround(variable->floatValue);
     variable->integerValue64 = std::llround(variable->floatValue);
     variable->booleanValue = (bool)variable->floatValue;
@@ -255,6 +244,13 @@ void RpcDecoder::decodeParameter(PVariable &variable, uint32_t &position) {
     variable->integerValue = (int32_t)std::lround(variable->floatValue);
     variable->integerValue64 = std::llround(variable->floatValue);
     variable->booleanValue = (bool)variable->floatValue;
+  } else if (variable->type == VariableType::tDouble) {
+    _doubleReceived = true;
+    variable->type = VariableType::tFloat;
+    variable->floatValue = _decoder->decodeDouble(variable->binaryValue, position);
+    variable->integerValue = (int32_t)std::lround(variable->floatValue);
+    variable->integerValue64 = std::llround(variable->floatValue);
+    variable->booleanValue = (bool)variable->floatValue;
   } else if (variable->type == VariableType::tBoolean) {
     variable->booleanValue = _decoder->decodeBoolean(variable->binaryValue, position);
     variable->integerValue = (int32_t)variable->booleanValue;
@@ -271,7 +267,7 @@ void RpcDecoder::decodeParameter(PVariable &variable, uint32_t &position) {
   }
 }
 
-PArray RpcDecoder::decodeArray(std::vector<char> &packet, uint32_t &position) {
+PArray RpcDecoder::decodeArray(const ByteSpan &packet, uint32_t &position) {
   uint32_t arrayLength = _decoder->decodeInteger(packet, position);
   PArray array = std::make_shared<Array>();
   for (uint32_t i = 0; i < arrayLength; i++) {
@@ -280,26 +276,7 @@ PArray RpcDecoder::decodeArray(std::vector<char> &packet, uint32_t &position) {
   return array;
 }
 
-PArray RpcDecoder::decodeArray(std::vector<uint8_t> &packet, uint32_t &position) {
-  uint32_t arrayLength = _decoder->decodeInteger(packet, position);
-  PArray array = std::make_shared<Array>();
-  for (uint32_t i = 0; i < arrayLength; i++) {
-    array->push_back(decodeParameter(packet, position));
-  }
-  return array;
-}
-
-PStruct RpcDecoder::decodeStruct(std::vector<char> &packet, uint32_t &position) {
-  uint32_t structLength = _decoder->decodeInteger(packet, position);
-  PStruct rpcStruct = std::make_shared<Struct>();
-  for (uint32_t i = 0; i < structLength; i++) {
-    std::string name = _decoder->decodeString(packet, position);
-    rpcStruct->insert(StructElement(name, decodeParameter(packet, position)));
-  }
-  return rpcStruct;
-}
-
-PStruct RpcDecoder::decodeStruct(std::vector<uint8_t> &packet, uint32_t &position) {
+PStruct RpcDecoder::decodeStruct(const ByteSpan &packet, uint32_t &position) {
   uint32_t structLength = _decoder->decodeInteger(packet, position);
   PStruct rpcStruct = std::make_shared<Struct>();
   for (uint32_t i = 0; i < structLength; i++) {
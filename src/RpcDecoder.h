@@ -39,8 +39,13 @@
 #include <memory>
 #include <vector>
 #include <cmath>
+#include <atomic>
+#include <tuple>
 
 namespace Ipc {
+
+class RpcTraitsBase;
+
 class RpcDecoder {
  public:
   RpcDecoder();
@@ -53,18 +58,83 @@ class RpcDecoder {
   virtual std::shared_ptr<Variable> decodeResponse(std::vector<char> &packet, uint32_t offset = 0);
   virtual std::shared_ptr<Variable> decodeResponse(std::vector<uint8_t> &packet, uint32_t offset = 0);
   virtual void decodeResponse(PVariable &variable, uint32_t offset = 0);
+
+  //Span versions of the methods above. They work on any contiguous memory. The vector versions wrap these.
+  virtual std::shared_ptr<RpcHeader> decodeHeader(const ByteSpan &packet);
+  virtual std::shared_ptr<std::vector<std::shared_ptr<Variable>>> decodeRequest(const ByteSpan &packet, std::string &methodName);
+  virtual std::shared_ptr<Variable> decodeResponse(const ByteSpan &packet, uint32_t offset = 0);
+
+  /**
+   * Like decodeRequest(const ByteSpan&, std::string&), but the method name is not copied. "methodName" points into
+   * "packet", so it is only valid as long as the packet is.
+   */
+  virtual std::shared_ptr<std::vector<std::shared_ptr<Variable>>> decodeRequest(const ByteSpan &packet, ByteSpan &methodName);
+
+  /**
+   * Decodes only the method name of a request. The returned span points into "packet".
+   */
+  ByteSpan decodeMethodName(const ByteSpan &packet);
+
+  /**
+   * Decodes a request without creating Variables. The parameters are decoded into the elements of "parameters" using
+   * RpcTraits. Missing parameters get their default value, additional parameters are ignored. Defined in RpcTraits.h,
+   * include it to use this method.
+   */
+  template<typename... Parameters>
+  void decodeTypedRequest(const ByteSpan &packet, std::string &methodName, std::tuple<Parameters...> &parameters);
+
+  /**
+   * Like decodeTypedRequest(), but continues behind "methodName", which was returned by decodeMethodName() for the same
+   * packet, so the method name is not decoded again. Defined in RpcTraits.h.
+   */
+  template<typename... Parameters>
+  void decodeTypedParameters(const ByteSpan &packet, const ByteSpan &methodName, std::tuple<Parameters...> &parameters);
+
+  /**
+   * Decodes a response into "value" using RpcTraits. Defined in RpcTraits.h.
+   */
+  template<typename T>
+  void decodeTypedResponse(const ByteSpan &packet, T &value, uint32_t offset = 0);
+
+  /**
+   * Decodes the value at "position" into "value" using RpcTraits and moves "position" behind it. Defined in RpcTraits.h.
+   */
+  template<typename T>
+  void decodeTyped(const ByteSpan &data, uint32_t &position, T &value);
+
+  /**
+   * Checks if the value at "position" is an array. If it is, "count" is set to the number of elements and "position" is
+   * moved to the first element. Otherwise "position" is not changed.
+   */
+  bool decodeArrayStart(const ByteSpan &data, uint32_t &position, uint32_t &count);
+
+  /**
+   * Checks if the value at "position" is an error struct (a struct with exactly the elements "faultCode" and
+   * "faultString") and decodes it if it is.
+   */
+  bool decodeFault(const ByteSpan &data, uint32_t position, int32_t &faultCode, std::string &faultString);
+
+  /**
+   * Returns true when a VariableType::tDouble was decoded since the last call to resetDoubleReceived(). This means the other side supports raw doubles.
+   */
+  bool doubleReceived() { return _doubleReceived; }
+  void resetDoubleReceived() { _doubleReceived = false; }
  private:
+  friend class RpcTraitsBase;
+
   std::unique_ptr<BinaryDecoder> _decoder;
+  std::atomic_bool _doubleReceived{false};
 
-  std::shared_ptr<Variable> decodeParameter(std::vector<char> &packet, uint32_t &position);
-  std::shared_ptr<Variable> decodeParameter(std::vector<uint8_t> &packet, uint32_t &position);
+  std::shared_ptr<Variable> decodeParameter(const ByteSpan &packet, uint32_t &position);
   void decodeParameter(PVariable &variable, uint32_t &position);
-  VariableType decodeType(std::vector<char> &packet, uint32_t &position);
-  VariableType decodeType(std::vector<uint8_t> &packet, uint32_t &position);
-  std::shared_ptr<Array> decodeArray(std::vector<char> &packet, uint32_t &position);
-  std::shared_ptr<Array> decodeArray(std::vector<uint8_t> &packet, uint32_t &position);
-  std::shared_ptr<Struct> decodeStruct(std::vector<char> &packet, uint32_t &position);
-  std::shared_ptr<Struct> decodeStruct(std::vector<uint8_t> &packet, uint32_t &position);
+  VariableType decodeType(const ByteSpan &packet, uint32_t &position);
+
+  /**
+   * Decodes a string like BinaryDecoder::decodeString(), but returns a span pointing into "packet" instead of a copy.
+   */
+  ByteSpan decodeStringSpan(const ByteSpan &packet, uint32_t &position);
+  std::shared_ptr<Array> decodeArray(const ByteSpan &packet, uint32_t &position);
+  std::shared_ptr<Struct> decodeStruct(const ByteSpan &packet, uint32_t &position);
 };
 }
 #endif
@@ -33,426 +33,200 @@
 namespace Ipc {
 
 RpcEncoder::RpcEncoder() {
-  checkEndianness();
-
   _encoder = std::unique_ptr<BinaryEncoder>(new BinaryEncoder());
-
-  strncpy(&_packetStartRequest[0], "Bin", 4);
-  strncpy(&_packetStartResponse[0], "Bin", 4);
-  _packetStartResponse[3] = 1;
-  _packetStartResponse[4] = 0;
-  strncpy(&_packetStartError[0], "Bin", 4);
-  _packetStartError[3] = 0xFF;
-  _packetStartError[4] = 0;
 }
 
 RpcEncoder::RpcEncoder(bool forceInteger64) : RpcEncoder() {
   _forceInteger64 = forceInteger64;
 }
 
-void RpcEncoder::checkEndianness() {
-  union {
-    uint32_t i;
-    char c[4];
-  } bint = {0x01020304};
-
-  _isBigEndian = bint.c[0] == 1;
-}
-
-void RpcEncoder::memcpyBigEndian(char *to, const char *from, const uint32_t &length) {
-  if (_isBigEndian) memcpy(to, from, length);
-  else {
-    uint32_t last = length - 1;
-    for (uint32_t i = 0; i < length; i++) {
-      to[i] = from[last - i];
-    }
-  }
-}
-
 void RpcEncoder::encodeRequest(std::string methodName, std::shared_ptr<std::list<std::shared_ptr<Variable>>> parameters, std::vector<char> &encodedData, std::shared_ptr<RpcHeader> header) {
-  //The "Bin", the type byte after that and the length itself are not part of the length
   encodedData.clear();
-  encodedData.insert(encodedData.begin(), _packetStartRequest, _packetStartRequest + 4);
-  uint32_t headerSize = 0;
-  if (header) {
-    headerSize = encodeHeader(encodedData, *header) + 4;
-    if (headerSize > 0) encodedData.at(3) |= 0x40;
-  }
-  _encoder->encodeString(encodedData, methodName);
-  if (!parameters) _encoder->encodeInteger(encodedData, 0);
-  else _encoder->encodeInteger(encodedData, parameters->size());
-  if (parameters) {
-    for (std::list<std::shared_ptr<Variable>>::iterator i = parameters->begin(); i != parameters->end(); ++i) {
-      encodeVariable(encodedData, (*i));
-    }
-  }
-
-  uint32_t dataSize = encodedData.size() - 4 - headerSize;
-  char result[4];
-  memcpyBigEndian(result, (char *)&dataSize, 4);
-  encodedData.insert(encodedData.begin() + 4 + headerSize, result, result + 4);
+  VectorSink<std::vector<char>> sink(encodedData);
+  encodeRequestPacket(methodName, parameters.get(), sink, header);
 }
 
 void RpcEncoder::encodeRequest(std::string methodName, std::shared_ptr<std::list<std::shared_ptr<Variable>>> parameters, std::vector<uint8_t> &encodedData, std::shared_ptr<RpcHeader> header) {
-  //The "Bin", the type byte after that and the length itself are not part of the length
   encodedData.clear();
-  encodedData.insert(encodedData.begin(), _packetStartRequest, _packetStartRequest + 4);
-  uint32_t headerSize = 0;
-  if (header) {
-    headerSize = encodeHeader(encodedData, *header) + 4;
-    if (headerSize > 0) encodedData.at(3) |= 0x40;
-  }
-  _encoder->encodeString(encodedData, methodName);
-  if (!parameters) _encoder->encodeInteger(encodedData, 0);
-  else _encoder->encodeInteger(encodedData, parameters->size());
-  if (parameters) {
-    for (std::list<std::shared_ptr<Variable>>::iterator i = parameters->begin(); i != parameters->end(); ++i) {
-      encodeVariable(encodedData, (*i));
-    }
-  }
-
-  uint32_t dataSize = encodedData.size() - 4 - headerSize;
-  char result[4];
-  memcpyBigEndian(result, (char *)&dataSize, 4);
-  encodedData.insert(encodedData.begin() + 4 + headerSize, result, result + 4);
+  VectorSink<std::vector<uint8_t>> sink(encodedData);
+  encodeRequestPacket(methodName, parameters.get(), sink, header);
 }
 
 void RpcEncoder::encodeRequest(std::string methodName, PArray parameters, std::vector<char> &encodedData, std::shared_ptr<RpcHeader> header) {
-  //The "Bin", the type byte after that and the length itself are not part of the length
   encodedData.clear();
-  encodedData.insert(encodedData.begin(), _packetStartRequest, _packetStartRequest + 4);
-  uint32_t headerSize = 0;
-  if (header) {
-    headerSize = encodeHeader(encodedData, *header) + 4;
-    if (headerSize > 0) encodedData.at(3) |= 0x40;
-  }
-  _encoder->encodeString(encodedData, methodName);
-  if (!parameters) _encoder->encodeInteger(encodedData, 0);
-  else _encoder->encodeInteger(encodedData, parameters->size());
-  if (parameters) {
-    for (Array::iterator i = parameters->begin(); i != parameters->end(); ++i) {
-      encodeVariable(encodedData, (*i));
-    }
-  }
-
-  uint32_t dataSize = encodedData.size() - 4 - headerSize;
-  char result[4];
-  memcpyBigEndian(result, (char *)&dataSize, 4);
-  encodedData.insert(encodedData.begin() + 4 + headerSize, result, result + 4);
+  VectorSink<std::vector<char>> sink(encodedData);
+  encodeRequestPacket(methodName, parameters.get(), sink, header);
 }
 
 void RpcEncoder::encodeRequest(std::string methodName, PArray parameters, std::vector<uint8_t> &encodedData, std::shared_ptr<RpcHeader> header) {
-  //The "Bin", the type byte after that and the length itself are not part of the length
   encodedData.clear();
-  encodedData.insert(encodedData.begin(), _packetStartRequest, _packetStartRequest + 4);
-  uint32_t headerSize = 0;
-  if (header) {
-    headerSize = encodeHeader(encodedData, *header) + 4;
-    if (headerSize > 0) encodedData.at(3) |= 0x40;
-  }
-  _encoder->encodeString(encodedData, methodName);
-  if (!parameters) _encoder->encodeInteger(encodedData, 0);
-  else _encoder->encodeInteger(encodedData, parameters->size());
-  if (parameters) {
-    for (Array::iterator i = parameters->begin(); i != parameters->end(); ++i) {
-      encodeVariable(encodedData, (*i));
-    }
-  }
-
-  uint32_t dataSize = encodedData.size() - 4 - headerSize;
-  char result[4];
-  memcpyBigEndian(result, (char *)&dataSize, 4);
-  encodedData.insert(encodedData.begin() + 4 + headerSize, result, result + 4);
+  VectorSink<std::vector<uint8_t>> sink(encodedData);
+  encodeRequestPacket(methodName, parameters.get(), sink, header);
 }
 
 void RpcEncoder::encodeResponse(std::shared_ptr<Variable> variable, std::vector<char> &encodedData) {
-  //The "Bin", the type byte after that and the length itself are not part of the length
   encodedData.clear();
-  if (!variable) variable.reset(new Variable(VariableType::tVoid));
-  if (variable->errorStruct) encodedData.insert(encodedData.begin(), _packetStartError, _packetStartError + 4);
-  else encodedData.insert(encodedData.begin(), _packetStartResponse, _packetStartResponse + 4);
-
-  encodeVariable(encodedData, variable);
-
-  uint32_t dataSize = encodedData.size() - 4;
-  char result[4];
-  memcpyBigEndian(result, (char *)&dataSize, 4);
-  encodedData.insert(encodedData.begin() + 4, result, result + 4);
+  VectorSink<std::vector<char>> sink(encodedData);
+  encodeResponse(variable, sink);
 }
 
 void RpcEncoder::encodeResponse(std::shared_ptr<Variable> variable, std::vector<uint8_t> &encodedData) {
-  //The "Bin", the type byte after that and the length itself are not part of the length
   encodedData.clear();
-  if (!variable) variable.reset(new Variable(VariableType::tVoid));
-  if (variable->errorStruct) encodedData.insert(encodedData.begin(), _packetStartError, _packetStartError + 4);
-  else encodedData.insert(encodedData.begin(), _packetStartResponse, _packetStartResponse + 4);
-
-  encodeVariable(encodedData, variable);
-
-  uint32_t dataSize = encodedData.size() - 4;
-  char result[4];
-  memcpyBigEndian(result, (char *)&dataSize, 4);
-  encodedData.insert(encodedData.begin() + 4, result, result + 4);
+  VectorSink<std::vector<uint8_t>> sink(encodedData);
+  encodeResponse(variable, sink);
 }
 
-void RpcEncoder::insertHeader(std::vector<char> &packet, const RpcHeader &header) {
-  std::vector<char> headerData;
-  uint32_t headerSize = encodeHeader(headerData, header);
-  if (headerSize > 0) {
-    packet.at(3) |= 0x40;
-    packet.insert(packet.begin() + 4, headerData.begin(), headerData.end());
-  }
+PPreparedPacket RpcEncoder::prepareRequest(const std::string &methodName, const PArray &parameterTemplate) {
+  auto packet = std::make_shared<PreparedPacket>();
+  packet->_isRequest = true;
+  packet->_methodName = methodName;
+  packet->_template = std::make_shared<Variable>(VariableType::tArray);
+  if (parameterTemplate) packet->_template->arrayValue = parameterTemplate;
+  packet->_slotCount = getEncoding(*packet)->slots.size();
+  return packet;
 }
 
-void RpcEncoder::insertHeader(std::vector<uint8_t> &packet, const RpcHeader &header) {
-  std::vector<uint8_t> headerData;
-  uint32_t headerSize = encodeHeader(headerData, header);
-  if (headerSize > 0) {
-    packet.at(3) |= 0x40;
-    packet.insert(packet.begin() + 4, headerData.begin(), headerData.end());
-  }
+PPreparedPacket RpcEncoder::prepareResponse(const PVariable &responseTemplate) {
+  auto packet = std::make_shared<PreparedPacket>();
+  packet->_template = responseTemplate ? responseTemplate : std::make_shared<Variable>(VariableType::tVoid);
+  packet->_slotCount = getEncoding(*packet)->slots.size();
+  return packet;
 }
 
-uint32_t RpcEncoder::encodeHeader(std::vector<char> &packet, const RpcHeader &header) {
-  uint32_t oldPacketSize = packet.size();
-  uint32_t parameterCount = 0;
-  if (!header.authorization.empty()) {
-    parameterCount++;
-    std::string temp("Authorization");
-    _encoder->encodeString(packet, temp);
-    std::string authorization = header.authorization;
-    _encoder->encodeString(packet, authorization);
-  } else return 0; //No header
-  char result[4];
-  memcpyBigEndian(result, (char *)&parameterCount, 4);
-  packet.insert(packet.begin() + oldPacketSize, result, result + 4);
-
-  uint32_t headerSize = packet.size() - oldPacketSize;
-  memcpyBigEndian(result, (char *)&headerSize, 4);
-  packet.insert(packet.begin() + oldPacketSize, result, result + 4);
-  return headerSize;
+void RpcEncoder::encodePrepared(const PreparedPacket &packet, const PArray &slotValues, std::vector<char> &encodedData) {
+  encodedData.clear();
+  VectorSink<std::vector<char>> sink(encodedData);
+  encodePrepared(packet, slotValues, sink);
 }
 
-uint32_t RpcEncoder::encodeHeader(std::vector<uint8_t> &packet, const RpcHeader &header) {
-  uint32_t oldPacketSize = packet.size();
-  uint32_t parameterCount = 0;
-  if (!header.authorization.empty()) {
-    parameterCount++;
-    std::string temp("Authorization");
-    _encoder->encodeString(packet, temp);
-    std::string authorization = header.authorization;
-    _encoder->encodeString(packet, authorization);
-  } else return 0; //No header
-  char result[4];
-  memcpyBigEndian(result, (char *)&parameterCount, 4);
-  packet.insert(packet.begin() + oldPacketSize, result, result + 4);
+void RpcEncoder::encodePrepared(const PreparedPacket &packet, const PArray &slotValues, std::vector<uint8_t> &encodedData) {
+  encodedData.clear();
+  VectorSink<std::vector<uint8_t>> sink(encodedData);
+  encodePrepared(packet, slotValues, sink);
+}
+
+std::shared_ptr<const PreparedPacket::Encoding> RpcEncoder::getEncoding(const PreparedPacket &packet) {
+  std::shared_ptr<const PreparedPacket::Encoding> encoding = std::atomic_load(&packet._encoding);
+  if (encoding && encoding->forceInteger64 == _forceInteger64 && encoding->encodeDouble == _encodeDouble) return encoding;
+
+  std::lock_guard<std::mutex> encodingGuard(packet._encodingMutex);
+  encoding = std::atomic_load(&packet._encoding);
+  if (encoding && encoding->forceInteger64 == _forceInteger64 && encoding->encodeDouble == _encodeDouble) return encoding;
+
+  std::shared_ptr<PreparedPacket::Encoding> newEncoding;
+  do {
+    newEncoding = std::make_shared<PreparedPacket::Encoding>();
+    newEncoding->forceInteger64 = _forceInteger64;
+    newEncoding->encodeDouble = _encodeDouble;
+    VectorSink<std::vector<char>> sink(newEncoding->data);
+    sink.append("Bin", 3);
+    if (packet._isRequest) sink.push_back(0);
+    else sink.push_back(packet._template->errorStruct ? (char)0xFF : (char)1);
+    _encoder->encodeInteger(sink, 0); //Length, set by encodePrepared()
+    if (packet._isRequest) {
+      _encoder->encodeString(sink, packet._methodName);
+      _encoder->encodeInteger(sink, packet._template->arrayValue->size());
+      for (auto &parameter : *packet._template->arrayValue) {
+        prepareVariable(newEncoding->data, newEncoding->slots, parameter);
+      }
+    } else {
+      PVariable responseTemplate = packet._template;
+      prepareVariable(newEncoding->data, newEncoding->slots, responseTemplate);
+    }
+  } while (newEncoding->encodeDouble != _encodeDouble); //Changed while encoding
 
-  uint32_t headerSize = packet.size() - oldPacketSize;
-  memcpyBigEndian(result, (char *)&headerSize, 4);
-  packet.insert(packet.begin() + oldPacketSize, result, result + 4);
-  return headerSize;
+  std::atomic_store(&packet._encoding, std::shared_ptr<const PreparedPacket::Encoding>(newEncoding));
+  return newEncoding;
 }
 
-void RpcEncoder::encodeVariable(std::vector<char> &packet, std::shared_ptr<Variable> &variable) {
+void RpcEncoder::prepareVariable(std::vector<char> &data, std::vector<uint32_t> &slots, PVariable &variable) {
+  VectorSink<std::vector<char>> sink(data);
   if (!variable) variable.reset(new Variable(VariableType::tVoid));
-  if (variable->type == VariableType::tVoid) {
-    encodeVoid(packet);
-  } else if (variable->type == VariableType::tInteger) {
-    if (_forceInteger64) {
-      variable->integerValue64 = variable->integerValue;
-      encodeInteger64(packet, variable);
-    } else encodeInteger(packet, variable);
-  } else if (variable->type == VariableType::tInteger64) {
-    encodeInteger64(packet, variable);
-  } else if (variable->type == VariableType::tFloat) {
-    encodeFloat(packet, variable);
-  } else if (variable->type == VariableType::tBoolean) {
-    encodeBoolean(packet, variable);
-  } else if (variable->type == VariableType::tString) {
-    encodeString(packet, variable);
-  } else if (variable->type == VariableType::tBase64) {
-    encodeBase64(packet, variable);
-  } else if (variable->type == VariableType::tBinary) {
-    encodeBinary(packet, variable);
+  if (variable->type == VariableType::tVariant) {
+    slots.push_back(data.size());
   } else if (variable->type == VariableType::tStruct) {
-    encodeStruct(packet, variable);
-  } else if (variable->type == VariableType::tArray) {
-    encodeArray(packet, variable);
-  }
-}
-
-void RpcEncoder::encodeVariable(std::vector<uint8_t> &packet, std::shared_ptr<Variable> &variable) {
-  if (!variable) variable.reset(new Variable(VariableType::tVoid));
-  if (variable->type == VariableType::tVoid) {
-    encodeVoid(packet);
-  } else if (variable->type == VariableType::tInteger) {
-    if (_forceInteger64) {
-      variable->integerValue64 = variable->integerValue;
-      encodeInteger64(packet, variable);
-    } else encodeInteger(packet, variable);
-  } else if (variable->type == VariableType::tInteger64) {
-    encodeInteger64(packet, variable);
-  } else if (variable->type == VariableType::tFloat) {
-    encodeFloat(packet, variable);
-  } else if (variable->type == VariableType::tBoolean) {
-    encodeBoolean(packet, variable);
-  } else if (variable->type == VariableType::tString) {
-    encodeString(packet, variable);
-  } else if (variable->type == VariableType::tBase64) {
-    encodeBase64(packet, variable);
-  } else if (variable->type == VariableType::tBinary) {
-    encodeBinary(packet, variable);
-  } else if (variable->type == VariableType::tStruct) {
-    encodeStruct(packet, variable);
+    encodeType(sink, VariableType::tStruct);
+    _encoder->encodeInteger(sink, variable->structValue->size());
+    for (Struct::iterator i = variable->structValue->begin(); i != variable->structValue->end(); ++i) {
+      _encoder->encodeString(sink, i->first.empty() ? std::string("UNDEFINED") : i->first);
+      prepareVariable(data, slots, i->second);
+    }
   } else if (variable->type == VariableType::tArray) {
-    encodeArray(packet, variable);
-  }
-}
-
-void RpcEncoder::encodeStruct(std::vector<char> &packet, std::shared_ptr<Variable> &variable) {
-  encodeType(packet, VariableType::tStruct);
-  _encoder->encodeInteger(packet, variable->structValue->size());
-  for (Struct::iterator i = variable->structValue->begin(); i != variable->structValue->end(); ++i) {
-    std::string name = i->first.empty() ? "UNDEFINED" : i->first;
-    _encoder->encodeString(packet, name);
-    if (!i->second) i->second.reset(new Variable(VariableType::tVoid));
-    encodeVariable(packet, i->second);
-  }
-}
-
-void RpcEncoder::encodeStruct(std::vector<uint8_t> &packet, std::shared_ptr<Variable> &variable) {
-  encodeType(packet, VariableType::tStruct);
-  _encoder->encodeInteger(packet, variable->structValue->size());
-  for (Struct::iterator i = variable->structValue->begin(); i != variable->structValue->end(); ++i) {
-    std::string name = i->first.empty() ? "UNDEFINED" : i->first;
-    _encoder->encodeString(packet, name);
-    if (!i->second) i->second.reset(new Variable(VariableType::tVoid));
-    encodeVariable(packet, i->second);
-  }
-}
-
-void RpcEncoder::encodeArray(std::vector<char> &packet, std::shared_ptr<Variable> &variable) {
-  encodeType(packet, VariableType::tArray);
-  _encoder->encodeInteger(packet, variable->arrayValue->size());
-  for (std::vector<std::shared_ptr<Variable>>::iterator i = variable->arrayValue->begin(); i != variable->arrayValue->end(); ++i) {
-    encodeVariable(packet, *i);
-  }
-}
-
-void RpcEncoder::encodeArray(std::vector<uint8_t> &packet, std::shared_ptr<Variable> &variable) {
-  encodeType(packet, VariableType::tArray);
-  _encoder->encodeInteger(packet, variable->arrayValue->size());
-  for (std::vector<std::shared_ptr<Variable>>::iterator i = variable->arrayValue->begin(); i != variable->arrayValue->end(); ++i) {
-    encodeVariable(packet, *i);
-  }
-}
-
-void RpcEncoder::encodeType(std::vector<char> &packet, VariableType type) {
-  _encoder->encodeInteger(packet, (int32_t)type);
-}
-
-void RpcEncoder::encodeType(std::vector<uint8_t> &packet, VariableType type) {
-  _encoder->encodeInteger(packet, (int32_t)type);
-}
-
-void RpcEncoder::encodeInteger(std::vector<char> &packet, std::shared_ptr<Variable> &variable) {
-  encodeType(packet, VariableType::tInteger);
-  _encoder->encodeInteger(packet, variable->integerValue);
-}
-
-void RpcEncoder::encodeInteger(std::vector<uint8_t> &packet, std::shared_ptr<Variable> &variable) {
-  encodeType(packet, VariableType::tInteger);
-  _encoder->encodeInteger(packet, variable->integerValue);
-}
-
-void RpcEncoder::encodeInteger64(std::vector<char> &packet, std::shared_ptr<Variable> &variable) {
-  encodeType(packet, VariableType::tInteger64);
-  _encoder->encodeInteger64(packet, variable->integerValue64);
-}
-
-void RpcEncoder::encodeInteger64(std::vector<uint8_t> &packet, std::shared_ptr<Variable> &variable) {
-  encodeType(packet, VariableType::tInteger64);
-  _encoder->encodeInteger64(packet, variable->integerValue64);
-}
-
-void RpcEncoder::encodeFloat(std::vector<char> &packet, std::shared_ptr<Variable> &variable) {
-  encodeType(packet, VariableType::tFloat);
-  _encoder->encodeFloat(packet, variable->floatValue);
-}
-
-void RpcEncoder::encodeFloat(std::vector<uint8_t> &packet, std::shared_ptr<Variable> &variable) {
-  encodeType(packet, VariableType::tFloat);
-  _encoder->encodeFloat(packet, variable->floatValue);
-}
-
-void RpcEncoder::encodeBoolean(std::vector<char> &packet, std::shared_ptr<Variable> &variable) {
-  encodeType(packet, VariableType::tBoolean);
-  _encoder->encodeBoolean(packet, variable->booleanValue);
-}
-
-void RpcEncoder::encodeBoolean(std::vector<uint8_t> &packet, std::shared_ptr<Variable> &variable) {
-  encodeType(packet, VariableType::tBoolean);
-  _encoder->encodeBoolean(packet, variable->booleanValue);
-}
-
-void RpcEncoder::encodeString(std::vector<char> &packet, std::shared_ptr<Variable> &variable) {
-  encodeType(packet, VariableType::tString);
-  //We could call encodeRawString here, but then the string would have to be copied and that would cost time.
-  _encoder->encodeInteger(packet, variable->stringValue.size());
-  if (variable->stringValue.size() > 0) {
-    packet.insert(packet.end(), variable->stringValue.begin(), variable->stringValue.end());
-  }
-}
-
-void RpcEncoder::encodeString(std::vector<uint8_t> &packet, std::shared_ptr<Variable> &variable) {
-  encodeType(packet, VariableType::tString);
-  //We could call encodeRawString here, but then the string would have to be copied and that would cost time.
-  _encoder->encodeInteger(packet, variable->stringValue.size());
-  if (variable->stringValue.size() > 0) {
-    packet.insert(packet.end(), variable->stringValue.begin(), variable->stringValue.end());
-  }
-}
-
-void RpcEncoder::encodeBase64(std::vector<char> &packet, std::shared_ptr<Variable> &variable) {
-  encodeType(packet, VariableType::tBase64);
-  //We could call encodeRawString here, but then the string would have to be copied and that would cost time.
-  _encoder->encodeInteger(packet, variable->stringValue.size());
-  if (variable->stringValue.size() > 0) {
-    packet.insert(packet.end(), variable->stringValue.begin(), variable->stringValue.end());
-  }
-}
-
-void RpcEncoder::encodeBase64(std::vector<uint8_t> &packet, std::shared_ptr<Variable> &variable) {
-  encodeType(packet, VariableType::tBase64);
-  //We could call encodeRawString here, but then the string would have to be copied and that would cost time.
-  _encoder->encodeInteger(packet, variable->stringValue.size());
-  if (variable->stringValue.size() > 0) {
-    packet.insert(packet.end(), variable->stringValue.begin(), variable->stringValue.end());
-  }
+    encodeType(sink, VariableType::tArray);
+    _encoder->encodeInteger(sink, variable->arrayValue->size());
+    for (auto &element : *variable->arrayValue) {
+      prepareVariable(data, slots, element);
+    }
+  } else encodeVariable(sink, variable);
 }
 
-void RpcEncoder::encodeBinary(std::vector<char> &packet, std::shared_ptr<Variable> &variable) {
-  encodeType(packet, VariableType::tBinary);
-  _encoder->encodeInteger(packet, variable->binaryValue.size());
-  if (variable->binaryValue.size() > 0) {
-    packet.insert(packet.end(), variable->binaryValue.begin(), variable->binaryValue.end());
+void RpcEncoder::insertHeader(std::vector<char> &packet, const RpcHeader &header) {
+  uint32_t headerSize = getHeaderSize(header);
+  if (headerSize > 0) {
+    packet.at(3) |= 0x40;
+    size_t oldPacketSize = packet.size();
+    packet.resize(oldPacketSize + headerSize);
+    std::move_backward(packet.begin() + 4, packet.begin() + oldPacketSize, packet.end());
+    writeHeaderPrefix((char *)packet.data() + 4, header, headerSize);
+    memcpy((char *)packet.data() + 4 + 29, header.authorization.data(), header.authorization.size());
   }
 }
 
-void RpcEncoder::encodeBinary(std::vector<uint8_t> &packet, std::shared_ptr<Variable> &variable) {
-  encodeType(packet, VariableType::tBinary);
-  _encoder->encodeInteger(packet, variable->binaryValue.size());
-  if (variable->binaryValue.size() > 0) {
-    packet.insert(packet.end(), variable->binaryValue.begin(), variable->binaryValue.end());
+void RpcEncoder::insertHeader(std::vector<uint8_t> &packet, const RpcHeader &header) {
+  uint32_t headerSize = getHeaderSize(header);
+  if (headerSize > 0) {
+    packet.at(3) |= 0x40;
+    size_t oldPacketSize = packet.size();
+    packet.resize(oldPacketSize + headerSize);
+    std::move_backward(packet.begin() + 4, packet.begin() + oldPacketSize, packet.end());
+    writeHeaderPrefix((char *)packet.data() + 4, header, headerSize);
+    memcpy((char *)packet.data() + 4 + 29, header.authorization.data(), header.authorization.size());
+  }
+}
+
+uint32_t RpcEncoder::getHeaderSize(const RpcHeader &header) {
+  if (header.authorization.empty()) return 0;
+  //Header size, parameter count, "Authorization" and the value
+  return 4 + 4 + 4 + 13 + 4 + header.authorization.size();
+}
+
+void RpcEncoder::writeHeaderPrefix(char *buffer, const RpcHeader &header, uint32_t headerSize) {
+  Endianness::writeBigEndian32(buffer, headerSize - 4);
+  Endianness::writeBigEndian32(buffer + 4, 1); //Parameter count
+  Endianness::writeBigEndian32(buffer + 8, 13);
+  memcpy(buffer + 12, "Authorization", 13);
+  Endianness::writeBigEndian32(buffer + 25, header.authorization.size());
+}
+
+size_t RpcEncoder::getVariableSize(const std::shared_ptr<Variable> &variable) {
+  if (!variable) return 4; //Encoded as void
+  switch (variable->type) {
+    case VariableType::tVoid: return 4;
+    case VariableType::tInteger: return _forceInteger64 ? 12 : 8;
+    case VariableType::tInteger64: return 12;
+    case VariableType::tFloat: return 12;
+    case VariableType::tDouble: return 12;
+    case VariableType::tBoolean: return 5;
+    case VariableType::tString: return 8 + variable->stringValue.size();
+    case VariableType::tBase64: return 8 + variable->stringValue.size();
+    case VariableType::tBinary: return 8 + variable->binaryValue.size();
+    case VariableType::tStruct: {
+      size_t size = 8;
+      for (auto &element : *variable->structValue) {
+        size += 4 + (element.first.empty() ? 9 : element.first.size()) + getVariableSize(element.second);
+      }
+      return size;
+    }
+    case VariableType::tArray: {
+      size_t size = 8;
+      for (auto &element : *variable->arrayValue) {
+        size += getVariableSize(element);
+      }
+      return size;
+    }
+    case VariableType::tVariant: return 0;
   }
-}
-
-void RpcEncoder::encodeVoid(std::vector<char> &packet) {
-  encodeType(packet, VariableType::tVoid);
-}
-
-void RpcEncoder::encodeVoid(std::vector<uint8_t> &packet) {
-  encodeType(packet, VariableType::tVoid);
+  return 0;
 }
 
 }
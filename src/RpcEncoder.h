@@ -34,13 +34,26 @@
 #include "RpcHeader.h"
 #include "Variable.h"
 #include "BinaryEncoder.h"
+#include "ByteSink.h"
+#include "PreparedPacket.h"
+#include "IpcException.h"
 
 #include <memory>
 #include <cstring>
 #include <list>
+#include <atomic>
+#include <algorithm>
+#include <tuple>
 
 namespace Ipc {
 
+class RpcTraitsBase;
+
+class RpcEncoderException : public IpcException {
+ public:
+  explicit RpcEncoderException(const std::string &message) : IpcException(message) {}
+};
+
 class RpcEncoder {
  public:
   RpcEncoder();
@@ -55,58 +68,279 @@ class RpcEncoder {
   virtual void encodeRequest(std::string methodName, PArray parameters, std::vector<uint8_t> &encodedData, std::shared_ptr<RpcHeader> header = nullptr);
   virtual void encodeResponse(std::shared_ptr<Variable> variable, std::vector<char> &encodedData);
   virtual void encodeResponse(std::shared_ptr<Variable> variable, std::vector<uint8_t> &encodedData);
+
+  /**
+   * Encodes a request and appends it to "sink" (see ByteSink.h). Contrary to the vector versions, the sink is not
+   * cleared. The exact packet size is reserved before anything is written, so a BufferSink or IovecSink that is too
+   * small throws before any byte is written.
+   */
+  template<typename Sink>
+  void encodeRequest(const std::string &methodName, const PArray &parameters, Sink &sink, const std::shared_ptr<RpcHeader> &header = nullptr) {
+    encodeRequestPacket(methodName, parameters.get(), sink, header);
+  }
+
+  /**
+   * Encodes a response and appends it to "sink" (see ByteSink.h). Contrary to the vector versions, the sink is not
+   * cleared.
+   */
+  template<typename Sink>
+  void encodeResponse(const std::shared_ptr<Variable> &variable, Sink &sink) {
+    //The "Bin", the type byte after that and the length itself are not part of the length
+    std::shared_ptr<Variable> response = variable ? variable : std::make_shared<Variable>(VariableType::tVoid);
+    size_t dataSize = getVariableSize(response);
+    sink.reserve(8 + dataSize);
+    sink.append("Bin", 3);
+    sink.push_back(response->errorStruct ? (char)0xFF : (char)1);
+    _encoder->encodeInteger(sink, (int32_t)dataSize);
+    encodeVariable(sink, response);
+  }
+
+  /**
+   * Pre-encodes a request to "methodName". Placeholders (Variable::createPlaceholder()) are filled by
+   * encodePrepared() (see PreparedPacket). Headers are not supported.
+   */
+  PPreparedPacket prepareRequest(const std::string &methodName, const PArray &parameterTemplate);
+
+  /**
+   * Pre-encodes a response. Placeholders (Variable::createPlaceholder()) are filled by encodePrepared() (see
+   * PreparedPacket).
+   */
+  PPreparedPacket prepareResponse(const PVariable &responseTemplate);
+
+  /**
+   * Encodes a prepared request or response. Only the slot values are encoded, the rest is copied.
+   *
+   * @param packet The packet returned by prepareRequest() or prepareResponse().
+   * @param slotValues One value per slot in the order the slots appear in the template. nullptr is the same as an empty array.
+   * @param[out] encodedData The encoded packet. The vector is cleared first.
+   * @throws RpcEncoderException When the number of values doesn't match the number of slots.
+   */
+  void encodePrepared(const PreparedPacket &packet, const PArray &slotValues, std::vector<char> &encodedData);
+  void encodePrepared(const PreparedPacket &packet, const PArray &slotValues, std::vector<uint8_t> &encodedData);
+
+  /**
+   * Sink version of encodePrepared(). The sink is not cleared.
+   */
+  template<typename Sink>
+  void encodePrepared(const PreparedPacket &packet, const PArray &slotValues, Sink &sink) {
+    std::shared_ptr<const PreparedPacket::Encoding> encoding = getEncoding(packet);
+    size_t slotValueCount = slotValues ? slotValues->size() : 0;
+    if (slotValueCount != encoding->slots.size()) {
+      throw RpcEncoderException("Wrong number of slot values (expected " + std::to_string(encoding->slots.size()) + ", got " + std::to_string(slotValueCount) + ").");
+    }
+    //The "Bin", the type byte after that and the length itself are not part of the length
+    size_t dataSize = encoding->data.size() - 8;
+    for (size_t i = 0; i < slotValueCount; i++) {
+      dataSize += getVariableSize(slotValues->at(i));
+    }
+    sink.reserve(8 + dataSize);
+    sink.append(encoding->data.data(), 4);
+    _encoder->encodeInteger(sink, (int32_t)dataSize);
+    size_t position = 8;
+    for (size_t i = 0; i < slotValueCount; i++) {
+      sink.append(encoding->data.data() + position, encoding->slots[i] - position);
+      position = encoding->slots[i];
+      encodeVariable(sink, slotValues->at(i));
+    }
+    sink.append(encoding->data.data() + position, encoding->data.size() - position);
+  }
+
+  /**
+   * Encodes a request without creating Variables. The elements of "parameters" are the parameters of the request and are
+   * encoded using RpcTraits. The packet is appended to "sink" (see ByteSink.h). Defined in RpcTraits.h, include it to
+   * use this method.
+   */
+  template<typename Sink, typename... Parameters>
+  void encodeTypedRequest(const std::string &methodName, const std::tuple<Parameters...> &parameters, Sink &sink);
+
+  /**
+   * Encodes "value" as response using RpcTraits and appends the packet to "sink". Defined in RpcTraits.h.
+   */
+  template<typename T, typename Sink>
+  void encodeTypedResponse(const T &value, Sink &sink);
+
+  /**
+   * Encodes floats as raw IEEE 754 doubles (VariableType::tDouble) instead of the lossy mantissa/exponent format. Only enable this when the other side understands tDouble.
+   */
+  void setEncodeDouble(bool value) { _encodeDouble = value; }
+  bool getEncodeDouble() { return _encodeDouble; }
  private:
+  friend class RpcTraitsBase;
+
   bool _forceInteger64 = false;
+  std::atomic_bool _encodeDouble{false};
   std::unique_ptr<BinaryEncoder> _encoder;
-  char _packetStartRequest[4];
-  char _packetStartResponse[5];
-  char _packetStartError[5];
 
   /**
-   * The result of checkEndianness() is stored in this variable. This is done through calling "init".
+   * Returns the size of the encoded header including its length field or "0" when there is no header to encode.
    */
-  bool _isBigEndian = true;
+  uint32_t getHeaderSize(const RpcHeader &header);
 
   /**
-   * Checks if the system is little or big endian.
+   * Writes everything of the header except the authorization value to "buffer", which needs to be at least 29 bytes
+   * large. The authorization value follows directly after that.
    */
-  void checkEndianness();
+  void writeHeaderPrefix(char *buffer, const RpcHeader &header, uint32_t headerSize);
 
   /**
-   * Copies binary values from one memory location to another reversing the byte order when the system is little endian.
-   *
-   * @param[out] to The destination array. No memory is allocated, so make sure, the array is large enough.
-   * @param[in] from The source array.
-   * @param length The number of bytes to copy.
+   * Returns the exact number of bytes encodeVariable() produces for "variable", so the packet can be allocated once.
+   */
+  size_t getVariableSize(const std::shared_ptr<Variable> &variable);
+
+  /**
+   * Returns the encoding of "packet" matching the current settings of this encoder. The encoding is created when the
+   * packet is used for the first time or when the settings changed since then.
+   */
+  std::shared_ptr<const PreparedPacket::Encoding> getEncoding(const PreparedPacket &packet);
+
+  /**
+   * Appends "variable" to "data" like encodeVariable(), but only records the position of placeholders
+   * (VariableType::tVariant) in "slots".
+   */
+  void prepareVariable(std::vector<char> &data, std::vector<uint32_t> &slots, PVariable &variable);
+
+  /**
+   * Encodes a request with the parameters in "parameters", which is either an Array or a std::list of variables.
+   * "parameters" may be nullptr.
    */
-  void memcpyBigEndian(char *to, const char *from, const uint32_t &length);
-
-  uint32_t encodeHeader(std::vector<char> &packet, const RpcHeader &header);
-  uint32_t encodeHeader(std::vector<uint8_t> &packet, const RpcHeader &header);
-  void encodeVariable(std::vector<char> &packet, std::shared_ptr<Variable> &variable);
-  void encodeVariable(std::vector<uint8_t> &packet, std::shared_ptr<Variable> &variable);
-  void encodeInteger(std::vector<char> &packet, std::shared_ptr<Variable> &variable);
-  void encodeInteger(std::vector<uint8_t> &packet, std::shared_ptr<Variable> &variable);
-  void encodeInteger64(std::vector<char> &packet, std::shared_ptr<Variable> &variable);
-  void encodeInteger64(std::vector<uint8_t> &packet, std::shared_ptr<Variable> &variable);
-  void encodeFloat(std::vector<char> &packet, std::shared_ptr<Variable> &variable);
-  void encodeFloat(std::vector<uint8_t> &packet, std::shared_ptr<Variable> &variable);
-  void encodeBoolean(std::vector<char> &packet, std::shared_ptr<Variable> &variable);
-  void encodeBoolean(std::vector<uint8_t> &packet, std::shared_ptr<Variable> &variable);
-  void encodeType(std::vector<char> &packet, VariableType type);
-  void encodeType(std::vector<uint8_t> &packet, VariableType type);
-  void encodeString(std::vector<char> &packet, std::shared_ptr<Variable> &variable);
-  void encodeString(std::vector<uint8_t> &packet, std::shared_ptr<Variable> &variable);
-  void encodeBase64(std::vector<char> &packet, std::shared_ptr<Variable> &variable);
-  void encodeBase64(std::vector<uint8_t> &packet, std::shared_ptr<Variable> &variable);
-  void encodeBinary(std::vector<char> &packet, std::shared_ptr<Variable> &variable);
-  void encodeBinary(std::vector<uint8_t> &packet, std::shared_ptr<Variable> &variable);
-  void encodeVoid(std::vector<char> &packet);
-  void encodeVoid(std::vector<uint8_t> &packet);
-  void encodeStruct(std::vector<char> &packet, std::shared_ptr<Variable> &variable);
-  void encodeStruct(std::vector<uint8_t> &packet, std::shared_ptr<Variable> &variable);
-  void encodeArray(std::vector<char> &packet, std::shared_ptr<Variable> &variable);
-  void encodeArray(std::vector<uint8_t> &packet, std::shared_ptr<Variable> &variable);
+  template<typename Sink, typename Parameters>
+  void encodeRequestPacket(const std::string &methodName, Parameters *parameters, Sink &sink, const std::shared_ptr<RpcHeader> &header) {
+    //The "Bin", the type byte after that and the length itself are not part of the length
+    uint32_t headerSize = header ? getHeaderSize(*header) : 0;
+    size_t dataSize = 4 + methodName.size() + 4;
+    if (parameters) {
+      for (auto &parameter : *parameters) {
+        dataSize += getVariableSize(parameter);
+      }
+    }
+    sink.reserve(4 + headerSize + 4 + dataSize);
+    sink.append("Bin", 3);
+    sink.push_back(headerSize > 0 ? (char)0x40 : (char)0);
+    if (headerSize > 0) encodeHeader(sink, *header, headerSize);
+    _encoder->encodeInteger(sink, (int32_t)dataSize);
+    _encoder->encodeString(sink, methodName);
+    _encoder->encodeInteger(sink, parameters ? (int32_t)parameters->size() : 0);
+    if (parameters) {
+      for (auto &parameter : *parameters) {
+        encodeVariable(sink, parameter);
+      }
+    }
+  }
+
+  template<typename Sink>
+  void encodeHeader(Sink &sink, const RpcHeader &header, uint32_t headerSize) {
+    char prefix[29];
+    writeHeaderPrefix(prefix, header, headerSize);
+    sink.append(prefix, sizeof(prefix));
+    sink.append(header.authorization.data(), header.authorization.size());
+  }
+
+  template<typename Sink>
+  void encodeVariable(Sink &sink, std::shared_ptr<Variable> &variable) {
+    if (!variable) variable.reset(new Variable(VariableType::tVoid));
+    if (variable->type == VariableType::tVoid) {
+      encodeVoid(sink);
+    } else if (variable->type == VariableType::tInteger) {
+      if (_forceInteger64) {
+        variable->integerValue64 = variable->integerValue;
+        encodeInteger64(sink, variable);
+      } else encodeInteger(sink, variable);
+    } else if (variable->type == VariableType::tInteger64) {
+      encodeInteger64(sink, variable);
+    } else if (variable->type == VariableType::tFloat || variable->type == VariableType::tDouble) {
+      encodeFloat(sink, variable);
+    } else if (variable->type == VariableType::tBoolean) {
+      encodeBoolean(sink, variable);
+    } else if (variable->type == VariableType::tString) {
+      encodeString(sink, variable);
+    } else if (variable->type == VariableType::tBase64) {
+      encodeBase64(sink, variable);
+    } else if (variable->type == VariableType::tBinary) {
+      encodeBinary(sink, variable);
+    } else if (variable->type == VariableType::tStruct) {
+      encodeStruct(sink, variable);
+    } else if (variable->type == VariableType::tArray) {
+      encodeArray(sink, variable);
+    }
+  }
+
+  template<typename Sink>
+  void encodeInteger(Sink &sink, std::shared_ptr<Variable> &variable) {
+    encodeType(sink, VariableType::tInteger);
+    _encoder->encodeInteger(sink, variable->integerValue);
+  }
+
+  template<typename Sink>
+  void encodeInteger64(Sink &sink, std::shared_ptr<Variable> &variable) {
+    encodeType(sink, VariableType::tInteger64);
+    _encoder->encodeInteger64(sink, variable->integerValue64);
+  }
+
+  template<typename Sink>
+  void encodeFloat(Sink &sink, std::shared_ptr<Variable> &variable) {
+    if (_encodeDouble) {
+      encodeType(sink, VariableType::tDouble);
+      _encoder->encodeDouble(sink, variable->floatValue);
+    } else {
+      encodeType(sink, VariableType::tFloat);
+      _encoder->encodeFloat(sink, variable->floatValue);
+    }
+  }
+
+  template<typename Sink>
+  void encodeBoolean(Sink &sink, std::shared_ptr<Variable> &variable) {
+    encodeType(sink, VariableType::tBoolean);
+    _encoder->encodeBoolean(sink, variable->booleanValue);
+  }
+
+  template<typename Sink>
+  void encodeType(Sink &sink, VariableType type) {
+    _encoder->encodeInteger(sink, (int32_t)type);
+  }
+
+  template<typename Sink>
+  void encodeString(Sink &sink, std::shared_ptr<Variable> &variable) {
+    encodeType(sink, VariableType::tString);
+    _encoder->encodeString(sink, variable->stringValue);
+  }
+
+  template<typename Sink>
+  void encodeBase64(Sink &sink, std::shared_ptr<Variable> &variable) {
+    encodeType(sink, VariableType::tBase64);
+    _encoder->encodeString(sink, variable->stringValue);
+  }
+
+  template<typename Sink>
+  void encodeBinary(Sink &sink, std::shared_ptr<Variable> &variable) {
+    encodeType(sink, VariableType::tBinary);
+    _encoder->encodeBinary(sink, variable->binaryValue);
+  }
+
+  template<typename Sink>
+  void encodeVoid(Sink &sink) {
+    encodeType(sink, VariableType::tVoid);
+  }
+
+  template<typename Sink>
+  void encodeStruct(Sink &sink, std::shared_ptr<Variable> &variable) {
+    static const std::string undefined = "UNDEFINED";
+    encodeType(sink, VariableType::tStruct);
+    _encoder->encodeInteger(sink, variable->structValue->size());
+    for (Struct::iterator i = variable->structValue->begin(); i != variable->structValue->end(); ++i) {
+      _encoder->encodeString(sink, i->first.empty() ? undefined : i->first);
+      if (!i->second) i->second.reset(new Variable(VariableType::tVoid));
+      encodeVariable(sink, i->second);
+    }
+  }
+
+  template<typename Sink>
+  void encodeArray(Sink &sink, std::shared_ptr<Variable> &variable) {
+    encodeType(sink, VariableType::tArray);
+    _encoder->encodeInteger(sink, variable->arrayValue->size());
+    for (std::vector<std::shared_ptr<Variable>>::iterator i = variable->arrayValue->begin(); i != variable->arrayValue->end(); ++i) {
+      encodeVariable(sink, *i);
+    }
+  }
 };
 
 }
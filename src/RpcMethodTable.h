@@ -0,0 +1,183 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * libhomegear-base is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * libhomegear-base is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libhomegear-base.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#ifndef IPCRPCMETHODTABLE_H_
+#define IPCRPCMETHODTABLE_H_
+
+#include "HazardPointers.h"
+
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace Ipc {
+
+/**
+ * Hash table mapping RPC method names to handlers. Lookups are lock free and can run while methods are registered:
+ * A published table is never modified. Registering a method creates a copy with the new entry and publishes it
+ * atomically (RCU style). find() copies the handler out of the table, protecting the table with the thread's hazard
+ * pointer (see HazardPointers) only while copying, so readers don't write to memory shared with other readers. Replaced
+ * tables are freed by the next registration or the destructor once no hazard pointer references them. This is meant
+ * for the few registrations done at startup, each one copies the table.
+ */
+template<typename Handler>
+class RpcMethodTable {
+ public:
+  struct Entry {
+    uint64_t hash = 0;
+    std::string name;
+    Handler handler;
+  };
+
+  RpcMethodTable() {
+    _currentTable.reset(new Table(16));
+    _table.store(_currentTable.get());
+  }
+
+  RpcMethodTable(const RpcMethodTable &) = delete;
+  RpcMethodTable &operator=(const RpcMethodTable &) = delete;
+
+  /**
+   * Calculates the 64 bit FNV-1a hash of "name".
+   */
+  static uint64_t hash(const char *name, size_t size) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < size; i++) {
+      hash ^= (uint8_t)name[i];
+      hash *= 1099511628211ULL;
+    }
+    return hash;
+  }
+
+  /**
+   * Adds "handler" or replaces the handler of an existing method with the same name. Empty names are ignored.
+   */
+  void insert(const std::string &name, const Handler &handler) {
+    if (name.empty()) return;
+    std::lock_guard<std::mutex> writeGuard(_writeMutex);
+    const Table *current = _table.load(std::memory_order_relaxed);
+    //Keep the load factor at 50% or below, so probe sequences stay short.
+    size_t capacity = current->entries.size();
+    if ((current->count + 1) * 2 > capacity) capacity *= 2;
+    std::unique_ptr<Table> table(new Table(capacity));
+    for (auto &entry : current->entries) {
+      if (!entry.name.empty() && entry.name != name) table->insert(entry);
+    }
+    Entry entry;
+    entry.hash = hash(name.data(), name.size());
+    entry.name = name;
+    entry.handler = handler;
+    table->insert(entry);
+    _table.store(table.get());
+    _retiredTables.push_back(std::move(_currentTable));
+    _currentTable = std::move(table);
+    reclaim();
+  }
+
+  /**
+   * Copies the handler of method "name" to "handler". "hash" is the result of hash().
+   *
+   * @return Returns false when the method is unknown.
+   */
+  bool find(const char *name, size_t size, uint64_t hash, Handler &handler) const {
+    HazardPointerGuard hazardPointer;
+    const Table *table = _table.load();
+    while (true) {
+      //Sequentially consistent, so insert() either sees the hazard pointer or the reader sees the new table.
+      hazardPointer.slot.store(table);
+      const Table *current = _table.load();
+      if (current == table) break;
+      table = current;
+    }
+    for (size_t i = hash & table->mask;; i = (i + 1) & table->mask) {
+      const Entry &entry = table->entries[i];
+      if (entry.name.empty()) return false;
+      if (entry.hash == hash && entry.name.size() == size && std::memcmp(entry.name.data(), name, size) == 0) {
+        handler = entry.handler;
+        return true;
+      }
+    }
+  }
+
+  bool find(const char *name, size_t size, Handler &handler) const {
+    return find(name, size, hash(name, size), handler);
+  }
+
+  bool find(const std::string &name, Handler &handler) const {
+    return find(name.data(), name.size(), hash(name.data(), name.size()), handler);
+  }
+ private:
+  struct Table {
+    std::vector<Entry> entries;
+    size_t mask = 0;
+    size_t count = 0;
+
+    //"capacity" needs to be a power of two.
+    explicit Table(size_t capacity) : entries(capacity), mask(capacity - 1) {}
+
+    void insert(const Entry &entry) {
+      size_t i = entry.hash & mask;
+      while (!entries[i].name.empty()) i = (i + 1) & mask;
+      entries[i] = entry;
+      count++;
+    }
+  };
+
+  /**
+   * Clears the hazard pointer of the calling thread when find() returns, also when copying the handler throws.
+   */
+  struct HazardPointerGuard {
+    std::atomic<const void *> &slot = HazardPointers::slot();
+
+    ~HazardPointerGuard() { slot.store(nullptr, std::memory_order_release); }
+  };
+
+  std::atomic<const Table *> _table{nullptr};
+  mutable std::mutex _writeMutex;
+  std::unique_ptr<Table> _currentTable;
+  std::vector<std::unique_ptr<Table>> _retiredTables; //Tables replaced by insert() that readers might still use.
+
+  /**
+   * Frees the replaced tables no reader uses anymore. Readers starting afterwards get the current table. Must be
+   * called with _writeMutex locked.
+   */
+  void reclaim() {
+    for (auto i = _retiredTables.begin(); i != _retiredTables.end();) {
+      if (HazardPointers::isProtected(i->get())) ++i;
+      else i = _retiredTables.erase(i);
+    }
+  }
+};
+
+}
+#endif
@@ -0,0 +1,886 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * libhomegear-base is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * libhomegear-base is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libhomegear-base.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#ifndef IPCRPCTRAITS_H_
+#define IPCRPCTRAITS_H_
+
+#include "RpcEncoder.h"
+#include "RpcDecoder.h"
+#include "JsonEncoder.h"
+#include "Math.h"
+
+#include <cstring>
+#include <map>
+#include <unordered_map>
+#include <tuple>
+#include <type_traits>
+
+namespace Ipc {
+
+/**
+ * Maps the C++ type "T" to the binary RPC and JSON formats, so values can be encoded and decoded without creating
+ * Variables. There are specializations for bool, the integer types, float, double, std::string, std::vector<uint8_t>
+ * (VariableType::tBinary), std::vector<T> (arrays), std::map<std::string, T> and std::unordered_map<std::string, T>
+ * (structs), std::tuple (arrays with elements of different types), PVariable and PArray. Structs are added with
+ * RpcStructTraits. Every specialization provides:
+ *
+ *   //Returns the size of the encoded value including its type.
+ *   static size_t size(RpcEncoder &encoder, const T &value);
+ *   template<typename Sink> static void encode(RpcEncoder &encoder, Sink &sink, const T &value);
+ *   static void decode(RpcDecoder &decoder, const ByteSpan &data, uint32_t &position, T &value);
+ *   template<typename Sink> static void encodeJson(JsonEncoder &encoder, Sink &sink, const T &value);
+ *
+ * Decoding is as lenient as RpcDecoder: Numbers, booleans and strings are converted into each other the same way
+ * Variable does it. Values of any other type are skipped and leave the default value.
+ */
+template<typename T>
+struct RpcTraits;
+
+/**
+ * Helpers shared by the RpcTraits specializations. This class has access to the internals of RpcEncoder, RpcDecoder
+ * and JsonEncoder.
+ */
+class RpcTraitsBase {
+ public:
+  static bool forceInteger64(RpcEncoder &encoder) { return encoder._forceInteger64; }
+  static bool encodeDouble(RpcEncoder &encoder) { return encoder._encodeDouble; }
+  static BinaryEncoder &binaryEncoder(RpcEncoder &encoder) { return *encoder._encoder; }
+  static BinaryDecoder &binaryDecoder(RpcDecoder &decoder) { return *decoder._decoder; }
+
+  template<typename Sink>
+  static void encodeType(RpcEncoder &encoder, Sink &sink, VariableType type) {
+    encoder._encoder->encodeInteger(sink, (int32_t)type);
+  }
+
+  static size_t variableSize(RpcEncoder &encoder, const PVariable &variable) {
+    return encoder.getVariableSize(variable);
+  }
+
+  template<typename Sink>
+  static void encodeVariable(RpcEncoder &encoder, Sink &sink, const PVariable &variable) {
+    PVariable element = variable;
+    encoder.encodeVariable(sink, element);
+  }
+
+  static VariableType decodeType(RpcDecoder &decoder, const ByteSpan &data, uint32_t &position) {
+    return (VariableType)decoder._decoder->decodeInteger(data, position);
+  }
+
+  static PVariable decodeVariable(RpcDecoder &decoder, const ByteSpan &data, uint32_t &position) {
+    return decoder.decodeParameter(data, position);
+  }
+
+  /**
+   * Decodes a number, boolean, string or void value of type "type" and converts it like Variable does. Other types are
+   * skipped.
+   *
+   * @return Returns false when the value was skipped.
+   */
+  static bool decodeScalar(RpcDecoder &decoder, const ByteSpan &data, uint32_t &position, VariableType type, int64_t &integer, double &floatValue, bool &boolean) {
+    integer = 0;
+    floatValue = 0;
+    boolean = false;
+    switch (type) {
+      case VariableType::tVoid: return true;
+      case VariableType::tInteger: integer = decoder._decoder->decodeInteger(data, position);
+        floatValue = integer;
+        boolean = (bool)integer;
+        return true;
+      case VariableType::tInteger64: integer = decoder._decoder->decodeInteger64(data, position);
+        floatValue = integer;
+        boolean = (bool)integer;
+        return true;
+      case VariableType::tFloat: floatValue = decoder._decoder->decodeFloat(data, position);
+        integer = std::llround(floatValue);
+        boolean = (bool)floatValue;
+        return true;
+      case VariableType::tDouble: decoder._doubleReceived = true;
+        floatValue = decoder._decoder->decodeDouble(data, position);
+        integer = std::llround(floatValue);
+        boolean = (bool)floatValue;
+        return true;
+      case VariableType::tBoolean: boolean = decoder._decoder->decodeBoolean(data, position);
+        integer = (int64_t)boolean;
+        floatValue = (double)boolean;
+        return true;
+      case VariableType::tString:
+      case VariableType::tBase64: {
+        std::string value = decoder._decoder->decodeString(data, position);
+        integer = Math::getNumber64(value);
+        floatValue = integer;
+        boolean = !value.empty() && value != "0" && value != "false" && value != "f";
+        return true;
+      }
+      default: skip(decoder, data, position, type);
+        return false;
+    }
+  }
+
+  /**
+   * Moves "position" behind the value of type "type". Never moves "position" behind the end of "data".
+   */
+  static void skip(RpcDecoder &decoder, const ByteSpan &data, uint32_t &position, VariableType type) {
+    switch (type) {
+      case VariableType::tInteger: advance(data, position, 4);
+        break;
+      case VariableType::tBoolean: advance(data, position, 1);
+        break;
+      case VariableType::tInteger64:
+      case VariableType::tFloat:
+      case VariableType::tDouble: advance(data, position, 8);
+        break;
+      case VariableType::tString:
+      case VariableType::tBase64:
+      case VariableType::tBinary: advance(data, position, (uint32_t)decoder._decoder->decodeInteger(data, position));
+        break;
+      case VariableType::tArray: {
+        uint32_t count = decoder._decoder->decodeInteger(data, position);
+        for (uint32_t i = 0; i < count && position < data.size(); i++) {
+          skip(decoder, data, position, decodeType(decoder, data, position));
+        }
+        break;
+      }
+      case VariableType::tStruct: {
+        uint32_t count = decoder._decoder->decodeInteger(data, position);
+        for (uint32_t i = 0; i < count && position < data.size(); i++) {
+          advance(data, position, (uint32_t)decoder._decoder->decodeInteger(data, position));
+          skip(decoder, data, position, decodeType(decoder, data, position));
+        }
+        break;
+      }
+      default: break;
+    }
+  }
+
+  static void advance(const ByteSpan &data, uint32_t &position, uint32_t size) {
+    if (position > data.size() || size > data.size() - position) position = data.size();
+    else position += size;
+  }
+
+  /**
+   * Returns the number of elements to reserve for "count" encoded elements. Every element takes at least 4 bytes, so
+   * a corrupt count doesn't cause a huge allocation.
+   */
+  static size_t reserveSize(const ByteSpan &data, uint32_t position, uint32_t count) {
+    size_t remaining = position < data.size() ? (data.size() - position) / 4 : 0;
+    return count < remaining ? count : remaining;
+  }
+
+  template<typename Sink>
+  static void encodeJsonString(JsonEncoder &encoder, Sink &sink, const std::string &value) {
+    std::string escaped = encoder.encodeString(value);
+    sink.push_back('"');
+    sink.append(escaped.data(), escaped.size());
+    sink.push_back('"');
+  }
+
+  template<typename Sink>
+  static void encodeJsonFloat(JsonEncoder &encoder, Sink &sink, double value) {
+    std::string number = encoder.toString(value);
+    sink.append(number.data(), number.size());
+  }
+
+  template<typename Sink>
+  static void encodeJsonVariable(JsonEncoder &encoder, Sink &sink, const PVariable &variable) {
+    if (!variable) sink.append("null", 4);
+    else encoder.encodeValue(variable, sink);
+  }
+};
+
+// {{{ Scalars
+template<>
+struct RpcTraits<bool> : public RpcTraitsBase {
+  static size_t size(RpcEncoder &encoder, bool value) { return 5; }
+
+  template<typename Sink>
+  static void encode(RpcEncoder &encoder, Sink &sink, bool value) {
+    encodeType(encoder, sink, VariableType::tBoolean);
+    binaryEncoder(encoder).encodeBoolean(sink, value);
+  }
+
+  static void decode(RpcDecoder &decoder, const ByteSpan &data, uint32_t &position, bool &value) {
+    int64_t integer = 0;
+    double floatValue = 0;
+    decodeScalar(decoder, data, position, decodeType(decoder, data, position), integer, floatValue, value);
+  }
+
+  template<typename Sink>
+  static void encodeJson(JsonEncoder &encoder, Sink &sink, bool value) {
+    if (value) sink.append("true", 4);
+    else sink.append("false", 5);
+  }
+};
+
+/**
+ * Integers with up to 32 bits are encoded as VariableType::tInteger (or VariableType::tInteger64 when the encoder forces
+ * 64 bit integers), 64 bit integers as VariableType::tInteger64. Like Variable, uint32_t is encoded as a 32 bit integer.
+ */
+template<typename T>
+struct RpcIntegerTraits : public RpcTraitsBase {
+  static size_t size(RpcEncoder &encoder, T value) {
+    return (sizeof(T) == 8 || forceInteger64(encoder)) ? 12 : 8;
+  }
+
+  template<typename Sink>
+  static void encode(RpcEncoder &encoder, Sink &sink, T value) {
+    if (sizeof(T) == 8) {
+      encodeType(encoder, sink, VariableType::tInteger64);
+      binaryEncoder(encoder).encodeInteger64(sink, (int64_t)value);
+    } else if (forceInteger64(encoder)) {
+      encodeType(encoder, sink, VariableType::tInteger64);
+      binaryEncoder(encoder).encodeInteger64(sink, (int64_t)(int32_t)value);
+    } else {
+      encodeType(encoder, sink, VariableType::tInteger);
+      binaryEncoder(encoder).encodeInteger(sink, (int32_t)value);
+    }
+  }
+
+  static void decode(RpcDecoder &decoder, const ByteSpan &data, uint32_t &position, T &value) {
+    int64_t integer = 0;
+    double floatValue = 0;
+    bool boolean = false;
+    decodeScalar(decoder, data, position, decodeType(decoder, data, position), integer, floatValue, boolean);
+    value = (T)integer;
+  }
+
+  template<typename Sink>
+  static void encodeJson(JsonEncoder &encoder, Sink &sink, T value) {
+    std::string number = std::to_string(value);
+    sink.append(number.data(), number.size());
+  }
+};
+
+template<> struct RpcTraits<int8_t> : public RpcIntegerTraits<int8_t> {};
+template<> struct RpcTraits<uint8_t> : public RpcIntegerTraits<uint8_t> {};
+template<> struct RpcTraits<int16_t> : public RpcIntegerTraits<int16_t> {};
+template<> struct RpcTraits<uint16_t> : public RpcIntegerTraits<uint16_t> {};
+template<> struct RpcTraits<int32_t> : public RpcIntegerTraits<int32_t> {};
+template<> struct RpcTraits<uint32_t> : public RpcIntegerTraits<uint32_t> {};
+template<> struct RpcTraits<long> : public RpcIntegerTraits<long> {};
+template<> struct RpcTraits<unsigned long> : public RpcIntegerTraits<unsigned long> {};
+template<> struct RpcTraits<long long> : public RpcIntegerTraits<long long> {};
+template<> struct RpcTraits<unsigned long long> : public RpcIntegerTraits<unsigned long long> {};
+
+/**
+ * Floats are encoded as VariableType::tDouble when the encoder encodes doubles and as VariableType::tFloat otherwise.
+ */
+template<typename T>
+struct RpcFloatTraits : public RpcTraitsBase {
+  static size_t size(RpcEncoder &encoder, T value) { return 12; }
+
+  template<typename Sink>
+  static void encode(RpcEncoder &encoder, Sink &sink, T value) {
+    if (encodeDouble(encoder)) {
+      encodeType(encoder, sink, VariableType::tDouble);
+      binaryEncoder(encoder).encodeDouble(sink, value);
+    } else {
+      encodeType(encoder, sink, VariableType::tFloat);
+      binaryEncoder(encoder).encodeFloat(sink, value);
+    }
+  }
+
+  static void decode(RpcDecoder &decoder, const ByteSpan &data, uint32_t &position, T &value) {
+    int64_t integer = 0;
+    double floatValue = 0;
+    bool boolean = false;
+    decodeScalar(decoder, data, position, decodeType(decoder, data, position), integer, floatValue, boolean);
+    value = (T)floatValue;
+  }
+
+  template<typename Sink>
+  static void encodeJson(JsonEncoder &encoder, Sink &sink, T value) {
+    encodeJsonFloat(encoder, sink, value);
+  }
+};
+
+template<> struct RpcTraits<float> : public RpcFloatTraits<float> {};
+template<> struct RpcTraits<double> : public RpcFloatTraits<double> {};
+
+template<>
+struct RpcTraits<std::string> : public RpcTraitsBase {
+  static size_t size(RpcEncoder &encoder, const std::string &value) { return 8 + value.size(); }
+
+  template<typename Sink>
+  static void encode(RpcEncoder &encoder, Sink &sink, const std::string &value) {
+    encodeType(encoder, sink, VariableType::tString);
+    binaryEncoder(encoder).encodeString(sink, value);
+  }
+
+  static void decode(RpcDecoder &decoder, const ByteSpan &data, uint32_t &position, std::string &value) {
+    VariableType type = decodeType(decoder, data, position);
+    if (type == VariableType::tString || type == VariableType::tBase64) value = binaryDecoder(decoder).decodeString(data, position);
+    else {
+      value.clear();
+      skip(decoder, data, position, type);
+    }
+  }
+
+  template<typename Sink>
+  static void encodeJson(JsonEncoder &encoder, Sink &sink, const std::string &value) {
+    encodeJsonString(encoder, sink, value);
+  }
+};
+
+/**
+ * C strings can only be encoded. nullptr is encoded as empty string. String literals passed to templates decay to
+ * "const char*".
+ */
+template<typename T>
+struct RpcCStringTraits : public RpcTraitsBase {
+  static size_t size(RpcEncoder &encoder, T value) { return 8 + (value ? std::strlen(value) : 0); }
+
+  template<typename Sink>
+  static void encode(RpcEncoder &encoder, Sink &sink, T value) {
+    int32_t length = value ? (int32_t)std::strlen(value) : 0;
+    encodeType(encoder, sink, VariableType::tString);
+    binaryEncoder(encoder).encodeInteger(sink, length);
+    if (length > 0) sink.append(value, length);
+  }
+
+  template<typename Sink>
+  static void encodeJson(JsonEncoder &encoder, Sink &sink, T value) {
+    encodeJsonString(encoder, sink, value ? std::string(value) : std::string());
+  }
+};
+
+template<> struct RpcTraits<const char *> : public RpcCStringTraits<const char *> {};
+template<> struct RpcTraits<char *> : public RpcCStringTraits<char *> {};
+
+template<>
+struct RpcTraits<std::vector<uint8_t>> : public RpcTraitsBase {
+  static size_t size(RpcEncoder &encoder, const std::vector<uint8_t> &value) { return 8 + value.size(); }
+
+  template<typename Sink>
+  static void encode(RpcEncoder &encoder, Sink &sink, const std::vector<uint8_t> &value) {
+    encodeType(encoder, sink, VariableType::tBinary);
+    binaryEncoder(encoder).encodeBinary(sink, value);
+  }
+
+  static void decode(RpcDecoder &decoder, const ByteSpan &data, uint32_t &position, std::vector<uint8_t> &value) {
+    VariableType type = decodeType(decoder, data, position);
+    if (type == VariableType::tBinary) value = binaryDecoder(decoder).decodeBinary(data, position);
+    else {
+      value.clear();
+      skip(decoder, data, position, type);
+    }
+  }
+
+  //Binary data is not supported by JSON. Like JsonEncoder, encode it as null.
+  template<typename Sink>
+  static void encodeJson(JsonEncoder &encoder, Sink &sink, const std::vector<uint8_t> &value) {
+    sink.append("null", 4);
+  }
+};
+// }}}
+
+// {{{ Containers
+template<typename T>
+struct RpcTraits<std::vector<T>> : public RpcTraitsBase {
+  static size_t size(RpcEncoder &encoder, const std::vector<T> &value) {
+    size_t size = 8;
+    for (typename std::vector<T>::const_iterator i = value.begin(); i != value.end(); ++i) {
+      size += RpcTraits<T>::size(encoder, *i);
+    }
+    return size;
+  }
+
+  template<typename Sink>
+  static void encode(RpcEncoder &encoder, Sink &sink, const std::vector<T> &value) {
+    encodeType(encoder, sink, VariableType::tArray);
+    binaryEncoder(encoder).encodeInteger(sink, (int32_t)value.size());
+    for (typename std::vector<T>::const_iterator i = value.begin(); i != value.end(); ++i) {
+      RpcTraits<T>::encode(encoder, sink, *i);
+    }
+  }
+
+  static void decode(RpcDecoder &decoder, const ByteSpan &data, uint32_t &position, std::vector<T> &value) {
+    value.clear();
+    VariableType type = decodeType(decoder, data, position);
+    if (type != VariableType::tArray) {
+      skip(decoder, data, position, type);
+      return;
+    }
+    uint32_t count = binaryDecoder(decoder).decodeInteger(data, position);
+    value.reserve(reserveSize(data, position, count));
+    for (uint32_t i = 0; i < count && position < data.size(); i++) {
+      T element{};
+      RpcTraits<T>::decode(decoder, data, position, element);
+      value.push_back(std::move(element));
+    }
+  }
+
+  template<typename Sink>
+  static void encodeJson(JsonEncoder &encoder, Sink &sink, const std::vector<T> &value) {
+    sink.push_back('[');
+    for (typename std::vector<T>::const_iterator i = value.begin(); i != value.end(); ++i) {
+      if (i != value.begin()) sink.push_back(',');
+      RpcTraits<T>::encodeJson(encoder, sink, *i);
+    }
+    sink.push_back(']');
+  }
+};
+
+/**
+ * Maps with string keys are encoded as VariableType::tStruct. Like for Variable, empty keys are encoded as "UNDEFINED".
+ */
+template<typename Map>
+struct RpcMapTraits : public RpcTraitsBase {
+  typedef typename Map::mapped_type Value;
+
+  static size_t size(RpcEncoder &encoder, const Map &value) {
+    size_t size = 8;
+    for (typename Map::const_iterator i = value.begin(); i != value.end(); ++i) {
+      size += 4 + (i->first.empty() ? 9 : i->first.size()) + RpcTraits<Value>::size(encoder, i->second);
+    }
+    return size;
+  }
+
+  template<typename Sink>
+  static void encode(RpcEncoder &encoder, Sink &sink, const Map &value) {
+    static const std::string undefined = "UNDEFINED";
+    encodeType(encoder, sink, VariableType::tStruct);
+    binaryEncoder(encoder).encodeInteger(sink, (int32_t)value.size());
+    for (typename Map::const_iterator i = value.begin(); i != value.end(); ++i) {
+      binaryEncoder(encoder).encodeString(sink, i->first.empty() ? undefined : i->first);
+      RpcTraits<Value>::encode(encoder, sink, i->second);
+    }
+  }
+
+  static void decode(RpcDecoder &decoder, const ByteSpan &data, uint32_t &position, Map &value) {
+    value.clear();
+    VariableType type = decodeType(decoder, data, position);
+    if (type != VariableType::tStruct) {
+      skip(decoder, data, position, type);
+      return;
+    }
+    uint32_t count = binaryDecoder(decoder).decodeInteger(data, position);
+    for (uint32_t i = 0; i < count && position < data.size(); i++) {
+      std::string name = binaryDecoder(decoder).decodeString(data, position);
+      RpcTraits<Value>::decode(decoder, data, position, value[name]);
+    }
+  }
+
+  template<typename Sink>
+  static void encodeJson(JsonEncoder &encoder, Sink &sink, const Map &value) {
+    sink.push_back('{');
+    for (typename Map::const_iterator i = value.begin(); i != value.end(); ++i) {
+      if (i != value.begin()) sink.push_back(',');
+      encodeJsonString(encoder, sink, i->first);
+      sink.push_back(':');
+      RpcTraits<Value>::encodeJson(encoder, sink, i->second);
+    }
+    sink.push_back('}');
+  }
+};
+
+template<typename T>
+struct RpcTraits<std::map<std::string, T>> : public RpcMapTraits<std::map<std::string, T>> {};
+
+template<typename T>
+struct RpcTraits<std::unordered_map<std::string, T>> : public RpcMapTraits<std::unordered_map<std::string, T>> {};
+
+template<typename Tuple, size_t Index>
+using RpcTupleElementTraits = RpcTraits<typename std::decay<typename std::tuple_element<Index, Tuple>::type>::type>;
+
+/**
+ * Iterates over the elements "Index" to "Count - 1" of a tuple. Tuple elements may be references when the tuple is only
+ * encoded.
+ */
+template<size_t Index, size_t Count>
+struct RpcTupleElements {
+  template<typename Tuple>
+  static size_t size(RpcEncoder &encoder, const Tuple &tuple) {
+    return RpcTupleElementTraits<Tuple, Index>::size(encoder, std::get<Index>(tuple)) + RpcTupleElements<Index + 1, Count>::size(encoder, tuple);
+  }
+
+  template<typename Sink, typename Tuple>
+  static void encode(RpcEncoder &encoder, Sink &sink, const Tuple &tuple) {
+    RpcTupleElementTraits<Tuple, Index>::encode(encoder, sink, std::get<Index>(tuple));
+    RpcTupleElements<Index + 1, Count>::encode(encoder, sink, tuple);
+  }
+
+  /**
+   * Decodes the first "encodedCount" elements. The remaining elements are not touched.
+   */
+  template<typename Tuple>
+  static void decode(RpcDecoder &decoder, const ByteSpan &data, uint32_t &position, Tuple &tuple, uint32_t encodedCount) {
+    if (Index >= encodedCount) return;
+    RpcTupleElementTraits<Tuple, Index>::decode(decoder, data, position, std::get<Index>(tuple));
+    RpcTupleElements<Index + 1, Count>::decode(decoder, data, position, tuple, encodedCount);
+  }
+
+  template<typename Sink, typename Tuple>
+  static void encodeJson(JsonEncoder &encoder, Sink &sink, const Tuple &tuple) {
+    if (Index > 0) sink.push_back(',');
+    RpcTupleElementTraits<Tuple, Index>::encodeJson(encoder, sink, std::get<Index>(tuple));
+    RpcTupleElements<Index + 1, Count>::encodeJson(encoder, sink, tuple);
+  }
+};
+
+template<size_t Count>
+struct RpcTupleElements<Count, Count> {
+  template<typename Tuple>
+  static size_t size(RpcEncoder &encoder, const Tuple &tuple) { return 0; }
+
+  template<typename Sink, typename Tuple>
+  static void encode(RpcEncoder &encoder, Sink &sink, const Tuple &tuple) {}
+
+  template<typename Tuple>
+  static void decode(RpcDecoder &decoder, const ByteSpan &data, uint32_t &position, Tuple &tuple, uint32_t encodedCount) {}
+
+  template<typename Sink, typename Tuple>
+  static void encodeJson(JsonEncoder &encoder, Sink &sink, const Tuple &tuple) {}
+};
+
+/**
+ * Tuples are encoded as arrays. When decoding, missing elements get their default value and additional elements are
+ * skipped.
+ */
+template<typename... Elements>
+struct RpcTraits<std::tuple<Elements...>> : public RpcTraitsBase {
+  typedef RpcTupleElements<0, sizeof...(Elements)> TupleElements;
+
+  static size_t size(RpcEncoder &encoder, const std::tuple<Elements...> &value) {
+    return 8 + TupleElements::size(encoder, value);
+  }
+
+  template<typename Sink>
+  static void encode(RpcEncoder &encoder, Sink &sink, const std::tuple<Elements...> &value) {
+    encodeType(encoder, sink, VariableType::tArray);
+    binaryEncoder(encoder).encodeInteger(sink, (int32_t)sizeof...(Elements));
+    TupleElements::encode(encoder, sink, value);
+  }
+
+  static void decode(RpcDecoder &decoder, const ByteSpan &data, uint32_t &position, std::tuple<Elements...> &value) {
+    value = std::tuple<Elements...>();
+    VariableType type = decodeType(decoder, data, position);
+    if (type != VariableType::tArray) {
+      skip(decoder, data, position, type);
+      return;
+    }
+    uint32_t count = binaryDecoder(decoder).decodeInteger(data, position);
+    TupleElements::decode(decoder, data, position, value, count);
+    for (uint32_t i = sizeof...(Elements); i < count && position < data.size(); i++) {
+      skip(decoder, data, position, decodeType(decoder, data, position));
+    }
+  }
+
+  template<typename Sink>
+  static void encodeJson(JsonEncoder &encoder, Sink &sink, const std::tuple<Elements...> &value) {
+    sink.push_back('[');
+    TupleElements::encodeJson(encoder, sink, value);
+    sink.push_back(']');
+  }
+};
+// }}}
+
+// {{{ Variables
+/**
+ * Allows mixing typed values and Variables. nullptr is encoded as void.
+ */
+template<>
+struct RpcTraits<PVariable> : public RpcTraitsBase {
+  static size_t size(RpcEncoder &encoder, const PVariable &value) { return variableSize(encoder, value); }
+
+  template<typename Sink>
+  static void encode(RpcEncoder &encoder, Sink &sink, const PVariable &value) {
+    encodeVariable(encoder, sink, value);
+  }
+
+  static void decode(RpcDecoder &decoder, const ByteSpan &data, uint32_t &position, PVariable &value) {
+    value = decodeVariable(decoder, data, position);
+  }
+
+  template<typename Sink>
+  static void encodeJson(JsonEncoder &encoder, Sink &sink, const PVariable &value) {
+    encodeJsonVariable(encoder, sink, value);
+  }
+};
+
+/**
+ * Encodes an array of Variables. nullptr is encoded as an empty array.
+ */
+template<>
+struct RpcTraits<PArray> : public RpcTraitsBase {
+  static size_t size(RpcEncoder &encoder, const PArray &value) {
+    size_t size = 8;
+    if (value) {
+      for (auto &element : *value) {
+        size += variableSize(encoder, element);
+      }
+    }
+    return size;
+  }
+
+  template<typename Sink>
+  static void encode(RpcEncoder &encoder, Sink &sink, const PArray &value) {
+    encodeType(encoder, sink, VariableType::tArray);
+    binaryEncoder(encoder).encodeInteger(sink, value ? (int32_t)value->size() : 0);
+    if (value) {
+      for (auto &element : *value) {
+        encodeVariable(encoder, sink, element);
+      }
+    }
+  }
+
+  static void decode(RpcDecoder &decoder, const ByteSpan &data, uint32_t &position, PArray &value) {
+    value = std::make_shared<Array>();
+    VariableType type = decodeType(decoder, data, position);
+    if (type != VariableType::tArray) {
+      skip(decoder, data, position, type);
+      return;
+    }
+    uint32_t count = binaryDecoder(decoder).decodeInteger(data, position);
+    value->reserve(reserveSize(data, position, count));
+    for (uint32_t i = 0; i < count && position < data.size(); i++) {
+      value->push_back(decodeVariable(decoder, data, position));
+    }
+  }
+
+  template<typename Sink>
+  static void encodeJson(JsonEncoder &encoder, Sink &sink, const PArray &value) {
+    sink.push_back('[');
+    if (value) {
+      for (Array::const_iterator i = value->begin(); i != value->end(); ++i) {
+        if (i != value->begin()) sink.push_back(',');
+        encodeJsonVariable(encoder, sink, *i);
+      }
+    }
+    sink.push_back(']');
+  }
+};
+// }}}
+
+/**
+ * Base for RpcTraits specializations of structs. The specialization only lists the fields:
+ *
+ *   struct Point {
+ *     int32_t x = 0;
+ *     int32_t y = 0;
+ *   };
+ *
+ *   namespace Ipc {
+ *   template<>
+ *   struct RpcTraits<Point> : public RpcStructTraits<Point> {
+ *     template<typename Visitor, typename Value>
+ *     static void fields(Visitor &visitor, Value &value) {
+ *       visitor("x", value.x);
+ *       visitor("y", value.y);
+ *     }
+ *   };
+ *   }
+ *
+ * The struct is encoded as VariableType::tStruct with the fields in the listed order. When decoding, fields are matched
+ * by name. Unknown fields are skipped and missing fields keep the value of a default constructed "T".
+ */
+template<typename T>
+struct RpcStructTraits : public RpcTraitsBase {
+  static size_t size(RpcEncoder &encoder, const T &value) {
+    SizeVisitor visitor(encoder);
+    RpcTraits<T>::fields(visitor, value);
+    return 8 + visitor.size;
+  }
+
+  template<typename Sink>
+  static void encode(RpcEncoder &encoder, Sink &sink, const T &value) {
+    CountVisitor counter;
+    RpcTraits<T>::fields(counter, value);
+    encodeType(encoder, sink, VariableType::tStruct);
+    binaryEncoder(encoder).encodeInteger(sink, counter.count);
+    EncodeVisitor<Sink> visitor(encoder, sink);
+    RpcTraits<T>::fields(visitor, value);
+  }
+
+  static void decode(RpcDecoder &decoder, const ByteSpan &data, uint32_t &position, T &value) {
+    value = T();
+    VariableType type = decodeType(decoder, data, position);
+    if (type != VariableType::tStruct) {
+      skip(decoder, data, position, type);
+      return;
+    }
+    uint32_t count = binaryDecoder(decoder).decodeInteger(data, position);
+    for (uint32_t i = 0; i < count && position < data.size(); i++) {
+      uint32_t nameSize = binaryDecoder(decoder).decodeInteger(data, position);
+      if (nameSize > data.size() - position) {
+        position = data.size();
+        return;
+      }
+      DecodeVisitor visitor(decoder, data, position, data.data() + position, nameSize);
+      position += nameSize;
+      RpcTraits<T>::fields(visitor, value);
+      if (!visitor.found) skip(decoder, data, position, decodeType(decoder, data, position));
+    }
+  }
+
+  template<typename Sink>
+  static void encodeJson(JsonEncoder &encoder, Sink &sink, const T &value) {
+    EncodeJsonVisitor<Sink> visitor(encoder, sink);
+    sink.push_back('{');
+    RpcTraits<T>::fields(visitor, value);
+    sink.push_back('}');
+  }
+ private:
+  struct CountVisitor {
+    int32_t count = 0;
+
+    template<typename Field>
+    void operator()(const char *name, const Field &field) { count++; }
+  };
+
+  struct SizeVisitor {
+    RpcEncoder &encoder;
+    size_t size = 0;
+
+    explicit SizeVisitor(RpcEncoder &encoder) : encoder(encoder) {}
+
+    template<typename Field>
+    void operator()(const char *name, const Field &field) {
+      size += 4 + std::strlen(name) + RpcTraits<Field>::size(encoder, field);
+    }
+  };
+
+  template<typename Sink>
+  struct EncodeVisitor {
+    RpcEncoder &encoder;
+    Sink &sink;
+
+    EncodeVisitor(RpcEncoder &encoder, Sink &sink) : encoder(encoder), sink(sink) {}
+
+    template<typename Field>
+    void operator()(const char *name, const Field &field) {
+      int32_t nameSize = (int32_t)std::strlen(name);
+      binaryEncoder(encoder).encodeInteger(sink, nameSize);
+      sink.append(name, nameSize);
+      RpcTraits<Field>::encode(encoder, sink, field);
+    }
+  };
+
+  struct DecodeVisitor {
+    RpcDecoder &decoder;
+    const ByteSpan &data;
+    uint32_t &position;
+    const char *name;
+    uint32_t nameSize;
+    bool found = false;
+
+    DecodeVisitor(RpcDecoder &decoder, const ByteSpan &data, uint32_t &position, const char *name, uint32_t nameSize) : decoder(decoder), data(data), position(position), name(name), nameSize(nameSize) {}
+
+    template<typename Field>
+    void operator()(const char *fieldName, Field &field) {
+      if (found || std::strlen(fieldName) != nameSize || std::memcmp(fieldName, name, nameSize) != 0) return;
+      found = true;
+      RpcTraits<Field>::decode(decoder, data, position, field);
+    }
+  };
+
+  template<typename Sink>
+  struct EncodeJsonVisitor {
+    JsonEncoder &encoder;
+    Sink &sink;
+    bool first = true;
+
+    EncodeJsonVisitor(JsonEncoder &encoder, Sink &sink) : encoder(encoder), sink(sink) {}
+
+    template<typename Field>
+    void operator()(const char *name, const Field &field) {
+      if (!first) sink.push_back(',');
+      first = false;
+      encodeJsonString(encoder, sink, name);
+      sink.push_back(':');
+      RpcTraits<Field>::encodeJson(encoder, sink, field);
+    }
+  };
+};
+
+// {{{ Typed members of RpcEncoder, RpcDecoder and JsonEncoder
+template<typename Sink, typename... Parameters>
+void RpcEncoder::encodeTypedRequest(const std::string &methodName, const std::tuple<Parameters...> &parameters, Sink &sink) {
+  typedef RpcTupleElements<0, sizeof...(Parameters)> TupleElements;
+  //The "Bin", the type byte after that and the length itself are not part of the length
+  size_t dataSize = 4 + methodName.size() + 4 + TupleElements::size(*this, parameters);
+  sink.reserve(8 + dataSize);
+  sink.append("Bin", 3);
+  sink.push_back(0);
+  _encoder->encodeInteger(sink, (int32_t)dataSize);
+  _encoder->encodeString(sink, methodName);
+  _encoder->encodeInteger(sink, (int32_t)sizeof...(Parameters));
+  TupleElements::encode(*this, sink, parameters);
+}
+
+template<typename T, typename Sink>
+void RpcEncoder::encodeTypedResponse(const T &value, Sink &sink) {
+  //The "Bin", the type byte after that and the length itself are not part of the length
+  size_t dataSize = RpcTraits<T>::size(*this, value);
+  sink.reserve(8 + dataSize);
+  sink.append("Bin", 3);
+  sink.push_back(1);
+  _encoder->encodeInteger(sink, (int32_t)dataSize);
+  RpcTraits<T>::encode(*this, sink, value);
+}
+
+template<typename... Parameters>
+void RpcDecoder::decodeTypedRequest(const ByteSpan &packet, std::string &methodName, std::tuple<Parameters...> &parameters) {
+  uint32_t position = 4;
+  uint32_t headerSize = 0;
+  if (packet.at(3) == 0x40 || packet.at(3) == 0x41) headerSize = _decoder->decodeInteger(packet, position) + 4;
+  position = 8 + headerSize;
+  methodName = _decoder->decodeString(packet, position);
+  uint32_t parameterCount = _decoder->decodeInteger(packet, position);
+  parameters = std::tuple<Parameters...>();
+  RpcTupleElements<0, sizeof...(Parameters)>::decode(*this, packet, position, parameters, parameterCount);
+}
+
+template<typename... Parameters>
+void RpcDecoder::decodeTypedParameters(const ByteSpan &packet, const ByteSpan &methodName, std::tuple<Parameters...> &parameters) {
+  uint32_t position = (uint32_t)(methodName.data() + methodName.size() - packet.data());
+  uint32_t parameterCount = _decoder->decodeInteger(packet, position);
+  parameters = std::tuple<Parameters...>();
+  RpcTupleElements<0, sizeof...(Parameters)>::decode(*this, packet, position, parameters, parameterCount);
+}
+
+template<typename T>
+void RpcDecoder::decodeTypedResponse(const ByteSpan &packet, T &value, uint32_t offset) {
+  uint32_t position = offset + 8;
+  RpcTraits<T>::decode(*this, packet, position, value);
+}
+
+template<typename T>
+void RpcDecoder::decodeTyped(const ByteSpan &data, uint32_t &position, T &value) {
+  RpcTraits<T>::decode(*this, data, position, value);
+}
+
+template<typename T, typename Sink>
+void JsonEncoder::encodeTyped(const T &value, Sink &sink) {
+  RpcTraits<T>::encodeJson(*this, sink, value);
+}
+// }}}
+
+}
+#endif
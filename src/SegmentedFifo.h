@@ -0,0 +1,186 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * libhomegear-base is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * libhomegear-base is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libhomegear-base.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#ifndef IPCSEGMENTEDFIFO_H_
+#define IPCSEGMENTEDFIFO_H_
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace Ipc {
+
+/**
+ * Unbounded FIFO storing its elements in linked segments of "segmentSize" elements. Segments are allocated when the
+ * FIFO grows and freed as soon as they are drained, so the memory follows the number of elements. One drained segment
+ * is kept as spare while elements remain, so a FIFO with a steady backlog doesn't allocate. An empty FIFO keeps only
+ * its last segment and a FIFO that was never used doesn't allocate at all. Elements never move, so references stay
+ * valid until the element is popped. Not thread safe.
+ */
+template<typename T, size_t segmentSize = 64>
+class SegmentedFifo {
+ public:
+  SegmentedFifo() = default;
+
+  SegmentedFifo(SegmentedFifo &&other) noexcept {
+    swap(other);
+  }
+
+  SegmentedFifo &operator=(SegmentedFifo &&other) noexcept {
+    if (this != &other) {
+      clear();
+      swap(other);
+    }
+    return *this;
+  }
+
+  SegmentedFifo(const SegmentedFifo &) = delete;
+  SegmentedFifo &operator=(const SegmentedFifo &) = delete;
+
+  ~SegmentedFifo() {
+    clear();
+  }
+
+  bool empty() const { return _size == 0; }
+  size_t size() const { return _size; }
+
+  /**
+   * The number of bytes allocated for segments.
+   */
+  size_t memoryUsage() const { return _segmentCount * sizeof(Segment); }
+
+  T &front() { return *_head->element(_headIndex); }
+  T &back() { return *_tail->element(_tailIndex - 1); }
+
+  void push_back(T &&value) {
+    if (!_tail) {
+      _head = _tail = takeSegment();
+    } else if (_tailIndex == segmentSize) {
+      Segment *segment = takeSegment();
+      _tail->next = segment;
+      _tail = segment;
+      _tailIndex = 0;
+    }
+    new(_tail->element(_tailIndex)) T(std::move(value));
+    _tailIndex++;
+    _size++;
+  }
+
+  void emplace_back() {
+    push_back(T());
+  }
+
+  void pop_front() {
+    _head->element(_headIndex)->~T();
+    _headIndex++;
+    _size--;
+    if (_size == 0) {
+      //Reuse the segment from its start and give back the spare after a burst.
+      if (_head != _tail) {
+        releaseSegment(_head);
+        _head = _tail;
+      }
+      _headIndex = 0;
+      _tailIndex = 0;
+      if (_spare) {
+        delete _spare;
+        _spare = nullptr;
+        _segmentCount--;
+      }
+    } else if (_headIndex == segmentSize) {
+      Segment *segment = _head;
+      _head = _head->next;
+      _headIndex = 0;
+      releaseSegment(segment);
+    }
+  }
+
+  /**
+   * Destroys all elements and frees all segments.
+   */
+  void clear() {
+    while (_size > 0) pop_front();
+    delete _head;
+    delete _spare;
+    _head = nullptr;
+    _tail = nullptr;
+    _spare = nullptr;
+    _segmentCount = 0;
+  }
+ private:
+  struct Segment {
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type elements[segmentSize];
+    Segment *next = nullptr;
+
+    T *element(size_t index) { return reinterpret_cast<T *>(&elements[index]); }
+  };
+
+  Segment *_head = nullptr;
+  Segment *_tail = nullptr;
+  Segment *_spare = nullptr;
+  size_t _headIndex = 0;
+  size_t _tailIndex = 0;
+  size_t _size = 0;
+  size_t _segmentCount = 0;
+
+  void swap(SegmentedFifo &other) {
+    std::swap(_head, other._head);
+    std::swap(_tail, other._tail);
+    std::swap(_spare, other._spare);
+    std::swap(_headIndex, other._headIndex);
+    std::swap(_tailIndex, other._tailIndex);
+    std::swap(_size, other._size);
+    std::swap(_segmentCount, other._segmentCount);
+  }
+
+  Segment *takeSegment() {
+    if (_spare) {
+      Segment *segment = _spare;
+      _spare = nullptr;
+      segment->next = nullptr;
+      return segment;
+    }
+    Segment *segment = new Segment;
+    _segmentCount++;
+    return segment;
+  }
+
+  void releaseSegment(Segment *segment) {
+    if (!_spare) _spare = segment;
+    else {
+      delete segment;
+      _segmentCount--;
+    }
+  }
+};
+
+}
+#endif
@@ -0,0 +1,93 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * libhomegear-base is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * libhomegear-base is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libhomegear-base.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#include "ThreadOptions.h"
+#include "Output.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <pthread.h>
+#include <sched.h>
+
+namespace Ipc {
+
+bool ThreadOptions::apply(int32_t threadIndex) const {
+  bool result = true;
+  pthread_t thread = pthread_self();
+  int error = 0;
+
+  if (!name.empty()) {
+    std::string suffix = threadIndex >= 0 ? "-" + std::to_string(threadIndex) : "";
+    //Names are limited to 16 bytes including the terminating null character. The suffix tells the threads apart, so
+    //the name is shortened instead.
+    std::string threadName = (name.substr(0, 15 - std::min(suffix.size(), (size_t)15)) + suffix).substr(0, 15);
+#ifdef __linux__
+    error = pthread_setname_np(thread, threadName.c_str());
+#else
+    error = ENOSYS;
+#endif
+    if (error != 0) {
+      Output::printWarning("Warning: Could not set thread name to " + threadName + ": " + std::string(strerror(error)));
+      result = false;
+    }
+  }
+
+  if (!cpus.empty()) {
+#ifdef __linux__
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    for (auto cpu : cpus) {
+      if (cpu < CPU_SETSIZE) CPU_SET(cpu, &cpuSet);
+    }
+    error = pthread_setaffinity_np(thread, sizeof(cpu_set_t), &cpuSet);
+#else
+    error = ENOSYS;
+#endif
+    if (error != 0) {
+      Output::printWarning("Warning: Could not set CPU affinity of thread " + name + ": " + std::string(strerror(error)));
+      result = false;
+    }
+  }
+
+  if (realtimePriority > 0) {
+    sched_param parameters{};
+    parameters.sched_priority = std::max(sched_get_priority_min(SCHED_FIFO), std::min((int)realtimePriority, sched_get_priority_max(SCHED_FIFO)));
+    error = pthread_setschedparam(thread, SCHED_FIFO, &parameters);
+    if (error != 0) {
+      Output::printWarning("Warning: Could not set SCHED_FIFO priority " + std::to_string(parameters.sched_priority) + " for thread " + name + ": " + std::string(strerror(error)));
+      result = false;
+    }
+  }
+
+  return result;
+}
+
+}
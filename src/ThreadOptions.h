@@ -0,0 +1,75 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * libhomegear-base is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * libhomegear-base is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libhomegear-base.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#ifndef IPCTHREADOPTIONS_H_
+#define IPCTHREADOPTIONS_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Ipc {
+
+/**
+ * Name, CPU affinity and scheduling policy of a group of threads, e.g. the processing threads of a queue (see
+ * TypedQueue::setThreadOptions()), the workers of a ThreadPool or the reader of a client (see
+ * IIpcClient::setThreadOptions()).
+ */
+struct ThreadOptions {
+  /**
+   * The thread name shown by top, htop and perf. The threads of a group get their number appended, e.g.
+   * "ipc-request-2". Linux limits names to 15 characters, so longer names are shortened. Empty keeps the name
+   * inherited from the creating thread.
+   */
+  std::string name;
+
+  /**
+   * The CPUs the threads may run on. Empty doesn't restrict them.
+   */
+  std::vector<uint32_t> cpus;
+
+  /**
+   * Runs the threads with SCHED_FIFO at this priority (1 to 99). This needs CAP_SYS_NICE or a matching RLIMIT_RTPRIO.
+   * A real-time thread that doesn't block starves all other threads on its CPUs, so combine this with "cpus". 0 keeps
+   * the default policy.
+   */
+  int32_t realtimePriority = 0;
+
+  /**
+   * Applies the options to the calling thread. Settings that fail are logged and don't prevent the others.
+   *
+   * @param threadIndex The number appended to the name. -1 uses the name as is.
+   * @return Returns false when a setting couldn't be applied.
+   */
+  bool apply(int32_t threadIndex = -1) const;
+};
+
+}
+#endif
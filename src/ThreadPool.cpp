@@ -0,0 +1,164 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * libhomegear-base is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * libhomegear-base is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libhomegear-base.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#include "ThreadPool.h"
+#include "Output.h"
+
+namespace Ipc {
+
+namespace {
+//The pool and worker index of the current thread, so post() can use the worker's own deque. Reset by the destructor
+//when a task destroys the pool it runs on, see run().
+thread_local ThreadPool *currentPool = nullptr;
+thread_local uint32_t currentWorker = 0;
+}
+
+ThreadPool::ThreadPool(uint32_t threadCount, ThreadOptions threadOptions) : _threadOptions(std::move(threadOptions)) {
+  if (threadCount == 0) threadCount = std::thread::hardware_concurrency();
+  if (threadCount == 0) threadCount = 1;
+  _workers.reserve(threadCount);
+  for (uint32_t i = 0; i < threadCount; i++) {
+    _workers.emplace_back(new Worker());
+  }
+  for (uint32_t i = 0; i < threadCount; i++) {
+    _workers[i]->thread = std::thread(&ThreadPool::run, this, i);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  _stop = true;
+  {
+    std::lock_guard<std::mutex> sleepGuard(_sleepMutex);
+  }
+  _sleepConditionVariable.notify_all();
+  for (auto &worker : _workers) {
+    if (!worker->thread.joinable()) continue;
+    //A task can release the last reference to the pool. Its worker can't be joined, so it is detached and run()
+    //returns after the task without touching the destroyed pool.
+    if (worker->thread.get_id() == std::this_thread::get_id()) {
+      worker->thread.detach();
+      currentPool = nullptr;
+    } else worker->thread.join();
+  }
+}
+
+std::shared_ptr<ThreadPool> ThreadPool::getDefault() {
+  static std::mutex defaultPoolMutex;
+  static std::weak_ptr<ThreadPool> defaultPool;
+  std::lock_guard<std::mutex> defaultPoolGuard(defaultPoolMutex);
+  std::shared_ptr<ThreadPool> pool = defaultPool.lock();
+  if (!pool) {
+    ThreadOptions threadOptions;
+    threadOptions.name = "ipc-pool";
+    pool = std::make_shared<ThreadPool>(0, threadOptions);
+    defaultPool = pool;
+  }
+  return pool;
+}
+
+bool ThreadPool::post(std::function<void()> task, bool yield) {
+  if (_stop) return false;
+  if (currentPool == this) {
+    Worker &worker = *_workers[currentWorker];
+    std::lock_guard<std::mutex> workerGuard(worker.mutex);
+    if (yield) worker.tasks.emplace_front(std::move(task));
+    else worker.tasks.emplace_back(std::move(task));
+  } else {
+    Worker &worker = *_workers[_nextWorker++ % _workers.size()];
+    std::lock_guard<std::mutex> workerGuard(worker.mutex);
+    worker.tasks.emplace_back(std::move(task));
+  }
+
+  //Pairs with the fence in run(): Either the worker sees the task or we see the worker sleeping.
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (_sleepingWorkers.load(std::memory_order_relaxed) > 0) {
+    {
+      std::lock_guard<std::mutex> sleepGuard(_sleepMutex);
+    }
+    _sleepConditionVariable.notify_one();
+  }
+  return true;
+}
+
+bool ThreadPool::takeTask(uint32_t index, std::function<void()> &task) {
+  {
+    Worker &worker = *_workers[index];
+    std::lock_guard<std::mutex> workerGuard(worker.mutex);
+    if (!worker.tasks.empty()) {
+      task = std::move(worker.tasks.back());
+      worker.tasks.pop_back();
+      return true;
+    }
+  }
+  for (uint32_t i = 1; i < _workers.size(); i++) {
+    Worker &victim = *_workers[(index + i) % _workers.size()];
+    std::lock_guard<std::mutex> victimGuard(victim.mutex);
+    if (!victim.tasks.empty()) {
+      task = std::move(victim.tasks.front());
+      victim.tasks.pop_front();
+      return true;
+    }
+  }
+  return false;
+}
+
+void ThreadPool::run(uint32_t index) {
+  currentPool = this;
+  currentWorker = index;
+  _threadOptions.apply(index);
+  std::function<void()> task;
+  while (!_stop) {
+    try {
+      if (!takeTask(index, task)) {
+        std::unique_lock<std::mutex> sleepLock(_sleepMutex);
+        ++_sleepingWorkers;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        while (!_stop && !takeTask(index, task)) {
+          _sleepConditionVariable.wait_for(sleepLock, std::chrono::milliseconds(1000));
+        }
+        --_sleepingWorkers;
+        if (_stop) return;
+      }
+      task();
+    }
+    catch (const std::exception &ex) {
+      Output::printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch (...) {
+      Output::printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+    //Releasing the task can release the last reference to the pool as well (see ~ThreadPool()). Then this must not be
+    //touched anymore.
+    task = nullptr;
+    if (currentPool != this) return;
+  }
+}
+
+}
@@ -0,0 +1,113 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * libhomegear-base is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * libhomegear-base is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libhomegear-base.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#ifndef IPCTHREADPOOL_H_
+#define IPCTHREADPOOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "ThreadOptions.h"
+
+namespace Ipc {
+
+/**
+ * Work-stealing thread pool. Each worker has its own deque of tasks. Tasks posted by a worker go to its own deque, so
+ * follow-up work stays on the same core. A worker takes its newest task first and idle workers steal the oldest tasks
+ * of the others. One pool can be shared by many queues (see IQueue::startQueue()) and many clients.
+ */
+class ThreadPool {
+ public:
+  /**
+   * @param threadCount The number of worker threads. 0 uses one thread per core.
+   * @param threadOptions The name, CPU affinity and scheduling policy of the workers. The name gets the worker's
+   * number appended.
+   */
+  explicit ThreadPool(uint32_t threadCount = 0, ThreadOptions threadOptions = ThreadOptions());
+
+  /**
+   * Stops the workers. Tasks that didn't run yet are discarded.
+   */
+  virtual ~ThreadPool();
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  /**
+   * Returns a pool with one thread per core shared by everything in the process that uses it. It is created on first
+   * use and destroyed when the last user releases it. Its workers are named "ipc-pool-<number>".
+   */
+  static std::shared_ptr<ThreadPool> getDefault();
+
+  uint32_t threadCount() const { return _workers.size(); }
+
+  /**
+   * Queues "task" for execution. Exceptions thrown by the task are caught and logged.
+   *
+   * @param task The task.
+   * @param yield Only relevant when called by a worker of this pool: When true, the task is queued behind the other
+   * tasks of the worker. Use this when a task reposts itself to continue later, so it doesn't starve other tasks.
+   * @return Returns false when the pool is being destroyed. The task is not run then.
+   */
+  bool post(std::function<void()> task, bool yield = false);
+ private:
+  struct Worker {
+    std::mutex mutex;
+    std::deque<std::function<void()>> tasks;
+    std::thread thread;
+  };
+
+  ThreadOptions _threadOptions;
+  std::vector<std::unique_ptr<Worker>> _workers;
+  std::atomic_bool _stop{false};
+  std::atomic<uint32_t> _nextWorker{0};
+
+  //Idle workers sleep on this. The counter tells post() whether it needs to wake one up.
+  std::mutex _sleepMutex;
+  std::condition_variable _sleepConditionVariable;
+  std::atomic<uint32_t> _sleepingWorkers{0};
+
+  void run(uint32_t index);
+
+  /**
+   * Takes the newest task of worker "index" or steals the oldest task of another worker.
+   */
+  bool takeTask(uint32_t index, std::function<void()> &task);
+};
+
+}
+#endif
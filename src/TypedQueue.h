@@ -0,0 +1,1451 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * libhomegear-base is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * libhomegear-base is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libhomegear-base.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#ifndef IPCTYPEDQUEUE_H_
+#define IPCTYPEDQUEUE_H_
+
+#include "IQueueBase.h"
+#include "ByteBudget.h"
+#include "MpmcRing.h"
+#include "SegmentedFifo.h"
+#include "ThreadOptions.h"
+#include "ThreadPool.h"
+#include "WaitStrategy.h"
+
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <unordered_map>
+#include <iostream>
+
+namespace Ipc {
+
+/**
+ * Queues with processing threads storing entries of type "T" by value. Entries are moved into and out of segments
+ * that are allocated while a queue grows and freed while it drains (see SegmentedFifo), so nothing is allocated per
+ * entry and an idle queue only holds a few kilobytes, whatever its buffer size.
+ *
+ * "Derived" is the class deriving from TypedQueue (CRTP). The queue calls the hooks below on it directly without
+ * virtual dispatch. "Derived" needs to define processQueueEntry(int32_t index, T &entry) and can hide the other hooks
+ * with its own versions. Hooks that aren't public need "friend class TypedQueue<Derived, T>". IQueue is the
+ * instantiation for std::shared_ptr<IQueueEntry> with virtual hooks.
+ *
+ * "T" needs to be default constructible and movable.
+ */
+template<typename Derived, typename T>
+class TypedQueue : public IQueueBase {
+ public:
+  TypedQueue(uint32_t queueCount, uint32_t bufferSize) : IQueueBase(queueCount) {
+    if (bufferSize < 2000000000) _bufferSize = (int32_t)bufferSize;
+
+    _bufferCount.reset(new std::atomic<int32_t>[queueCount]);
+    _waitWhenFull.resize(queueCount);
+    _priorityOptions.resize(queueCount);
+    _lanes.resize(queueCount);
+    _activeKeys.resize(queueCount);
+    _keyedCount.resize(queueCount);
+    _queuedKeys.resize(queueCount);
+    _coalescing.reset(new std::atomic_bool[queueCount]);
+    _coalescingEntries.resize(queueCount);
+    _coalescingMetrics.resize(queueCount);
+    _lockFree.resize(queueCount);
+    _useRing.reset(new std::atomic_bool[queueCount]);
+    _rings.resize(queueCount);
+    _counters.reset(new Counters[queueCount]);
+    _waitingConsumers.reset(new std::atomic<uint32_t>[queueCount]);
+    _waitingProducers.reset(new std::atomic<uint32_t>[queueCount]);
+    _batchSize.reset(new std::atomic<uint32_t>[queueCount]);
+    _waitStrategy.reset(new std::atomic<WaitStrategy>[queueCount]);
+    _overloadPolicy.reset(new std::atomic<OverloadPolicy>[queueCount]);
+    _blockTimeout.reset(new std::atomic<uint32_t>[queueCount]);
+    _byteLimit.reset(new std::atomic<size_t>[queueCount]);
+    _queuedBytes.reset(new std::atomic<size_t>[queueCount]);
+    _byteBudgets.resize(queueCount);
+    _activeByteBudgets.resize(queueCount);
+    _threadPools.resize(queueCount);
+    _maxConcurrency.resize(queueCount);
+    _scheduledTasks.reset(new std::atomic<uint32_t>[queueCount]);
+    _queueMutex.reset(new std::mutex[queueCount]);
+    _processingThread.resize(queueCount);
+    _threadOptions.resize(queueCount);
+    _activeThreadOptions.resize(queueCount);
+    _scalingOptions.resize(queueCount);
+    _activeScalingOptions.resize(queueCount);
+    _produceConditionVariable.reset(new std::condition_variable[queueCount]);
+    _processingConditionVariable.reset(new std::condition_variable[queueCount]);
+
+    for (int32_t i = 0; i < _queueCount; i++) {
+      _lanes[i].resize(1);
+      _bufferCount[i] = 0;
+      _keyedCount[i] = 0;
+      _coalescing[i] = false;
+      _lockFree[i] = false;
+      _useRing[i] = false;
+      _waitingConsumers[i] = 0;
+      _waitingProducers[i] = 0;
+      _batchSize[i] = 1;
+      _waitStrategy[i] = WaitStrategy::blocking;
+      _overloadPolicy[i] = OverloadPolicy::dropNewest;
+      _blockTimeout[i] = 0;
+      _byteLimit[i] = 0;
+      _queuedBytes[i] = 0;
+      _maxConcurrency[i] = 1;
+      _scheduledTasks[i] = 0;
+      _stopProcessingThread[i] = true;
+    }
+  }
+
+  virtual ~TypedQueue() {
+    for (int32_t i = 0; i < _queueCount; i++) {
+      stopQueue(i);
+      _lanes[i].clear();
+    }
+  }
+
+  /**
+   * Starts queue "index" with "processingThreadCount" threads of its own. With scaling enabled (see
+   * setScalingOptions()), the count is limited to the scaling range and changes with the load afterwards.
+   */
+  void startQueue(int32_t index, bool waitWhenFull, uint32_t processingThreadCount) {
+    if (index < 0 || index >= _queueCount) return;
+    resetQueue(index, waitWhenFull);
+    const ScalingOptions &scalingOptions = _activeScalingOptions[index];
+    if (scalingOptions.maxThreads > 0) {
+      processingThreadCount = std::max(processingThreadCount, std::max(scalingOptions.minThreads, (uint32_t)1));
+      processingThreadCount = std::min(processingThreadCount, scalingOptions.maxThreads);
+    }
+    _stopProcessingThread[index] = false;
+    std::lock_guard<std::mutex> queueGuard(_queueMutex[index]);
+    for (uint32_t i = 0; i < processingThreadCount; i++) {
+      addProcessingThread(index);
+    }
+  }
+
+  /**
+   * Starts queue "index" without threads of its own. Entries are processed by tasks posted to "threadPool", at most
+   * "maxConcurrency" at a time, so many queues can share a few threads. A task processes a few batches and then
+   * yields its worker to other tasks. Entries must not block waiting for other tasks of the same pool.
+   */
+  void startQueue(int32_t index, bool waitWhenFull, std::shared_ptr<ThreadPool> threadPool, uint32_t maxConcurrency) {
+    if (index < 0 || index >= _queueCount || !threadPool) return;
+    resetQueue(index, waitWhenFull);
+    _threadPools[index] = std::move(threadPool);
+    _maxConcurrency[index] = maxConcurrency > 0 ? maxConcurrency : 1;
+    _stopProcessingThread[index] = false;
+  }
+
+  void stopQueue(int32_t index) {
+    if (index < 0 || index >= _queueCount) return;
+    if (_stopProcessingThread[index]) return;
+    _stopProcessingThread[index] = true;
+    std::unique_lock<std::mutex> lock(_queueMutex[index]);
+    lock.unlock();
+    _processingConditionVariable[index].notify_all();
+    _produceConditionVariable[index].notify_all();
+    //No threads are added after the lock above, as addProcessingThread() checks _stopProcessingThread.
+    for (auto &processingThread : _processingThread[index]) {
+      if (processingThread->thread.joinable()) processingThread->thread.join();
+    }
+    _processingThread[index].clear();
+    _counters[index].threads = 0;
+    if (_threadPools[index]) {
+      //Tasks already posted to the pool see the stop flag when they run and end.
+      std::unique_lock<std::mutex> queueLock(_queueMutex[index]);
+      while (!_processingConditionVariable[index].wait_for(queueLock, std::chrono::milliseconds(10), [&] {
+        return _scheduledTasks[index] == 0;
+      }));
+    }
+    std::lock_guard<std::mutex> queueGuard(_queueMutex[index]);
+    uint64_t discarded = _keyedCount[index];
+    for (auto &lane : _lanes[index]) {
+      discarded += lane.entries.size();
+      lane.entries.clear();
+      lane.metrics.depth = 0;
+    }
+    _activeKeys[index].clear();
+    _queuedKeys[index].clear();
+    _coalescingEntries[index].clear();
+    if (_useRing[index]) {
+      //The ring is kept until the next start, so late calls to enqueue() don't need to synchronize with this.
+      BufferEntry bufferEntry;
+      while (_rings[index]->pop(bufferEntry)) discarded++;
+    }
+    _bufferCount[index] = 0;
+    _keyedCount[index] = 0;
+    releaseBytes(index, _queuedBytes[index]);
+    _counters[index].dropped += discarded;
+  }
+
+  /**
+   * Moves "entry" into queue "index". What happens when the queue is full depends on its overload policy (see
+   * setOverloadOptions()). "waitWhenFull" makes this call block regardless of the policy. Entries refused because the
+   * queue is full are destroyed.
+   *
+   * @return Returns false when the entry was refused.
+   */
+  bool enqueue(int32_t index, T entry, bool waitWhenFull = false) {
+    if (index < 0 || index >= _queueCount || _stopProcessingThread[index]) return true;
+    if (_useRing[index]) {
+      BufferEntry bufferEntry;
+      bufferEntry.hasKey = derived().getQueueEntryKey(index, entry, bufferEntry.key);
+      bufferEntry.size = derived().getQueueEntrySize(index, entry);
+      bufferEntry.entry = std::move(entry);
+      bufferEntry.enqueueTime = steadyTime();
+      return enqueueRing(index, bufferEntry, waitWhenFull || _waitWhenFull[index] || _overloadPolicy[index] == OverloadPolicy::block);
+    }
+    uint64_t coalescingKey = 0;
+    bool hasCoalescingKey = _coalescing[index] && derived().getQueueEntryCoalescingKey(index, entry, coalescingKey);
+    uint64_t key = 0;
+    bool hasKey = derived().getQueueEntryKey(index, entry, key);
+    uint32_t priority = derived().getQueueEntryPriority(index, entry);
+    size_t size = derived().getQueueEntrySize(index, entry);
+    int64_t enqueueTime = steadyTime();
+    std::unique_lock<std::mutex> lock(_queueMutex[index]);
+    if (hasCoalescingKey) {
+      //Merging doesn't need space in the buffer, so this is done before waiting.
+      auto queuedEntryIterator = _coalescingEntries[index].find(coalescingKey);
+      if (queuedEntryIterator != _coalescingEntries[index].end()) {
+        if (derived().mergeQueueEntries(index, *queuedEntryIterator->second, entry)) {
+          ++_coalescingMetrics[index].merged;
+          return true;
+        }
+        ++_coalescingMetrics[index].refused;
+      }
+    }
+    uint32_t priorityLane = std::min(priority, (uint32_t)_lanes[index].size() - 1);
+    uint32_t laneIndex = hasKey ? getKeyLane(index, key, priorityLane) : priorityLane;
+    if (!reserveSpace(index, size)) {
+      Counters &counters = _counters[index];
+      if (_waitWhenFull[index] || waitWhenFull || _overloadPolicy[index] == OverloadPolicy::block) {
+        counters.blocked.fetch_add(1, std::memory_order_relaxed);
+        int64_t deadline = getBlockDeadline(index);
+        bool reserved = false;
+        while (!_stopProcessingThread[index] && !(reserved = reserveSpace(index, size))) {
+          if (!waitForSpace(index, lock, deadline)) {
+            counters.timedOut.fetch_add(1, std::memory_order_relaxed);
+            counters.dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+          }
+        }
+        if (!reserved) return true;
+      } else {
+        //Dropping one entry might not free enough bytes. Entries are only dropped while this queue's own limits are
+        //reached. When a shared byte budget is exhausted by other queues, dropping this queue's backlog wouldn't help.
+        Reservation reservation = tryReserveSpace(index, size);
+        while (reservation == Reservation::queueFull && dropForNewEntry(index, laneIndex)) {
+          reservation = tryReserveSpace(index, size);
+        }
+        if (reservation != Reservation::reserved) {
+          counters.rejected.fetch_add(1, std::memory_order_relaxed);
+          counters.dropped.fetch_add(1, std::memory_order_relaxed);
+          return false;
+        }
+      }
+    }
+
+    //Dropping entries might have removed the last queued entry of the key.
+    if (hasKey) laneIndex = addQueuedKey(index, key, priorityLane);
+    Lane &lane = _lanes[index][laneIndex];
+    lane.entries.emplace_back();
+    BufferEntry &bufferEntry = lane.entries.back();
+    bufferEntry.entry = std::move(entry);
+    bufferEntry.key = key;
+    bufferEntry.hasKey = hasKey;
+    bufferEntry.coalescingKey = coalescingKey;
+    bufferEntry.hasCoalescingKey = hasCoalescingKey;
+    bufferEntry.size = size;
+    bufferEntry.enqueueTime = enqueueTime;
+    //Entries of a SegmentedFifo don't move, so the pointer stays valid.
+    if (hasCoalescingKey && _coalescing[index]) _coalescingEntries[index][coalescingKey] = &bufferEntry.entry;
+    ++lane.metrics.enqueued;
+    lane.metrics.depth = lane.entries.size();
+    if (lane.metrics.depth > lane.metrics.highWatermark) lane.metrics.highWatermark = lane.metrics.depth;
+    ++(_bufferCount[index]);
+    _counters[index].enqueued.fetch_add(1, std::memory_order_relaxed);
+    updateHighWatermark(index, _bufferCount[index] + _keyedCount[index]);
+
+    lock.unlock();
+    notifyConsumers(index);
+    return true;
+  }
+
+  /**
+   * Processes a batch of entries dequeued together (see setBatchSize()). Hide this to handle many entries at once,
+   * e.g. to store them in one database transaction. Entries need to be processed in the given order, as a batch can
+   * contain several entries with the same ordering key. The default implementation calls processQueueEntry() for each
+   * entry.
+   */
+  void processQueueEntries(int32_t index, std::vector<T> &entries) {
+    for (auto &entry : entries) {
+      try {
+        derived().processQueueEntry(index, entry);
+      }
+      catch (const std::exception &ex) {
+        std::cerr << "Error in TypedQueue::processQueueEntry: " << ex.what() << std::endl;
+      }
+      catch (...) {
+        std::cerr << "Unknown error in TypedQueue::processQueueEntry" << std::endl;
+      }
+    }
+  }
+
+  bool queueEmpty(int32_t index) {
+    return _bufferCount[index] > 0;
+  }
+
+  /**
+   * Sets the priority lanes of queue "index". Takes effect at the next call to startQueue(). The buffer size is shared
+   * by all lanes.
+   */
+  void setPriorityOptions(int32_t index, const PriorityOptions &options) {
+    if (index < 0 || index >= _queueCount) return;
+    std::lock_guard<std::mutex> queueGuard(_queueMutex[index]);
+    _priorityOptions[index] = options;
+    if (_priorityOptions[index].laneCount == 0) _priorityOptions[index].laneCount = 1;
+  }
+
+  /**
+   * Returns the depth and counters of each lane of queue "index". The counters are reset by startQueue().
+   */
+  std::vector<LaneMetrics> getLaneMetrics(int32_t index) {
+    std::vector<LaneMetrics> metrics;
+    if (index < 0 || index >= _queueCount) return metrics;
+    std::lock_guard<std::mutex> queueGuard(_queueMutex[index]);
+    if (_useRing[index]) {
+      LaneMetrics ringMetrics;
+      ringMetrics.depth = _rings[index]->size();
+      ringMetrics.highWatermark = _counters[index].highWatermark;
+      ringMetrics.enqueued = _rings[index]->pushed();
+      ringMetrics.dequeued = _rings[index]->popped();
+      metrics.push_back(ringMetrics);
+      return metrics;
+    }
+    metrics.reserve(_lanes[index].size());
+    for (auto &lane : _lanes[index]) {
+      metrics.push_back(lane.metrics);
+    }
+    return metrics;
+  }
+
+  /**
+   * Enables or disables coalescing for queue "index". When enabled, an entry with the same coalescing key as an entry
+   * that is still queued is merged into the queued entry instead of being queued (see getQueueEntryCoalescingKey()).
+   * Entries are only merged while the queue has a backlog, so the work per queued entry stays bounded by the number
+   * of distinct keys. Disabled by default.
+   */
+  void setCoalescing(int32_t index, bool enabled) {
+    if (index < 0 || index >= _queueCount) return;
+    std::lock_guard<std::mutex> queueGuard(_queueMutex[index]);
+    _coalescing[index] = enabled;
+    if (!enabled) _coalescingEntries[index].clear();
+  }
+
+  CoalescingMetrics getCoalescingMetrics(int32_t index) {
+    if (index < 0 || index >= _queueCount) return CoalescingMetrics();
+    std::lock_guard<std::mutex> queueGuard(_queueMutex[index]);
+    CoalescingMetrics metrics = _coalescingMetrics[index];
+    metrics.pending = _coalescingEntries[index].size();
+    return metrics;
+  }
+
+  /**
+   * Returns the depth and counters of queue "index". The counters are always on and reset by startQueue(). Merged
+   * entries (see setCoalescing()) are counted in getCoalescingMetrics() only.
+   */
+  QueueMetrics getMetrics(int32_t index) {
+    QueueMetrics metrics;
+    if (index < 0 || index >= _queueCount) return metrics;
+    {
+      std::lock_guard<std::mutex> queueGuard(_queueMutex[index]);
+      metrics.depth = (_useRing[index] ? _rings[index]->size() : _bufferCount[index].load()) + _keyedCount[index];
+      metrics.memoryUsage = getQueueMemoryUsage(index);
+      metrics.bytes = _queuedBytes[index];
+    }
+    Counters &counters = _counters[index];
+    metrics.highWatermark = counters.highWatermark;
+    metrics.enqueued = counters.enqueued;
+    metrics.dequeued = counters.dequeued;
+    metrics.dropped = counters.dropped;
+    metrics.waitTime = counters.waitTime.snapshot();
+    metrics.processingTime = counters.processingTime.snapshot();
+    return metrics;
+  }
+
+  /**
+   * Sets what enqueue() does when queue "index" is full (see OverloadPolicy). The default is to refuse new entries.
+   * Queues in lock-free mode (see setLockFree()) can't drop queued entries, so OverloadPolicy::dropOldest and
+   * OverloadPolicy::shedByPriority refuse new entries there. Can be changed at any time.
+   */
+  void setOverloadOptions(int32_t index, const OverloadOptions &options) {
+    if (index < 0 || index >= _queueCount) return;
+    _overloadPolicy[index] = options.policy;
+    _blockTimeout[index] = options.timeout;
+  }
+
+  /**
+   * Limits the total size of the entries of queue "index" as returned by getQueueEntrySize() to "bytes". The queue
+   * counts as full when either the byte limit or the buffer size is reached (see setOverloadOptions()). An entry
+   * larger than the limit is accepted when the queue holds no other sized entries. 0 disables the limit, which is the
+   * default. Can be changed at any time.
+   */
+  void setByteLimit(int32_t index, size_t bytes) {
+    if (index < 0 || index >= _queueCount) return;
+    _byteLimit[index] = bytes;
+  }
+
+  /**
+   * Makes queue "index" acquire the size of its entries from "budget", which can be shared with other queues. With
+   * "enforce" set, enqueue() refuses new entries while the budget is exhausted or blocks for OverloadPolicy::block.
+   * OverloadPolicy::dropOldest and OverloadPolicy::shedByPriority don't drop queued entries for the budget, only for the
+   * queue's own limits, as that would just free the budget for other queues. Otherwise the entries are only accounted and the producer throttles itself, e.g. with ByteBudget::waitForSpace(). Blocked calls
+   * to enqueue() check a shared budget every 10 ms. Takes effect at the next call to startQueue(). nullptr removes the
+   * budget.
+   */
+  void setByteBudget(int32_t index, std::shared_ptr<ByteBudget> budget, bool enforce = true) {
+    if (index < 0 || index >= _queueCount) return;
+    std::lock_guard<std::mutex> queueGuard(_queueMutex[index]);
+    _byteBudgets[index].budget = std::move(budget);
+    _byteBudgets[index].enforce = enforce;
+  }
+
+  /**
+   * Returns the counters of the overload policies of queue "index". The counters are reset by startQueue().
+   */
+  OverloadMetrics getOverloadMetrics(int32_t index) {
+    OverloadMetrics metrics;
+    if (index < 0 || index >= _queueCount) return metrics;
+    Counters &counters = _counters[index];
+    metrics.rejected = counters.rejected;
+    metrics.evicted = counters.evicted;
+    metrics.shed = counters.shed;
+    metrics.blocked = counters.blocked;
+    metrics.timedOut = counters.timedOut;
+    return metrics;
+  }
+
+  /**
+   * Returns the bytes allocated for storing the entries of all queues (see QueueMetrics::memoryUsage).
+   */
+  size_t getMemoryUsage() {
+    size_t memoryUsage = 0;
+    for (int32_t i = 0; i < _queueCount; i++) {
+      std::lock_guard<std::mutex> queueGuard(_queueMutex[i]);
+      memoryUsage += getQueueMemoryUsage(i);
+    }
+    return memoryUsage;
+  }
+
+  /**
+   * Stores the entries of queue "index" in a lock-free ring (see MpmcRing) instead of lanes protected by the queue
+   * mutex, so producers and consumers don't contend on a lock. Takes effect at the next call to startQueue().
+   *
+   * The ring only has one lane and doesn't support coalescing, so getQueueEntryPriority() is not called and
+   * setCoalescing() has no effect. Ordering keys work, but enqueueing entries with a key takes the queue mutex. The
+   * ring has room for the buffer size rounded up to a power of two. It is allocated in segments while it fills up, but
+   * only freed when the queue is restarted or destroyed.
+   */
+  void setLockFree(int32_t index, bool lockFree) {
+    if (index < 0 || index >= _queueCount) return;
+    std::lock_guard<std::mutex> queueGuard(_queueMutex[index]);
+    _lockFree[index] = lockFree;
+  }
+
+  /**
+   * Sets the maximum number of entries a processing thread dequeues at once and passes to processQueueEntries(). The
+   * default is 1. Larger batches take the queue lock less often, but entries of one batch are processed by one thread
+   * one after another. Can be changed at any time.
+   */
+  void setBatchSize(int32_t index, uint32_t batchSize) {
+    if (index < 0 || index >= _queueCount) return;
+    _batchSize[index] = batchSize > 0 ? batchSize : 1;
+  }
+
+  /**
+   * Sets how the processing threads of queue "index" wait for new entries (see WaitStrategy). The default is
+   * WaitStrategy::blocking. Queues running on a thread pool don't wait, so this has no effect for them. Can be changed
+   * at any time.
+   */
+  void setWaitStrategy(int32_t index, WaitStrategy strategy) {
+    if (index < 0 || index >= _queueCount) return;
+    _waitStrategy[index] = strategy;
+  }
+
+  /**
+   * Sets the name, CPU affinity and scheduling policy of the processing threads of queue "index" (see ThreadOptions).
+   * Takes effect at the next call to startQueue(). Queues running on a thread pool use the pool's threads, so set the
+   * options of the pool instead.
+   */
+  void setThreadOptions(int32_t index, const ThreadOptions &options) {
+    if (index < 0 || index >= _queueCount) return;
+    std::lock_guard<std::mutex> queueGuard(_queueMutex[index]);
+    _threadOptions[index] = options;
+  }
+
+  /**
+   * Lets the number of processing threads of queue "index" follow the load (see ScalingOptions). Takes effect at the
+   * next call to startQueue(). Queues running on a thread pool use "maxConcurrency" instead.
+   */
+  void setScalingOptions(int32_t index, const ScalingOptions &options) {
+    if (index < 0 || index >= _queueCount) return;
+    std::lock_guard<std::mutex> queueGuard(_queueMutex[index]);
+    _scalingOptions[index] = options;
+  }
+
+  /**
+   * Returns the processing thread count of queue "index" and the scaling decisions. The counters are reset by
+   * startQueue().
+   */
+  ScalingMetrics getScalingMetrics(int32_t index) {
+    ScalingMetrics metrics;
+    if (index < 0 || index >= _queueCount) return metrics;
+    Counters &counters = _counters[index];
+    metrics.threads = counters.threads;
+    metrics.peakThreads = counters.peakThreads;
+    metrics.scaleUps = counters.scaleUps;
+    metrics.scaleUpsByWaitTime = counters.scaleUpsByWaitTime;
+    metrics.scaleDowns = counters.scaleDowns;
+    return metrics;
+  }
+ protected:
+  /**
+   * Returns the ordering key of "entry". Entries with the same key are processed one after another in the order they
+   * were queued, even when the queue has multiple processing threads. Entries with different keys and entries without
+   * key are processed in parallel. Called by enqueue() on the queueing thread.
+   *
+   * @param index The queue index.
+   * @param entry The entry to be queued.
+   * @param[out] key The key of the entry.
+   * @return Return false when the entry has no key. The default implementation always returns false.
+   */
+  bool getQueueEntryKey(int32_t index, T &entry, uint64_t &key) { return false; }
+
+  /**
+   * Returns the priority lane of "entry" (see PriorityOptions). Values past the last lane select the last lane. While
+   * entries with the same ordering key (see getQueueEntryKey()) are queued, "entry" goes to their lane instead, so the
+   * entries of a key stay in order. Called by enqueue() on the queueing thread. The default implementation returns 0.
+   */
+  uint32_t getQueueEntryPriority(int32_t index, T &entry) { return 0; }
+
+  /**
+   * Returns the coalescing key of "entry". Only called when coalescing is enabled (see setCoalescing()). Called by
+   * enqueue() on the queueing thread before getQueueEntryKey() and getQueueEntryPriority().
+   *
+   * @return Return false when the entry can't be merged. The default implementation always returns false.
+   */
+  bool getQueueEntryCoalescingKey(int32_t index, T &entry, uint64_t &key) { return false; }
+
+  /**
+   * Returns the size of "entry" in bytes for the byte limit and budget (see setByteLimit() and setByteBudget()).
+   * Called by enqueue() on the queueing thread. The default implementation returns 0, so entries are only limited by
+   * count.
+   */
+  size_t getQueueEntrySize(int32_t index, T &entry) { return 0; }
+
+  /**
+   * Merges "entry" into "queuedEntry", which has the same coalescing key and has not been dequeued yet. Called with
+   * the queue locked, so this should be fast.
+   *
+   * @return Return false to queue "entry" normally, e.g. when the keys only collided.
+   */
+  bool mergeQueueEntries(int32_t index, T &queuedEntry, T &entry) { return false; }
+ private:
+  struct BufferEntry {
+    T entry;
+    uint64_t key = 0;
+    bool hasKey = false;
+    uint64_t coalescingKey = 0;
+    bool hasCoalescingKey = false;
+    size_t size = 0;
+    int64_t enqueueTime = 0;
+  };
+
+  struct Lane {
+    SegmentedFifo<BufferEntry> entries;
+    LaneMetrics metrics;
+
+    //Scheduling state, see selectLane()
+    uint32_t passedOver = 0;
+    int64_t credit = 0;
+  };
+
+  //Written by producers and by consumers respectively. The padding keeps them on different cache lines.
+  struct Counters {
+    std::atomic<uint64_t> enqueued{0};
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<uint32_t> highWatermark{0};
+    std::atomic<uint64_t> rejected{0};
+    std::atomic<uint64_t> evicted{0};
+    std::atomic<uint64_t> shed{0};
+    std::atomic<uint64_t> blocked{0};
+    std::atomic<uint64_t> timedOut{0};
+    char padding[64];
+    std::atomic<uint64_t> dequeued{0};
+    std::atomic<uint32_t> threads{0};
+    std::atomic<uint32_t> peakThreads{0};
+    std::atomic<uint64_t> scaleUps{0};
+    std::atomic<uint64_t> scaleUpsByWaitTime{0};
+    std::atomic<uint64_t> scaleDowns{0};
+    std::atomic<int64_t> lastScaleUp{0};
+    LatencyHistogram waitTime;
+    LatencyHistogram processingTime;
+  };
+
+  int32_t _bufferSize = 10000;
+  std::unique_ptr<std::atomic<int32_t>[]> _bufferCount;
+  std::vector<bool> _waitWhenFull;
+  std::vector<PriorityOptions> _priorityOptions;
+  std::vector<std::vector<Lane>> _lanes;
+
+  /**
+   * The keys currently being processed. Entries dequeued while their key is processed by another thread are moved to
+   * the key's deque and processed by that thread afterwards. Entries can still be merged into them (see
+   * setCoalescing()).
+   */
+  std::vector<std::unordered_map<uint64_t, SegmentedFifo<BufferEntry>>> _activeKeys;
+
+  /**
+   * The number of entries in _activeKeys. They still count towards the buffer size.
+   */
+  std::vector<int32_t> _keyedCount;
+
+  /**
+   * The lane and the number of the queued entries of each ordering key when the queue has more than one lane. New
+   * entries with the key go to the same lane regardless of their priority. Otherwise an entry in a higher priority lane
+   * could be dequeued before older entries of its key.
+   */
+  struct QueuedKey {
+    uint32_t lane = 0;
+    uint32_t count = 0;
+  };
+  std::vector<std::unordered_map<uint64_t, QueuedKey>> _queuedKeys;
+
+  /**
+   * Points to the queued entry of each coalescing key. The pointer is updated when the entry moves to _activeKeys.
+   */
+  std::unique_ptr<std::atomic_bool[]> _coalescing;
+  std::vector<std::unordered_map<uint64_t, T *>> _coalescingEntries;
+  std::vector<CoalescingMetrics> _coalescingMetrics;
+
+  //Lock-free mode, see setLockFree(). The counters of waiting threads tell the other side whether it needs to notify.
+  std::vector<bool> _lockFree;
+  std::unique_ptr<std::atomic_bool[]> _useRing;
+  std::vector<std::unique_ptr<MpmcRing<BufferEntry>>> _rings;
+  std::unique_ptr<std::atomic<uint32_t>[]> _waitingConsumers;
+  std::unique_ptr<std::atomic<uint32_t>[]> _waitingProducers;
+
+  std::unique_ptr<Counters[]> _counters;
+  std::unique_ptr<std::atomic<uint32_t>[]> _batchSize;
+  std::unique_ptr<std::atomic<WaitStrategy>[]> _waitStrategy;
+  std::unique_ptr<std::atomic<OverloadPolicy>[]> _overloadPolicy;
+  std::unique_ptr<std::atomic<uint32_t>[]> _blockTimeout;
+
+  //Byte accounting, see setByteLimit() and setByteBudget(). _activeByteBudgets is set from _byteBudgets on start.
+  struct ByteBudgetSettings {
+    std::shared_ptr<ByteBudget> budget;
+    bool enforce = true;
+  };
+  //Why tryReserveSpace() failed: The queue's own count or byte limit is reached, or a shared budget is exhausted.
+  enum class Reservation {
+    reserved,
+    queueFull,
+    budgetExhausted
+  };
+  std::unique_ptr<std::atomic<size_t>[]> _byteLimit;
+  std::unique_ptr<std::atomic<size_t>[]> _queuedBytes;
+  std::vector<ByteBudgetSettings> _byteBudgets;
+  std::vector<ByteBudgetSettings> _activeByteBudgets;
+
+  //Thread pool mode, see startQueue(). _scheduledTasks is the number of tasks posted to the pool and not finished yet.
+  std::vector<std::shared_ptr<ThreadPool>> _threadPools;
+  std::vector<uint32_t> _maxConcurrency;
+  std::unique_ptr<std::atomic<uint32_t>[]> _scheduledTasks;
+
+  //A dedicated processing thread. "finished" is set when it leaves process(), so its slot can be reused.
+  struct ProcessingThread {
+    std::thread thread;
+    std::atomic_bool finished{false};
+  };
+
+  std::unique_ptr<std::mutex[]> _queueMutex = nullptr;
+  std::vector<std::vector<std::unique_ptr<ProcessingThread>>> _processingThread;
+  //See setScalingOptions(). _activeScalingOptions is set from _scalingOptions on start.
+  std::vector<ScalingOptions> _scalingOptions;
+  std::vector<ScalingOptions> _activeScalingOptions;
+  //See setThreadOptions(). _activeThreadOptions is set from _threadOptions on start.
+  std::vector<ThreadOptions> _threadOptions;
+  std::vector<ThreadOptions> _activeThreadOptions;
+  std::unique_ptr<std::condition_variable[]> _produceConditionVariable = nullptr;
+  std::unique_ptr<std::condition_variable[]> _processingConditionVariable = nullptr;
+
+  Derived &derived() { return static_cast<Derived &>(*this); }
+
+  void resetQueue(int32_t index, bool waitWhenFull) {
+    std::lock_guard<std::mutex> queueGuard(_queueMutex[index]);
+    _lanes[index].clear();
+    _lanes[index].resize(_priorityOptions[index].laneCount);
+    _bufferCount[index] = 0;
+    _keyedCount[index] = 0;
+    _queuedKeys[index].clear();
+    _coalescingEntries[index].clear();
+    _coalescingMetrics[index] = CoalescingMetrics();
+    _waitWhenFull[index] = waitWhenFull;
+    _useRing[index] = _lockFree[index];
+    _rings[index].reset(_lockFree[index] ? new MpmcRing<BufferEntry>(_bufferSize) : nullptr);
+    _counters[index].enqueued = 0;
+    _counters[index].dequeued = 0;
+    _counters[index].dropped = 0;
+    _counters[index].highWatermark = 0;
+    _counters[index].rejected = 0;
+    _counters[index].evicted = 0;
+    _counters[index].shed = 0;
+    _counters[index].blocked = 0;
+    _counters[index].timedOut = 0;
+    _counters[index].threads = 0;
+    _counters[index].peakThreads = 0;
+    _counters[index].scaleUps = 0;
+    _counters[index].scaleUpsByWaitTime = 0;
+    _counters[index].scaleDowns = 0;
+    _counters[index].lastScaleUp = 0;
+    _counters[index].waitTime.reset();
+    _counters[index].processingTime.reset();
+    _threadPools[index].reset();
+    _scheduledTasks[index] = 0;
+    //Entries queued by enqueue() calls racing with stopQueue() are discarded with the old ring.
+    releaseBytes(index, _queuedBytes[index]);
+    _activeByteBudgets[index] = _byteBudgets[index];
+    _activeThreadOptions[index] = _threadOptions[index];
+    _activeScalingOptions[index] = _scalingOptions[index];
+  }
+
+  /**
+   * Starts a processing thread for queue "index" in a free slot. Must be called with the queue locked.
+   */
+  void addProcessingThread(int32_t index) {
+    if (_stopProcessingThread[index]) return;
+    std::vector<std::unique_ptr<ProcessingThread>> &processingThreads = _processingThread[index];
+    uint32_t threadIndex = 0;
+    while (threadIndex < processingThreads.size() && !processingThreads[threadIndex]->finished) threadIndex++;
+    if (threadIndex == processingThreads.size()) processingThreads.emplace_back(new ProcessingThread());
+    ProcessingThread &processingThread = *processingThreads[threadIndex];
+    //A finished thread doesn't touch the queue anymore, so this doesn't wait for the lock we hold.
+    if (processingThread.thread.joinable()) processingThread.thread.join();
+    processingThread.finished = false;
+    processingThread.thread = std::thread(&TypedQueue::process, this, index, threadIndex, &processingThread);
+
+    Counters &counters = _counters[index];
+    uint32_t threads = ++counters.threads;
+    if (threads > counters.peakThreads) counters.peakThreads = threads;
+  }
+
+  /**
+   * Adds a processing thread to queue "index" when the queue backs up (see ScalingOptions).
+   *
+   * @param waitTime The time the oldest entry of the last batch waited in nanoseconds.
+   */
+  void scaleUp(int32_t index, int64_t waitTime) {
+    const ScalingOptions &options = _activeScalingOptions[index];
+    Counters &counters = _counters[index];
+    uint32_t threads = counters.threads;
+    if (threads >= options.maxThreads) return;
+    bool waitedTooLong = options.waitTime != 0 && waitTime > (int64_t)options.waitTime * 1000000;
+    //Entries waiting for their ordering key aren't counted, as more threads can't process them any sooner.
+    uint32_t depth = _useRing[index] ? _rings[index]->size() : _bufferCount[index].load(std::memory_order_relaxed);
+    if (!waitedTooLong && depth <= (uint64_t)options.depthPerThread * threads) return;
+
+    int64_t time = steadyTime();
+    int64_t lastScaleUp = counters.lastScaleUp;
+    if (lastScaleUp != 0 && time - lastScaleUp < (int64_t)options.scaleUpInterval * 1000000) return;
+    //Only one of the threads seeing the backlog adds a thread.
+    if (!counters.lastScaleUp.compare_exchange_strong(lastScaleUp, time)) return;
+
+    std::lock_guard<std::mutex> queueGuard(_queueMutex[index]);
+    if (_stopProcessingThread[index] || counters.threads >= options.maxThreads) return;
+    addProcessingThread(index);
+    ++counters.scaleUps;
+    if (waitedTooLong) ++counters.scaleUpsByWaitTime;
+  }
+
+  /**
+   * Removes the calling thread from the processing threads of queue "index" unless only the minimum is left.
+   *
+   * @return Returns true when the thread needs to exit.
+   */
+  bool scaleDown(int32_t index) {
+    Counters &counters = _counters[index];
+    uint32_t minThreads = std::max(_activeScalingOptions[index].minThreads, (uint32_t)1);
+    uint32_t threads = counters.threads;
+    do {
+      if (threads <= minThreads) return false;
+    } while (!counters.threads.compare_exchange_weak(threads, threads - 1));
+    ++counters.scaleDowns;
+    return true;
+  }
+
+  /**
+   * The loop of dedicated processing threads. "threadIndex" numbers the threads of a queue.
+   */
+  void process(int32_t index, uint32_t threadIndex, ProcessingThread *processingThread) {
+    _activeThreadOptions[index].apply(threadIndex);
+    const ScalingOptions &scalingOptions = _activeScalingOptions[index];
+    bool scaling = scalingOptions.maxThreads > 0;
+    std::vector<T> batch;
+    std::vector<uint64_t> activatedKeys;
+    int64_t idleSince = 0;
+    while (!_stopProcessingThread[index]) {
+      try {
+        int64_t waitTime = 0;
+        if (processBatch(index, batch, activatedKeys, waitTime)) {
+          idleSince = 0;
+          if (scaling) scaleUp(index, waitTime);
+          continue;
+        }
+        if (scaling) {
+          //waitForEntries() returns after one second at the latest, so idle threads get here regularly.
+          int64_t time = steadyTime();
+          if (idleSince == 0) idleSince = time;
+          else if (time - idleSince >= (int64_t)scalingOptions.idleTime * 1000000 && scaleDown(index)) break;
+        }
+        waitForEntries(index);
+      }
+      catch (const std::exception &ex) {
+        std::cerr << "Error in TypedQueue::process: " << ex.what() << std::endl;
+      }
+      catch (...) {
+        std::cerr << "Unknown error in TypedQueue::process" << std::endl;
+      }
+    }
+    processingThread->finished = true;
+  }
+
+  /**
+   * Dequeues up to the batch size of entries and processes them. Doesn't wait for entries.
+   *
+   * @param waitTime Set to the time the first dequeued entry waited in nanoseconds.
+   * @return Returns false when the queue was empty.
+   */
+  bool processBatch(int32_t index, std::vector<T> &batch, std::vector<uint64_t> &activatedKeys, int64_t &waitTime) {
+    uint32_t batchSize = _batchSize[index];
+    batch.clear();
+
+    if (_useRing[index]) {
+      MpmcRing<BufferEntry> &ring = *_rings[index];
+      BufferEntry bufferEntry;
+      if (!ring.pop(bufferEntry)) return false;
+
+      //Each pop is a CAS of its own. Entries with a key were already marked as active by enqueueRing().
+      size_t popped = 0;
+      int64_t time = steadyTime();
+      waitTime = time > bufferEntry.enqueueTime ? time - bufferEntry.enqueueTime : 0;
+      do {
+        popped++;
+        recordDequeue(index, bufferEntry, time);
+        releaseBytes(index, bufferEntry.size);
+        if (bufferEntry.hasKey) activatedKeys.push_back(bufferEntry.key);
+        batch.push_back(std::move(bufferEntry.entry));
+      } while (popped < batchSize && ring.pop(bufferEntry));
+      notifyProducers(index, popped);
+
+      processEntries(index, batch, time);
+      if (activatedKeys.empty()) return true;
+
+      std::unique_lock<std::mutex> lock(_queueMutex[index]);
+      drainKeys(index, lock, activatedKeys, batch);
+      return true;
+    }
+
+    std::unique_lock<std::mutex> lock(_queueMutex[index]);
+    if (_bufferCount[index] == 0) return false;
+    size_t dequeued = 0;
+    int64_t time = steadyTime();
+    while (_bufferCount[index] > 0 && dequeued < batchSize) {
+      Lane &lane = _lanes[index][selectLane(index)];
+      //Admitted in place, so the coalescing entry still points to it (see releaseCoalescingKey()).
+      BufferEntry &bufferEntry = lane.entries.front();
+      if (dequeued == 0) waitTime = time > bufferEntry.enqueueTime ? time - bufferEntry.enqueueTime : 0;
+      removeQueuedKey(index, bufferEntry);
+      if (admitEntry(index, bufferEntry, activatedKeys)) {
+        recordDequeue(index, bufferEntry, time);
+        releaseBytes(index, bufferEntry.size);
+        batch.push_back(std::move(bufferEntry.entry));
+      }
+      lane.entries.pop_front();
+      ++lane.metrics.dequeued;
+      lane.metrics.depth = lane.entries.size();
+      --_bufferCount[index];
+      dequeued++;
+    }
+
+    lock.unlock();
+    notifyProducers(index, dequeued);
+    processEntries(index, batch, time);
+
+    if (!activatedKeys.empty()) {
+      lock.lock();
+      drainKeys(index, lock, activatedKeys, batch);
+    }
+    return true;
+  }
+
+  /**
+   * Waits until the queue has entries or is stopped, using the queue's wait strategy. Returns after one second at the
+   * latest.
+   */
+  void waitForEntries(int32_t index) {
+    SpinWait spinWait(_waitStrategy[index]);
+    while (spinWait.next()) {
+      if (_stopProcessingThread[index]) return;
+      if (_useRing[index] ? _rings[index]->size() > 0 : _bufferCount[index].load(std::memory_order_relaxed) > 0) return;
+    }
+
+    std::unique_lock<std::mutex> lock(_queueMutex[index]);
+    if (_useRing[index]) {
+      ++_waitingConsumers[index];
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (_rings[index]->size() == 0 && !_stopProcessingThread[index]) {
+        _processingConditionVariable[index].wait_for(lock, std::chrono::milliseconds(1000));
+      }
+      --_waitingConsumers[index];
+    } else {
+      _processingConditionVariable[index].wait_for(lock, std::chrono::milliseconds(1000), [&] {
+        return _bufferCount[index] > 0 || _stopProcessingThread[index];
+      });
+    }
+  }
+
+  /**
+   * Wakes up a processing thread or schedules a pool task after an entry was queued.
+   */
+  void notifyConsumers(int32_t index) {
+    if (_threadPools[index]) {
+      schedulePoolTask(index);
+    } else if (_useRing[index]) {
+      //Pairs with the fence in waitForEntries(): Either the consumer sees the entry or we see the consumer waiting.
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (_waitingConsumers[index].load(std::memory_order_relaxed) == 0) return;
+      {
+        std::lock_guard<std::mutex> queueGuard(_queueMutex[index]);
+      }
+      _processingConditionVariable[index].notify_one();
+    } else _processingConditionVariable[index].notify_one();
+  }
+
+  /**
+   * Wakes up threads waiting in enqueue() for free space after "freedEntries" were dequeued.
+   */
+  void notifyProducers(int32_t index, size_t freedEntries) {
+    if (freedEntries == 0) return;
+    if (_useRing[index]) {
+      //Pairs with the fence in enqueueRing(): Either the producer sees the free cell or we see the producer waiting.
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (_waitingProducers[index].load(std::memory_order_relaxed) == 0) return;
+      //Taking the lock makes sure the producer is already waiting and doesn't miss the notification.
+      std::lock_guard<std::mutex> queueGuard(_queueMutex[index]);
+    }
+    if (freedEntries == 1) _produceConditionVariable[index].notify_one();
+    else _produceConditionVariable[index].notify_all();
+  }
+
+  /**
+   * Posts a task to the thread pool unless "maxConcurrency" tasks are scheduled already.
+   */
+  void schedulePoolTask(int32_t index) {
+    uint32_t scheduledTasks = _scheduledTasks[index].load();
+    while (scheduledTasks < _maxConcurrency[index]) {
+      if (_scheduledTasks[index].compare_exchange_weak(scheduledTasks, scheduledTasks + 1)) {
+        if (!_threadPools[index]->post(std::bind(&TypedQueue::runPoolTask, this, index))) {
+          //The pool is shutting down. stopQueue() waits for the counter, so the task must not be counted.
+          --_scheduledTasks[index];
+          _processingConditionVariable[index].notify_all();
+        }
+        return;
+      }
+    }
+  }
+
+  void runPoolTask(int32_t index) {
+    //Batches processed before the task reposts itself behind the other tasks of the worker, so a busy queue doesn't
+    //monopolize the worker.
+    static const uint32_t batchesPerTask = 16;
+    static thread_local std::vector<T> batch;
+    static thread_local std::vector<uint64_t> activatedKeys;
+    bool drained = false;
+    int64_t waitTime = 0;
+    try {
+      for (uint32_t i = 0; i < batchesPerTask && !_stopProcessingThread[index]; i++) {
+        if (!processBatch(index, batch, activatedKeys, waitTime)) {
+          drained = true;
+          break;
+        }
+      }
+    }
+    catch (const std::exception &ex) {
+      std::cerr << "Error in TypedQueue::runPoolTask: " << ex.what() << std::endl;
+    }
+    catch (...) {
+      std::cerr << "Unknown error in TypedQueue::runPoolTask" << std::endl;
+    }
+
+    if (!drained && !_stopProcessingThread[index] && _threadPools[index]->post(std::bind(&TypedQueue::runPoolTask, this, index), true)) return;
+
+    //Holding the mutex keeps stopQueue() from returning before this task stops using the queue.
+    std::lock_guard<std::mutex> queueGuard(_queueMutex[index]);
+    --_scheduledTasks[index];
+    if (_stopProcessingThread[index]) {
+      _processingConditionVariable[index].notify_all();
+      return;
+    }
+    //An entry queued after processBatch() found the queue empty might have seen no free task slot.
+    bool entriesLeft = _bufferCount[index] > 0;
+    if (_useRing[index]) {
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      entriesLeft = _rings[index]->size() > 0;
+    }
+    if (entriesLeft) schedulePoolTask(index);
+  }
+
+  /**
+   * enqueue() for queues in lock-free mode.
+   */
+  bool enqueueRing(int32_t index, BufferEntry &bufferEntry, bool waitWhenFull) {
+    MpmcRing<BufferEntry> &ring = *_rings[index];
+    Counters &counters = _counters[index];
+    if (bufferEntry.hasKey) {
+      //Entries with a key are serialized here instead of by the processing threads, because the order of two pops
+      //can't be restored afterwards: Only the oldest entry of a key is in the ring. The others wait in the key's deque
+      //and are processed by the thread processing the key (see drainKeys()).
+      uint64_t key = bufferEntry.key;
+      bool queued = false;
+      bool timedOut = false;
+      int64_t deadline = 0;
+      std::unique_lock<std::mutex> lock(_queueMutex[index]);
+      ++_waitingProducers[index];
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      for (bool blocked = false; !_stopProcessingThread[index]; blocked = true) {
+        auto activeKeyIterator = _activeKeys[index].find(key);
+        if (activeKeyIterator != _activeKeys[index].end()) {
+          if (_keyedCount[index] < _bufferSize && reserveBytes(index, bufferEntry.size)) {
+            activeKeyIterator->second.push_back(std::move(bufferEntry));
+            ++_keyedCount[index];
+            --_waitingProducers[index];
+            counters.enqueued.fetch_add(1, std::memory_order_relaxed);
+            updateHighWatermark(index, ring.size() + _keyedCount[index]);
+            return true;
+          }
+        } else if (pushRing(index, bufferEntry)) {
+          _activeKeys[index].emplace(key, SegmentedFifo<BufferEntry>());
+          queued = true;
+          break;
+        }
+        if (!waitWhenFull) break;
+        if (!blocked) {
+          counters.blocked.fetch_add(1, std::memory_order_relaxed);
+          deadline = getBlockDeadline(index);
+        }
+        if (!waitForSpace(index, lock, deadline)) {
+          timedOut = true;
+          break;
+        }
+      }
+      --_waitingProducers[index];
+      if (!queued) {
+        if (_stopProcessingThread[index]) return true;
+        (timedOut ? counters.timedOut : counters.rejected).fetch_add(1, std::memory_order_relaxed);
+        counters.dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+      }
+    } else if (!pushRing(index, bufferEntry)) {
+      if (!waitWhenFull) {
+        counters.rejected.fetch_add(1, std::memory_order_relaxed);
+        counters.dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+      }
+      counters.blocked.fetch_add(1, std::memory_order_relaxed);
+      int64_t deadline = getBlockDeadline(index);
+      std::unique_lock<std::mutex> lock(_queueMutex[index]);
+      ++_waitingProducers[index];
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      while (!pushRing(index, bufferEntry)) {
+        if (_stopProcessingThread[index]) {
+          --_waitingProducers[index];
+          return true;
+        }
+        if (!waitForSpace(index, lock, deadline)) {
+          --_waitingProducers[index];
+          counters.timedOut.fetch_add(1, std::memory_order_relaxed);
+          counters.dropped.fetch_add(1, std::memory_order_relaxed);
+          return false;
+        }
+      }
+      --_waitingProducers[index];
+    }
+
+    counters.enqueued.fetch_add(1, std::memory_order_relaxed);
+    updateHighWatermark(index, ring.size());
+
+    notifyConsumers(index);
+    return true;
+  }
+
+  /**
+   * Reserves the bytes of "bufferEntry" and pushes it into the ring of queue "index".
+   *
+   * @return Returns false when the ring is full or the bytes don't fit.
+   */
+  bool pushRing(int32_t index, BufferEntry &bufferEntry) {
+    if (!reserveBytes(index, bufferEntry.size)) return false;
+    if (_rings[index]->push(bufferEntry)) return true;
+    releaseBytes(index, bufferEntry.size);
+    return false;
+  }
+
+  /**
+   * Reserves space for an entry of "size" bytes in queue "index" in locked mode. Must be called with the queue locked.
+   *
+   * @return Returns false when the queue is full.
+   */
+  bool reserveSpace(int32_t index, size_t size) {
+    return tryReserveSpace(index, size) == Reservation::reserved;
+  }
+
+  /**
+   * Like reserveSpace(), but tells why no space was reserved.
+   */
+  Reservation tryReserveSpace(int32_t index, size_t size) {
+    if (_bufferCount[index] + _keyedCount[index] >= _bufferSize) return Reservation::queueFull;
+    return tryReserveBytes(index, size);
+  }
+
+  /**
+   * Adds "size" to the bytes of queue "index" and acquires them from the queue's byte budget.
+   *
+   * @return Returns false when the bytes exceed the byte limit or an enforced budget.
+   */
+  bool reserveBytes(int32_t index, size_t size) {
+    return tryReserveBytes(index, size) == Reservation::reserved;
+  }
+
+  /**
+   * Like reserveBytes(), but tells why the bytes weren't reserved.
+   */
+  Reservation tryReserveBytes(int32_t index, size_t size) {
+    if (size == 0) return Reservation::reserved;
+    size_t byteLimit = _byteLimit[index];
+    size_t queuedBytes = _queuedBytes[index].load(std::memory_order_relaxed);
+    do {
+      if (byteLimit != 0 && queuedBytes != 0 && queuedBytes + size > byteLimit) return Reservation::queueFull;
+    } while (!_queuedBytes[index].compare_exchange_weak(queuedBytes, queuedBytes + size, std::memory_order_relaxed));
+    ByteBudget *budget = _activeByteBudgets[index].budget.get();
+    if (budget) {
+      if (!_activeByteBudgets[index].enforce) budget->acquire(size);
+      else if (!budget->tryAcquire(size)) {
+        _queuedBytes[index].fetch_sub(size, std::memory_order_relaxed);
+        return Reservation::budgetExhausted;
+      }
+    }
+    return Reservation::reserved;
+  }
+
+  /**
+   * Gives back the bytes of an entry that left queue "index".
+   */
+  void releaseBytes(int32_t index, size_t size) {
+    if (size == 0) return;
+    _queuedBytes[index].fetch_sub(size, std::memory_order_relaxed);
+    if (_activeByteBudgets[index].budget) _activeByteBudgets[index].budget->release(size);
+  }
+
+  /**
+   * Returns the time until which a blocking enqueue() waits for free space (see OverloadOptions) or 0 for no deadline.
+   */
+  int64_t getBlockDeadline(int32_t index) {
+    uint32_t timeout = _blockTimeout[index];
+    return timeout == 0 ? 0 : steadyTime() + (int64_t)timeout * 1000000;
+  }
+
+  /**
+   * Waits once for dequeued entries to free space. Must be called with "lock" locked.
+   *
+   * @return Returns false when "deadline" has passed.
+   */
+  bool waitForSpace(int32_t index, std::unique_lock<std::mutex> &lock, int64_t deadline) {
+    //Other queues sharing the byte budget don't notify this queue's producers, so a shared budget is polled.
+    int64_t timeout = _activeByteBudgets[index].budget ? 10000000 : 1000000000;
+    if (deadline != 0) {
+      int64_t time = steadyTime();
+      if (time >= deadline) return false;
+      if (deadline - time < timeout) timeout = deadline - time;
+    }
+    _produceConditionVariable[index].wait_for(lock, std::chrono::nanoseconds(timeout));
+    return true;
+  }
+
+  /**
+   * Drops a queued entry to make room for a new entry of lane "laneIndex" according to the overload policy. Must be
+   * called with the queue locked.
+   *
+   * @return Returns false when no entry was dropped.
+   */
+  bool dropForNewEntry(int32_t index, uint32_t laneIndex) {
+    std::vector<Lane> &lanes = _lanes[index];
+    OverloadPolicy policy = _overloadPolicy[index];
+    uint32_t selected = lanes.size();
+    if (policy == OverloadPolicy::dropOldest) {
+      for (uint32_t i = 0; i < lanes.size(); i++) {
+        if (lanes[i].entries.empty()) continue;
+        if (selected == lanes.size() || lanes[i].entries.front().enqueueTime < lanes[selected].entries.front().enqueueTime) selected = i;
+      }
+    } else if (policy == OverloadPolicy::shedByPriority) {
+      for (uint32_t i = lanes.size() - 1; i > laneIndex; i--) {
+        if (!lanes[i].entries.empty()) {
+          selected = i;
+          break;
+        }
+      }
+    }
+    if (selected == lanes.size()) return false;
+
+    Lane &lane = lanes[selected];
+    removeQueuedKey(index, lane.entries.front());
+    releaseCoalescingKey(index, lane.entries.front());
+    releaseBytes(index, lane.entries.front().size);
+    lane.entries.pop_front();
+    lane.metrics.depth = lane.entries.size();
+    --_bufferCount[index];
+    (policy == OverloadPolicy::dropOldest ? _counters[index].evicted : _counters[index].shed).fetch_add(1, std::memory_order_relaxed);
+    _counters[index].dropped.fetch_add(1, std::memory_order_relaxed);
+    return true;
+  }
+
+  /**
+   * Returns the lane to dequeue the next entry from. Must be called with the queue locked and at least one entry in
+   * the queue.
+   */
+  uint32_t selectLane(int32_t index) {
+    std::vector<Lane> &lanes = _lanes[index];
+    if (lanes.size() == 1) return 0;
+    const PriorityOptions &options = _priorityOptions[index];
+    uint32_t selected = lanes.size();
+
+    if (!options.weights.empty()) {
+      //Smooth weighted round robin: Each waiting lane earns its weight. The lane with the most credit is served and
+      //pays the sum of the weights of all waiting lanes. This interleaves the lanes instead of serving them in bursts.
+      int64_t weightSum = 0;
+      for (uint32_t i = 0; i < lanes.size(); i++) {
+        if (lanes[i].entries.empty()) continue;
+        int64_t weight = i < options.weights.size() && options.weights[i] > 0 ? options.weights[i] : 1;
+        lanes[i].credit += weight;
+        weightSum += weight;
+        if (selected == lanes.size() || lanes[i].credit > lanes[selected].credit) selected = i;
+      }
+      lanes[selected].credit -= weightSum;
+      return selected;
+    }
+
+    for (uint32_t i = 0; i < lanes.size(); i++) {
+      if (lanes[i].entries.empty()) continue;
+      if (selected == lanes.size()) {
+        selected = i;
+        if (options.starvationLimit == 0) return selected;
+      } else if (lanes[i].passedOver >= options.starvationLimit) {
+        selected = i;
+        break;
+      }
+    }
+    for (uint32_t i = 0; i < lanes.size(); i++) {
+      if (i != selected && !lanes[i].entries.empty()) ++lanes[i].passedOver;
+    }
+    lanes[selected].passedOver = 0;
+    return selected;
+  }
+
+  /**
+   * Returns the lane of the queued entries with ordering key "key" or "priorityLane" when there are none (see
+   * _queuedKeys). Must be called with the queue locked.
+   */
+  uint32_t getKeyLane(int32_t index, uint64_t key, uint32_t priorityLane) {
+    if (_lanes[index].size() == 1) return priorityLane;
+    auto queuedKeyIterator = _queuedKeys[index].find(key);
+    return queuedKeyIterator == _queuedKeys[index].end() ? priorityLane : queuedKeyIterator->second.lane;
+  }
+
+  /**
+   * Counts a new entry with ordering key "key" and returns its lane (see getKeyLane()). Must be called with the queue
+   * locked.
+   */
+  uint32_t addQueuedKey(int32_t index, uint64_t key, uint32_t priorityLane) {
+    if (_lanes[index].size() == 1) return priorityLane;
+    QueuedKey &queuedKey = _queuedKeys[index][key];
+    if (queuedKey.count == 0) queuedKey.lane = priorityLane;
+    ++queuedKey.count;
+    return queuedKey.lane;
+  }
+
+  /**
+   * Stops counting "bufferEntry", because it leaves its lane. Must be called with the queue locked.
+   */
+  void removeQueuedKey(int32_t index, const BufferEntry &bufferEntry) {
+    if (!bufferEntry.hasKey || _lanes[index].size() == 1) return;
+    auto queuedKeyIterator = _queuedKeys[index].find(bufferEntry.key);
+    if (queuedKeyIterator != _queuedKeys[index].end() && --queuedKeyIterator->second.count == 0) _queuedKeys[index].erase(queuedKeyIterator);
+  }
+
+  /**
+   * Decides whether a dequeued entry can be processed by the current thread. Entries whose key is processed by another
+   * thread are moved to that thread. Otherwise the entry's key is marked as active and added to "activatedKeys". Must
+   * be called with the queue locked.
+   *
+   * @return Returns false when the entry was handed over.
+   */
+  bool admitEntry(int32_t index, BufferEntry &bufferEntry, std::vector<uint64_t> &activatedKeys) {
+    if (bufferEntry.hasKey) {
+      auto activeKeyIterator = _activeKeys[index].find(bufferEntry.key);
+      if (activeKeyIterator != _activeKeys[index].end()) {
+        //Another thread is processing this key. It processes the entry when it is finished. Until then newer entries
+        //can still be merged into it.
+        T *previousLocation = &bufferEntry.entry;
+        activeKeyIterator->second.push_back(std::move(bufferEntry));
+        if (bufferEntry.hasCoalescingKey) {
+          auto queuedEntryIterator = _coalescingEntries[index].find(bufferEntry.coalescingKey);
+          if (queuedEntryIterator != _coalescingEntries[index].end() && queuedEntryIterator->second == previousLocation) {
+            queuedEntryIterator->second = &activeKeyIterator->second.back().entry;
+          }
+        }
+        ++_keyedCount[index];
+        return false;
+      }
+      _activeKeys[index].emplace(bufferEntry.key, SegmentedFifo<BufferEntry>());
+      activatedKeys.push_back(bufferEntry.key);
+    }
+    releaseCoalescingKey(index, bufferEntry);
+    return true;
+  }
+
+  /**
+   * Processes the entries handed over for "activatedKeys" and marks the keys as inactive. Must be called with "lock"
+   * locked. Returns with "lock" locked.
+   */
+  void drainKeys(int32_t index, std::unique_lock<std::mutex> &lock, std::vector<uint64_t> &activatedKeys, std::vector<T> &batch) {
+    for (auto key : activatedKeys) {
+      //Rehashing doesn't invalidate references to elements of unordered_map.
+      SegmentedFifo<BufferEntry> &keyedEntries = _activeKeys[index].at(key);
+      while (!keyedEntries.empty() && !_stopProcessingThread[index]) {
+        uint32_t batchSize = _batchSize[index];
+        batch.clear();
+        int64_t time = steadyTime();
+        while (!keyedEntries.empty() && batch.size() < batchSize) {
+          releaseCoalescingKey(index, keyedEntries.front());
+          recordDequeue(index, keyedEntries.front(), time);
+          releaseBytes(index, keyedEntries.front().size);
+          batch.push_back(std::move(keyedEntries.front().entry));
+          keyedEntries.pop_front();
+          --_keyedCount[index];
+        }
+
+        lock.unlock();
+        notifyProducers(index, batch.size());
+        processEntries(index, batch, time);
+        lock.lock();
+      }
+      //Only left over when the queue is stopped.
+      _keyedCount[index] -= keyedEntries.size();
+      _counters[index].dropped += keyedEntries.size();
+      while (!keyedEntries.empty()) {
+        releaseCoalescingKey(index, keyedEntries.front());
+        releaseBytes(index, keyedEntries.front().size);
+        keyedEntries.pop_front();
+      }
+      _activeKeys[index].erase(key);
+    }
+    activatedKeys.clear();
+  }
+
+  /**
+   * Stops merging into the entry, because it is about to be processed. Must be called with the queue locked and the
+   * entry still at the location it was registered with.
+   */
+  void releaseCoalescingKey(int32_t index, BufferEntry &bufferEntry) {
+    if (!bufferEntry.hasCoalescingKey) return;
+    auto queuedEntryIterator = _coalescingEntries[index].find(bufferEntry.coalescingKey);
+    if (queuedEntryIterator != _coalescingEntries[index].end() && queuedEntryIterator->second == &bufferEntry.entry) _coalescingEntries[index].erase(queuedEntryIterator);
+  }
+
+  void updateHighWatermark(int32_t index, uint32_t depth) {
+    uint32_t highWatermark = _counters[index].highWatermark.load(std::memory_order_relaxed);
+    while (depth > highWatermark && !_counters[index].highWatermark.compare_exchange_weak(highWatermark, depth, std::memory_order_relaxed));
+  }
+
+  /**
+   * Returns the bytes allocated for storing the entries of queue "index". Must be called with the queue locked.
+   */
+  size_t getQueueMemoryUsage(int32_t index) {
+    size_t memoryUsage = 0;
+    for (auto &lane : _lanes[index]) {
+      memoryUsage += lane.entries.memoryUsage();
+    }
+    for (auto &keyedEntries : _activeKeys[index]) {
+      memoryUsage += keyedEntries.second.memoryUsage();
+    }
+    if (_rings[index]) memoryUsage += _rings[index]->memoryUsage();
+    return memoryUsage;
+  }
+
+  /**
+   * Counts "bufferEntry" as dequeued at "time" (see getMetrics()).
+   */
+  void recordDequeue(int32_t index, const BufferEntry &bufferEntry, int64_t time) {
+    _counters[index].dequeued.fetch_add(1, std::memory_order_relaxed);
+    _counters[index].waitTime.record(time > bufferEntry.enqueueTime ? time - bufferEntry.enqueueTime : 0);
+  }
+
+  /**
+   * Calls processQueueEntries() and clears "entries". Exceptions are caught, so a failing entry can't leave its key
+   * marked as active.
+   *
+   * @param dequeueTime The time the entries were dequeued. Used as the start of processing to save reading the clock.
+   */
+  void processEntries(int32_t index, std::vector<T> &entries, int64_t dequeueTime) {
+    if (entries.empty()) return;
+    size_t entryCount = entries.size();
+    try {
+      derived().processQueueEntries(index, entries);
+    }
+    catch (const std::exception &ex) {
+      std::cerr << "Error in TypedQueue::processQueueEntries: " << ex.what() << std::endl;
+    }
+    catch (...) {
+      std::cerr << "Unknown error in TypedQueue::processQueueEntries" << std::endl;
+    }
+    _counters[index].processingTime.record((steadyTime() - dequeueTime) / entryCount, entryCount);
+    entries.clear();
+  }
+};
+
+}
+#endif
@@ -66,6 +66,7 @@ Variable::Variable(Variable const &rhs) {
 Variable::Variable(VariableType variableType) : Variable() {
   type = variableType;
   if (type == VariableType::tVariant) type = VariableType::tVoid;
+  else if (type == VariableType::tDouble) type = VariableType::tFloat;
 }
 
 Variable::Variable(uint8_t integer) : Variable() {
@@ -184,6 +185,12 @@ std::shared_ptr<Variable> Variable::createError(int32_t faultCode, std::string f
   return error;
 }
 
+std::shared_ptr<Variable> Variable::createPlaceholder() {
+  std::shared_ptr<Variable> placeholder = std::make_shared<Variable>();
+  placeholder->type = VariableType::tVariant;
+  return placeholder;
+}
+
 Variable &Variable::operator=(const Variable &rhs) {
   if (&rhs == this) return *this;
   errorStruct = rhs.errorStruct;
@@ -324,6 +331,8 @@ Variable::operator Variable::bool_type() const {
       case VariableType::tBoolean: break;
       case VariableType::tFloat: result = (bool)floatValue;
         break;
+      case VariableType::tDouble: result = (bool)floatValue;
+        break;
       case VariableType::tInteger: result = (bool)integerValue;
         break;
       case VariableType::tInteger64: result = (bool)integerValue64;
@@ -439,6 +448,7 @@ std::string Variable::toString() {
     case VariableType::tBase64: return stringValue;
     case VariableType::tBoolean: if (booleanValue) return "true"; else return "false";
     case VariableType::tFloat: return std::to_string(floatValue);
+    case VariableType::tDouble: return std::to_string(floatValue);
     case VariableType::tInteger: return std::to_string(integerValue);
     case VariableType::tInteger64: return std::to_string(integerValue64);
     case VariableType::tString: return stringValue;
@@ -458,6 +468,7 @@ std::string Variable::getTypeString(VariableType type) {
       //case VariableType::rpcDate:
       //	return "dateTime.iso8601";
     case VariableType::tFloat: return "double";
+    case VariableType::tDouble: return "double";
     case VariableType::tInteger: return "i4";
     case VariableType::tInteger64: return "i8";
     case VariableType::tString: return "string";
@@ -53,6 +53,7 @@ enum class VariableType {
   tBase64 = 0x11,
   tBinary = 0xD0,
   tInteger64 = 0xD1,
+  tDouble = 0xD2, //Raw IEEE 754 binary64 on the wire. Decoded variables always have type tFloat.
   tVariant = 0x1111,
 };
 
@@ -109,6 +110,11 @@ class Variable {
   explicit Variable(const char *binaryVal, size_t binaryValSize);
   virtual ~Variable();
   static PVariable createError(int32_t faultCode, std::string faultString);
+
+  /**
+   * Creates a placeholder (VariableType::tVariant) for templates of prepared packets (see PreparedPacket).
+   */
+  static PVariable createPlaceholder();
   std::string print(bool stdout = false, bool stderr = false, bool oneLine = false);
   static std::string getTypeString(VariableType type);
   void setType(VariableType value) { type = value; };
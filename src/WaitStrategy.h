@@ -0,0 +1,118 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * libhomegear-base is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * libhomegear-base is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libhomegear-base.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#ifndef IPCWAITSTRATEGY_H_
+#define IPCWAITSTRATEGY_H_
+
+#include <cstdint>
+#include <thread>
+
+namespace Ipc {
+
+/**
+ * How a thread waits for queue entries or for the response to an RPC request.
+ */
+enum class WaitStrategy : int32_t {
+  /**
+   * Sleep on a condition variable right away. Uses no CPU while waiting, but each wake-up costs a futex call and a
+   * context switch.
+   */
+  blocking,
+
+  /**
+   * Spin for a few microseconds, then yield the CPU for a while, then sleep like "blocking". Work arriving shortly
+   * after the previous work is picked up without sleeping.
+   */
+  adaptive,
+
+  /**
+   * Spin until work arrives, yielding the CPU now and then so other threads still get to run when there are more
+   * threads than cores. Lowest latency, but every waiting thread keeps a core busy. Only use this for few threads on
+   * machines with spare cores.
+   */
+  spinning
+};
+
+/**
+ * The polling phase of a WaitStrategy. Typical use:
+ *
+ *   SpinWait spinWait(strategy);
+ *   while (spinWait.next()) {
+ *     if (condition) return;
+ *   }
+ *   //Block on the condition variable
+ */
+class SpinWait {
+ public:
+  explicit SpinWait(WaitStrategy strategy) : _strategy(strategy) {}
+
+  /**
+   * Pauses briefly. Returns false when the caller should stop polling and block.
+   */
+  bool next() {
+    if (_strategy == WaitStrategy::blocking) return false;
+    if (_strategy == WaitStrategy::spinning) {
+      if (++_count % spinCount == 0) std::this_thread::yield();
+      else pause();
+      return true;
+    }
+    if (_count < spinCount) {
+      _count++;
+      pause();
+      return true;
+    }
+    if (_count < spinCount + yieldCount) {
+      _count++;
+      std::this_thread::yield();
+      return true;
+    }
+    return false;
+  }
+
+  /**
+   * Tells the CPU that this is a spin loop, so the sibling hyperthread gets the core's resources.
+   */
+  static void pause() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+  }
+ private:
+  static const uint32_t spinCount = 200;
+  static const uint32_t yieldCount = 50;
+
+  WaitStrategy _strategy;
+  uint32_t _count = 0;
+};
+
+}
+#endif
@@ -0,0 +1,200 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * libhomegear-base is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * libhomegear-base is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libhomegear-base.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+
+
+/*
+ * Endianness: the SSSE3 and AVX2 kernels of swapArray32() and swapArray64() must produce the same result as the scalar
+ * implementation for every length from 0 to 67 (full vectors plus every tail length), for starts that aren't aligned
+ * to the vector size and in place. They must not write outside of the destination. Only the instruction sets the CPU
+ * supports are tested. toBigEndianArray*() and fromBigEndianArray*() must match writeBigEndian*() and
+ * readBigEndian*().
+ */
+
+#include "Endianness.h"
+
+#include <cstdio>
+#include <vector>
+
+using namespace Ipc;
+
+namespace {
+
+bool success = true;
+
+#define CHECK(condition) do { if (!(condition)) { printf("Check failed in line %d: %s\n", __LINE__, #condition); success = false; } } while (0)
+
+const size_t maxCount = 67;
+const size_t maxOffset = 8; //Elements, covers every start within a 32 byte vector.
+const size_t guard = 8;
+const uint64_t guardValue = 0xA5A5A5A5A5A5A5A5ull;
+
+const char *levelName(Endianness::SimdLevel level) {
+  if (level == Endianness::SimdLevel::avx2) return "AVX2";
+  if (level == Endianness::SimdLevel::ssse3) return "SSSE3";
+  return "scalar";
+}
+
+template<typename T> T pattern(size_t index) {
+  //Distinct bytes, so every misplaced byte is detected.
+  uint64_t value = 0;
+  for (size_t i = 0; i < sizeof(T); i++) value |= (uint64_t)((index * sizeof(T) + i + 1) & 0xFF) << (i * 8);
+  return (T)value;
+}
+
+template<typename T> T reference(T value) {
+  T result = 0;
+  for (size_t i = 0; i < sizeof(T); i++) result |= (T)((value >> (i * 8)) & 0xFF) << ((sizeof(T) - 1 - i) * 8);
+  return result;
+}
+
+void swapArray(uint32_t *to, const uint32_t *from, size_t count, Endianness::SimdLevel level) {
+  Endianness::swapArray32(to, from, count, level);
+}
+
+void swapArray(uint64_t *to, const uint64_t *from, size_t count, Endianness::SimdLevel level) {
+  Endianness::swapArray64(to, from, count, level);
+}
+
+template<typename T> bool guardsIntact(const std::vector<T> &buffer, size_t start, size_t count) {
+  for (size_t i = 0; i < buffer.size(); i++) {
+    if (i >= start && i < start + count) continue;
+    if (buffer[i] != (T)guardValue) return false;
+  }
+  return true;
+}
+
+template<typename T> void testSwapArray(Endianness::SimdLevel level) {
+  size_t failures = 0;
+  for (size_t count = 0; count <= maxCount; count++) {
+    for (size_t fromOffset = 0; fromOffset < maxOffset; fromOffset++) {
+      for (size_t toOffset = 0; toOffset < maxOffset; toOffset++) {
+        //std::vector allocates with at least 16 byte alignment, so offsets move the start relative to the vectors.
+        std::vector<T> from(guard + maxOffset + maxCount + guard, (T)guardValue);
+        std::vector<T> to(from.size(), (T)guardValue);
+        size_t fromStart = guard + fromOffset;
+        size_t toStart = guard + toOffset;
+        for (size_t i = 0; i < count; i++) from[fromStart + i] = pattern<T>(i);
+        std::vector<T> original = from;
+
+        swapArray(to.data() + toStart, from.data() + fromStart, count, level);
+
+        bool correct = from == original && guardsIntact(to, toStart, count);
+        for (size_t i = 0; i < count; i++) {
+          if (to[toStart + i] != reference(pattern<T>(i))) correct = false;
+        }
+
+        //In place
+        swapArray(from.data() + fromStart, from.data() + fromStart, count, level);
+        correct = correct && guardsIntact(from, fromStart, count);
+        for (size_t i = 0; i < count; i++) {
+          if (from[fromStart + i] != to[toStart + i]) correct = false;
+        }
+
+        if (!correct) {
+          if (failures++ < 10) printf("%s, %zu bit: wrong result for %zu elements from offset %zu to offset %zu.\n", levelName(level), sizeof(T) * 8, count, fromOffset, toOffset);
+          success = false;
+        }
+      }
+    }
+  }
+}
+
+void testKernels() {
+  Endianness::SimdLevel supported = Endianness::getSimdLevel();
+  printf("Best supported instruction set: %s\n", levelName(supported));
+
+  std::vector<Endianness::SimdLevel> levels{Endianness::SimdLevel::scalar};
+  if (supported == Endianness::SimdLevel::ssse3 || supported == Endianness::SimdLevel::avx2) levels.push_back(Endianness::SimdLevel::ssse3);
+  if (supported == Endianness::SimdLevel::avx2) levels.push_back(Endianness::SimdLevel::avx2);
+
+  for (auto level : levels) {
+    testSwapArray<uint32_t>(level);
+    testSwapArray<uint64_t>(level);
+  }
+}
+
+void testConversions() {
+  for (size_t count = 0; count <= maxCount; count++) {
+    for (size_t offset = 0; offset < maxOffset; offset++) {
+      std::vector<uint32_t> values32(offset + count);
+      std::vector<uint64_t> values64(offset + count);
+      for (size_t i = 0; i < count; i++) {
+        values32[offset + i] = pattern<uint32_t>(i);
+        values64[offset + i] = pattern<uint64_t>(i);
+      }
+
+      std::vector<uint32_t> bigEndian32(values32.size());
+      std::vector<uint64_t> bigEndian64(values64.size());
+      Endianness::toBigEndianArray32(bigEndian32.data() + offset, values32.data() + offset, count);
+      Endianness::toBigEndianArray64(bigEndian64.data() + offset, values64.data() + offset, count);
+
+      std::vector<uint32_t> hostOrder32(values32.size());
+      std::vector<uint64_t> hostOrder64(values64.size());
+      Endianness::fromBigEndianArray32(hostOrder32.data() + offset, bigEndian32.data() + offset, count);
+      Endianness::fromBigEndianArray64(hostOrder64.data() + offset, bigEndian64.data() + offset, count);
+
+      bool correct = true;
+      for (size_t i = offset; i < offset + count; i++) {
+        uint32_t expected32 = 0;
+        uint64_t expected64 = 0;
+        Endianness::writeBigEndian32(&expected32, values32[i]);
+        Endianness::writeBigEndian64(&expected64, values64[i]);
+        if (bigEndian32[i] != expected32 || bigEndian64[i] != expected64) correct = false;
+        if (Endianness::readBigEndian32(&bigEndian32[i]) != values32[i] || Endianness::readBigEndian64(&bigEndian64[i]) != values64[i]) correct = false;
+        if (hostOrder32[i] != values32[i] || hostOrder64[i] != values64[i]) correct = false;
+      }
+      if (!correct) {
+        printf("Wrong conversion of %zu elements at offset %zu.\n", count, offset);
+        success = false;
+      }
+
+      //The default functions must match the scalar implementation.
+      std::vector<uint32_t> scalar32(values32.size());
+      std::vector<uint32_t> swapped32(values32.size());
+      Endianness::swapArray32(scalar32.data() + offset, values32.data() + offset, count, Endianness::SimdLevel::scalar);
+      Endianness::swapArray32(swapped32.data() + offset, values32.data() + offset, count);
+      CHECK(swapped32 == scalar32);
+      std::vector<uint64_t> scalar64(values64.size());
+      std::vector<uint64_t> swapped64(values64.size());
+      Endianness::swapArray64(scalar64.data() + offset, values64.data() + offset, count, Endianness::SimdLevel::scalar);
+      Endianness::swapArray64(swapped64.data() + offset, values64.data() + offset, count);
+      CHECK(swapped64 == scalar64);
+    }
+  }
+}
+
+}
+
+int main() {
+  testKernels();
+  testConversions();
+  return success ? 0 : 1;
+}
@@ -0,0 +1,390 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * libhomegear-base is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * libhomegear-base is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libhomegear-base.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+
+
+/*
+ * Float codecs: the legacy mantissa/exponent format (BinaryEncoder::getMantissaAndExponent() and
+ * BinaryDecoder::getFloatValue()) must produce the same bytes as the original halving/doubling encoder. The decoder
+ * must return the same values as the original pow/log10 decoder, except where the original's rounding factor was
+ * inexact (at most two ulps apart) or overflowed (NaN below 1e-299, infinity from 2^1023 on). Negative values are
+ * rounded like positive ones now. Subnormals encode as 0. Raw doubles (VariableType::tDouble) must roundtrip bit for bit
+ * and are only sent after setEncodeDouble(true).
+ */
+
+#include "BinaryDecoder.h"
+#include "BinaryEncoder.h"
+#include "Math.h"
+#include "RpcDecoder.h"
+#include "RpcEncoder.h"
+
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <vector>
+
+using namespace Ipc;
+
+namespace {
+
+bool success = true;
+
+#define CHECK(condition) do { if (!(condition)) { printf("Check failed in line %d: %s\n", __LINE__, #condition); success = false; } } while (0)
+
+uint64_t checks = 0;
+uint64_t failures = 0;
+
+void memcpyBigEndian(char *to, const char *from, uint32_t length) {
+  for (uint32_t i = 0; i < length; i++) to[i] = from[length - 1 - i];
+}
+
+//The original encoder and decoder, copied verbatim as reference.
+void baselineEncodeFloat(std::vector<char> &encodedData, double floatValue) {
+  double temp = std::abs(floatValue);
+  int32_t exponent = 0;
+  int32_t mantissa = 0;
+  if (std::isnormal(temp)) {
+    if (temp != 0 && temp < 0.5) {
+      while (temp < 0.5) {
+        temp *= 2;
+        exponent--;
+      }
+    } else {
+      while (temp >= 1) {
+        temp /= 2;
+        exponent++;
+      }
+    }
+    if (floatValue < 0) { temp *= -1; }
+    mantissa = std::lround(temp * 0x40000000);
+  }
+  char data[8];
+  memcpyBigEndian(data, (char *)&mantissa, 4);
+  memcpyBigEndian(data + 4, (char *)&exponent, 4);
+  encodedData.insert(encodedData.end(), data, data + 8);
+}
+
+double baselineDecodeFloat(std::vector<char> &encodedData, uint32_t &position) {
+  if (position + 8 > encodedData.size()) return 0;
+  int32_t mantissa = 0;
+  int32_t exponent = 0;
+  memcpyBigEndian((char *)&mantissa, &encodedData.at(position), 4);
+  position += 4;
+  memcpyBigEndian((char *)&exponent, &encodedData.at(position), 4);
+  position += 4;
+  double floatValue = (double)mantissa / 0x40000000;
+  floatValue *= std::pow(2, exponent);
+  if (floatValue != 0) {
+    int32_t digits = std::lround(std::floor(std::log10(floatValue) + 1));
+    double factor = std::pow(10, 9 - digits);
+    //Round to 9 digits
+    floatValue = std::floor(floatValue * factor + 0.5) / factor;
+  }
+  return floatValue;
+}
+
+std::vector<char> encodeLegacy(int32_t mantissa, int32_t exponent) {
+  std::vector<char> data(8);
+  memcpyBigEndian(data.data(), (char *)&mantissa, 4);
+  memcpyBigEndian(data.data() + 4, (char *)&exponent, 4);
+  return data;
+}
+
+double unroundedValue(std::vector<char> &encodedData) {
+  int32_t mantissa = 0;
+  int32_t exponent = 0;
+  memcpyBigEndian((char *)&mantissa, &encodedData.at(0), 4);
+  memcpyBigEndian((char *)&exponent, &encodedData.at(4), 4);
+  return std::ldexp((double)mantissa / 0x40000000, exponent);
+}
+
+/**
+ * glibc's pow() is off by up to one ulp for some powers of 10 (e.g. 10^23) and 10^-n can't be represented exactly, so
+ * the baseline rounded values of these decades up to two ulps off. The decoder uses exact powers of 10 from
+ * Math::Pow10().
+ */
+bool baselineFactorInexact(std::vector<char> &encodedData) {
+  double floatValue = unroundedValue(encodedData);
+  int32_t digits = std::lround(std::floor(std::log10(floatValue) + 1));
+  int32_t decimalExponent = 9 - digits;
+  if (decimalExponent < 0) return true;
+  return decimalExponent <= 308 && std::pow(10, decimalExponent) != Math::Pow10(decimalExponent);
+}
+
+/**
+ * Number of doubles between two finite values of the same sign.
+ */
+uint64_t ulpDistance(double a, double b) {
+  int64_t bitsA = 0;
+  int64_t bitsB = 0;
+  std::memcpy(&bitsA, &a, sizeof(double));
+  std::memcpy(&bitsB, &b, sizeof(double));
+  return bitsA > bitsB ? bitsA - bitsB : bitsB - bitsA;
+}
+
+bool sameBits(double a, double b) {
+  return std::memcmp(&a, &b, sizeof(double)) == 0;
+}
+
+void fail(const char *what, double value, double expected, double actual) {
+  failures++;
+  if (failures <= 10) printf("%s mismatch for %.17g: expected %.17g, got %.17g\n", what, value, expected, actual);
+  success = false;
+}
+
+/**
+ * Encodes "value" with both encoders and decodes the result with both decoders.
+ */
+void checkValue(double value) {
+  BinaryEncoder encoder;
+  BinaryDecoder decoder;
+  checks++;
+
+  std::vector<char> expected;
+  std::vector<char> actual;
+  baselineEncodeFloat(expected, value);
+  encoder.encodeFloat(actual, value);
+  if (actual != expected) {
+    fail("Encoding", value, 0, 0);
+    return;
+  }
+
+  uint32_t position = 0;
+  double decoded = decoder.decodeFloat(actual, position);
+  if (position != 8) fail("Position", value, 8, position);
+
+  //The uint8_t overload must decode the same value.
+  std::vector<uint8_t> unsignedData(actual.begin(), actual.end());
+  position = 0;
+  double unsignedDecoded = decoder.decodeFloat(unsignedData, position);
+  if (!sameBits(unsignedDecoded, decoded)) fail("uint8_t decoding", value, decoded, unsignedDecoded);
+
+  if (value > 0) {
+    position = 0;
+    double baseline = baselineDecodeFloat(expected, position);
+    if (std::isfinite(baseline)) {
+      if (!sameBits(decoded, baseline) && !(baselineFactorInexact(expected) && ulpDistance(baseline, decoded) <= 2)) {
+        fail("Decoding", value, baseline, decoded);
+      }
+    } else if (std::isnan(decoded) || std::isinf(decoded) != std::isinf(unroundedValue(expected))) {
+      //The baseline returned NaN below 1e-299, where its rounding factor overflowed, and infinity from 2^1023 on, where
+      //pow(2, exponent) did.
+      fail("Decoding", value, baseline, decoded);
+    }
+
+    //Negative values are rounded like positive ones. The baseline returned NaN for them.
+    std::vector<char> negative;
+    encoder.encodeFloat(negative, -value);
+    position = 0;
+    double negativeDecoded = decoder.decodeFloat(negative, position);
+    if (negativeDecoded != -decoded) fail("Negative decoding", -value, -decoded, negativeDecoded);
+  }
+}
+
+void testValues() {
+  //Rounding to 9 significant digits and mantissas that round up to 2^30.
+  const double values[] = {
+      1, 0.5, 0.1, 0.2, 0.3, 1.5, 2, 3, 10, 21.5, 21.37, 22.4, 99.99, 100, 123456.789, 1e-5, 0.001, 0.005, 0.015, 1.005,
+      2.675, 0.999999999, 0.9999999995, 999999999, 999999999.5, 1e9, 1e9 - 0.5, 1e9 + 0.5, 4294967295.0,
+      std::nextafter(1.0, 0.0), std::nextafter(0.5, 1.0), std::nextafter(1.0, 2.0), 1 - std::ldexp(1, -31),
+      1 - std::ldexp(1, -32), 1 - std::ldexp(1, -33), 0.5 + std::ldexp(1, -32), 12345.6789, 3.14159265358979,
+      2.718281828459045, 1e15, 1e-15, 65535.5, -0.0, 0.0
+  };
+  for (double value : values) {
+    checkValue(value);
+    checkValue(-value);
+  }
+
+  //Decimal values with 1 to 4 decimal places.
+  for (int32_t i = 0; i <= 20000; i++) {
+    checkValue(i / 10.0);
+    checkValue(i / 100.0);
+    checkValue(i / 1000.0);
+    checkValue(i / 10000.0);
+  }
+}
+
+void testExponentEdges() {
+  //Every binary exponent of normal doubles, with mantissas at the edges of [0.5, 1).
+  for (int32_t exponent = -1021; exponent <= 1024; exponent++) {
+    checkValue(std::ldexp(0.5, exponent));
+    checkValue(std::ldexp(std::nextafter(1.0, 0.0), exponent));
+    checkValue(std::ldexp(0.75, exponent));
+    checkValue(std::ldexp(0.5 + std::ldexp(1, -31), exponent));
+  }
+  checkValue(DBL_MAX);
+  checkValue(DBL_MIN);
+  checkValue(std::nextafter(DBL_MIN, 1.0));
+
+  //Every power of 10 and the neighbours, where the number of decimal digits changes.
+  for (int32_t exponent = -307; exponent <= 308; exponent++) {
+    double value = std::pow(10, exponent);
+    checkValue(value);
+    checkValue(std::nextafter(value, 0.0));
+    checkValue(std::nextafter(value, DBL_MAX));
+  }
+
+  //Subnormals, infinity and NaN aren't normal, so they are encoded as 0.
+  const double notNormal[] = {
+      std::nextafter(DBL_MIN, 0.0), DBL_MIN / 2, std::numeric_limits<double>::denorm_min(),
+      std::numeric_limits<double>::infinity(), std::numeric_limits<double>::quiet_NaN()
+  };
+  BinaryEncoder encoder;
+  for (double value : notNormal) {
+    checkValue(value);
+    checkValue(-value);
+    std::vector<char> data;
+    encoder.encodeFloat(data, value);
+    CHECK(data == std::vector<char>(8, 0));
+  }
+
+  //Mantissa/exponent pairs no encoder produces must decode to something sane.
+  BinaryDecoder decoder;
+  const int32_t exponents[] = {-1100, -1074, -1060, -1030, -1022, 1023, 1024, 1025, 2000, INT32_MAX, INT32_MIN};
+  const int32_t mantissas[] = {1, 0x20000000, 0x3FFFFFFF, 0x40000000, -0x40000000, INT32_MAX, INT32_MIN};
+  for (int32_t exponent : exponents) {
+    for (int32_t mantissa : mantissas) {
+      std::vector<char> data = encodeLegacy(mantissa, exponent);
+      uint32_t position = 0;
+      double decoded = decoder.decodeFloat(data, position);
+      double unrounded = std::ldexp((double)mantissa / 0x40000000, exponent);
+      CHECK(!std::isnan(decoded));
+      //Values outside of the normal range are returned without rounding.
+      if (!std::isnormal(unrounded)) CHECK(sameBits(decoded, unrounded));
+      else CHECK(std::abs(decoded - unrounded) <= std::abs(unrounded) * 1e-8);
+    }
+  }
+
+  //Truncated data.
+  std::vector<char> truncated(7, 1);
+  uint32_t position = 0;
+  CHECK(decoder.decodeFloat(truncated, position) == 0 && position == 0);
+  position = 0;
+  CHECK(decoder.decodeDouble(truncated, position) == 0 && position == 0);
+}
+
+void testRandom() {
+  std::mt19937_64 random(42);
+  std::uniform_real_distribution<double> mantissa(0.5, 1.0);
+  std::uniform_int_distribution<int32_t> exponent(-1021, 1024);
+  std::uniform_int_distribution<int32_t> smallExponent(-40, 40);
+  for (int32_t i = 0; i < 100000; i++) {
+    checkValue(std::ldexp(mantissa(random), exponent(random)));
+    double value = std::ldexp(mantissa(random), smallExponent(random));
+    checkValue(value);
+    checkValue(std::round(value * 100) / 100);
+  }
+
+  //Random bit patterns cover every exponent including subnormals, infinity and NaN.
+  for (int32_t i = 0; i < 100000; i++) {
+    uint64_t bits = random();
+    double value = 0;
+    std::memcpy(&value, &bits, sizeof(double));
+    checkValue(value);
+  }
+}
+
+void testDoubleRoundtrip() {
+  std::vector<double> values{
+      0.0, -0.0, 1, -1, 0.1, -21.37, 123456.789, 1e-300, -1e300, DBL_MAX, -DBL_MAX, DBL_MIN, DBL_MIN / 2,
+      std::numeric_limits<double>::denorm_min(), std::numeric_limits<double>::infinity(),
+      -std::numeric_limits<double>::infinity(), std::numeric_limits<double>::quiet_NaN(), 3.14159265358979
+  };
+  std::mt19937_64 random(7);
+  for (int32_t i = 0; i < 100000; i++) {
+    uint64_t bits = random();
+    double value = 0;
+    std::memcpy(&value, &bits, sizeof(double));
+    values.push_back(value);
+  }
+
+  BinaryEncoder encoder;
+  BinaryDecoder decoder;
+  for (double value : values) {
+    std::vector<char> data;
+    encoder.encodeDouble(data, value);
+    CHECK(data.size() == 8);
+    uint32_t position = 0;
+    double decoded = decoder.decodeDouble(data, position);
+    if (!sameBits(decoded, value)) fail("tDouble", value, value, decoded);
+    CHECK(position == 8);
+
+    std::vector<uint8_t> unsignedData(data.begin(), data.end());
+    position = 0;
+    decoded = decoder.decodeDouble(unsignedData, position);
+    if (!sameBits(decoded, value)) fail("uint8_t tDouble", value, value, decoded);
+  }
+
+  //Big endian on the wire.
+  std::vector<char> data;
+  encoder.encodeDouble(data, 1.0);
+  CHECK(data == std::vector<char>({0x3F, (char)0xF0, 0, 0, 0, 0, 0, 0}));
+
+  //Through the RPC layer: only sent as tDouble after setEncodeDouble(true). The decoder accepts both.
+  RpcEncoder rpcEncoder(true);
+  RpcDecoder rpcDecoder;
+  CHECK(!rpcEncoder.getEncodeDouble());
+  for (int32_t encodeDouble = 0; encodeDouble < 2; encodeDouble++) {
+    rpcEncoder.setEncodeDouble(encodeDouble == 1);
+    for (size_t i = 0; i < 1000 && i < values.size(); i++) {
+      double value = values[i];
+      std::vector<char> packet;
+      rpcEncoder.encodeResponse(std::make_shared<Variable>(value), packet);
+      rpcDecoder.resetDoubleReceived();
+      PVariable decoded = rpcDecoder.decodeResponse(packet);
+      CHECK(decoded && decoded->type == VariableType::tFloat);
+      if (!decoded) continue;
+      CHECK(rpcDecoder.doubleReceived() == (encodeDouble == 1));
+      if (encodeDouble == 1) {
+        if (!sameBits(decoded->floatValue, value)) fail("RPC tDouble", value, value, decoded->floatValue);
+      } else {
+        std::vector<char> legacy;
+        encoder.encodeFloat(legacy, value);
+        uint32_t position = 0;
+        double expected = decoder.decodeFloat(legacy, position);
+        if (!sameBits(decoded->floatValue, expected)) fail("RPC float", value, expected, decoded->floatValue);
+      }
+    }
+  }
+}
+
+}
+
+int main() {
+  testValues();
+  testExponentEdges();
+  testRandom();
+  testDoubleRoundtrip();
+  printf("%llu values checked.\n", (unsigned long long)checks);
+  return success ? 0 : 1;
+}
@@ -0,0 +1,143 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * libhomegear-base is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * libhomegear-base is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libhomegear-base.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+
+/*
+ * Several producers and processing threads with ordering keys, in locked and in lock-free mode: Entries of one key must
+ * be processed one at a time and in the order they were queued. Slow keys make other threads dequeue entries of a key
+ * that is still being processed, so these are handed over to the thread processing the key (see drainKeys()).
+ */
+
+#include "TypedQueue.h"
+
+#include <cstdio>
+
+using namespace Ipc;
+
+namespace {
+
+const uint32_t producerCount = 4;
+const uint32_t processingThreadCount = 4;
+const uint32_t keyCount = 16;
+const uint32_t entriesPerKey = 500;
+const uint32_t unkeyedEntriesPerProducer = 500;
+
+struct TestEntry {
+  bool hasKey = false;
+  uint64_t key = 0;
+  int64_t sequence = 0;
+};
+
+class TestQueue : public TypedQueue<TestQueue, TestEntry> {
+  friend class TypedQueue<TestQueue, TestEntry>;
+ public:
+  TestQueue() : TypedQueue(1, 200), _busy(keyCount), _lastSequence(keyCount) {
+    for (auto &lastSequence : _lastSequence) lastSequence = -1;
+  }
+
+  std::atomic<uint32_t> processed{0};
+  std::atomic<uint32_t> concurrentKeys{0};
+  std::atomic<uint32_t> outOfOrder{0};
+
+  int64_t getLastSequence(uint64_t key) { return _lastSequence[key]; }
+
+  void processQueueEntry(int32_t index, TestEntry &entry) {
+    if (entry.hasKey) {
+      if (_busy[entry.key].exchange(true)) ++concurrentKeys;
+      if (entry.sequence != _lastSequence[entry.key] + 1) ++outOfOrder;
+      _lastSequence[entry.key] = entry.sequence;
+      //Every fourth key is slow, so its entries pile up while it is processed.
+      if (entry.key % 4 == 0) std::this_thread::sleep_for(std::chrono::microseconds(20));
+      _busy[entry.key] = false;
+    }
+    ++processed;
+  }
+ protected:
+  bool getQueueEntryKey(int32_t index, TestEntry &entry, uint64_t &key) {
+    key = entry.key;
+    return entry.hasKey;
+  }
+ private:
+  std::vector<std::atomic_bool> _busy;
+  std::vector<std::atomic<int64_t>> _lastSequence;
+};
+
+bool success = true;
+
+#define CHECK(condition) do { if (!(condition)) { printf("Check failed in line %d: %s\n", __LINE__, #condition); success = false; } } while (0)
+
+void produce(TestQueue &queue, uint32_t producer) {
+  //Each key has one producer, so the order of its entries is the order they are queued in.
+  for (uint32_t sequence = 0; sequence < entriesPerKey; sequence++) {
+    for (uint64_t key = producer; key < keyCount; key += producerCount) {
+      TestEntry entry;
+      entry.hasKey = true;
+      entry.key = key;
+      entry.sequence = sequence;
+      queue.enqueue(0, std::move(entry), true);
+    }
+    if (sequence < unkeyedEntriesPerProducer) queue.enqueue(0, TestEntry(), true);
+  }
+}
+
+void test(bool lockFree, uint32_t batchSize) {
+  TestQueue queue;
+  queue.setLockFree(0, lockFree);
+  queue.setBatchSize(0, batchSize);
+  queue.startQueue(0, false, processingThreadCount);
+
+  std::vector<std::thread> producers;
+  for (uint32_t i = 0; i < producerCount; i++) producers.emplace_back(produce, std::ref(queue), i);
+  for (auto &producer : producers) producer.join();
+
+  const uint32_t total = keyCount * entriesPerKey + producerCount * unkeyedEntriesPerProducer;
+  for (int32_t i = 0; i < 10000 && queue.processed < total; i++) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  CHECK(queue.processed == total);
+  CHECK(queue.concurrentKeys == 0);
+  CHECK(queue.outOfOrder == 0);
+  for (uint64_t key = 0; key < keyCount; key++) CHECK(queue.getLastSequence(key) == entriesPerKey - 1);
+  auto metrics = queue.getMetrics(0);
+  CHECK(metrics.dropped == 0);
+  CHECK(metrics.dequeued == total);
+  CHECK(metrics.depth == 0);
+
+  queue.stopQueue(0);
+  if (!success) printf("Failed with lockFree = %d and batchSize = %u.\n", (int32_t)lockFree, batchSize);
+}
+
+}
+
+int main() {
+  test(false, 1);
+  test(false, 8);
+  test(true, 1);
+  test(true, 8);
+  return success ? 0 : 1;
+}
@@ -0,0 +1,166 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * libhomegear-base is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * libhomegear-base is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libhomegear-base.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+
+/*
+ * Entries with the same ordering key but different priorities: Once an entry of a key is queued, later entries of the
+ * key must go to its lane, so the lanes can't reorder them. Entries without key still use their priority lane.
+ */
+
+#include "TypedQueue.h"
+
+#include <cstdio>
+
+using namespace Ipc;
+
+namespace {
+
+struct TestEntry {
+  uint32_t priority = 0;
+  bool hasKey = false;
+  uint64_t key = 0;
+  uint32_t sequence = 0;
+};
+
+class TestQueue : public TypedQueue<TestQueue, TestEntry> {
+  friend class TypedQueue<TestQueue, TestEntry>;
+ public:
+  TestQueue() : TypedQueue(1, 1000) {}
+
+  //Keeps the processing thread busy with the first entry, so the others stay queued.
+  std::atomic_bool hold{true};
+  std::atomic_bool holding{false};
+  std::atomic<uint32_t> processed{0};
+  std::mutex processedMutex;
+  std::vector<TestEntry> processedEntries;
+
+  void processQueueEntry(int32_t index, TestEntry &entry) {
+    if (!holding) {
+      holding = true;
+      while (hold) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    {
+      std::lock_guard<std::mutex> processedGuard(processedMutex);
+      processedEntries.push_back(entry);
+    }
+    ++processed;
+  }
+ protected:
+  bool getQueueEntryKey(int32_t index, TestEntry &entry, uint64_t &key) {
+    key = entry.key;
+    return entry.hasKey;
+  }
+
+  uint32_t getQueueEntryPriority(int32_t index, TestEntry &entry) { return entry.priority; }
+};
+
+bool success = true;
+
+#define CHECK(condition) do { if (!(condition)) { printf("Check failed in line %d: %s\n", __LINE__, #condition); success = false; } } while (0)
+
+void enqueue(TestQueue &queue, uint32_t priority, bool hasKey, uint64_t key, uint32_t sequence) {
+  TestEntry entry;
+  entry.priority = priority;
+  entry.hasKey = hasKey;
+  entry.key = key;
+  entry.sequence = sequence;
+  CHECK(queue.enqueue(0, std::move(entry)));
+}
+
+void waitForProcessing(TestQueue &queue, uint32_t count) {
+  for (int32_t i = 0; i < 5000 && queue.processed < count; i++) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  CHECK(queue.processed == count);
+}
+
+void test(const IQueueBase::PriorityOptions &priorityOptions, uint32_t threadCount) {
+  static const uint32_t keyCount = 4;
+  static const uint32_t entriesPerKey = 30;
+
+  TestQueue queue;
+  queue.setPriorityOptions(0, priorityOptions);
+  queue.startQueue(0, false, threadCount);
+
+  enqueue(queue, 0, false, 0, 0);
+  while (!queue.holding) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+  //The first entry of each key goes to a different lane. Later entries of the key have all priorities.
+  uint32_t count = 1;
+  for (uint32_t i = 0; i < entriesPerKey; i++) {
+    for (uint32_t key = 0; key < keyCount; key++) {
+      enqueue(queue, (i + key) % 3, true, key, i);
+      count++;
+    }
+    enqueue(queue, i % 3, false, 0, i);
+    count++;
+  }
+  auto laneMetrics = queue.getLaneMetrics(0);
+  CHECK(laneMetrics.size() == 3);
+  if (threadCount == 1) {
+    //Keys 0, 1 and 2 started in lanes 0, 1 and 2 and key 3 in lane 0. The 31 entries without key are spread evenly.
+    //With more threads, keys are processed while entries are queued and can start in another lane again.
+    CHECK(laneMetrics[0].enqueued == 2 * entriesPerKey + 10 + 1);
+    CHECK(laneMetrics[1].enqueued == entriesPerKey + 10);
+    CHECK(laneMetrics[2].enqueued == entriesPerKey + 10);
+  }
+
+  queue.hold = false;
+  waitForProcessing(queue, count);
+
+  std::vector<int64_t> lastSequence(keyCount, -1);
+  for (auto &entry : queue.processedEntries) {
+    if (!entry.hasKey) continue;
+    CHECK((int64_t)entry.sequence == lastSequence[entry.key] + 1);
+    lastSequence[entry.key] = entry.sequence;
+  }
+  for (uint32_t key = 0; key < keyCount; key++) CHECK(lastSequence[key] == entriesPerKey - 1);
+
+  //No entry of key 2 is queued anymore, so the next one gets the lane of its priority again.
+  enqueue(queue, 0, true, 2, entriesPerKey);
+  waitForProcessing(queue, count + 1);
+  CHECK(queue.getLaneMetrics(0)[0].enqueued == laneMetrics[0].enqueued + 1);
+
+  queue.stopQueue(0);
+}
+
+}
+
+int main() {
+  IQueueBase::PriorityOptions priorityOptions;
+  priorityOptions.laneCount = 3;
+  test(priorityOptions, 1);
+  test(priorityOptions, 4);
+  priorityOptions.starvationLimit = 2;
+  test(priorityOptions, 1);
+  priorityOptions.starvationLimit = 0;
+  priorityOptions.weights = {4, 2, 1};
+  test(priorityOptions, 1);
+  test(priorityOptions, 4);
+  return success ? 0 : 1;
+}
@@ -0,0 +1,164 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * libhomegear-base is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * libhomegear-base is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libhomegear-base.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+
+/*
+ * MpmcRing: FIFO order and full/empty detection over several laps and segment boundaries, popping from a segment that
+ * wasn't allocated yet, and a stress test with several producers and consumers. Every element must be popped exactly
+ * once and the elements of each producer in the order they were pushed. Fresh rings make the producers race to
+ * allocate the first segments.
+ */
+
+#include "MpmcRing.h"
+
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+using namespace Ipc;
+
+namespace {
+
+bool success = true;
+
+#define CHECK(condition) do { if (!(condition)) { printf("Check failed in line %d: %s\n", __LINE__, #condition); success = false; } } while (0)
+
+void testWraparound() {
+  //256 cells in 4 segments of 64.
+  MpmcRing<uint64_t> ring(200);
+  CHECK(ring.capacity() == 256);
+  CHECK(ring.memoryUsage() == 0);
+
+  uint64_t value = 0;
+  CHECK(!ring.pop(value));
+
+  //Segment 1 isn't allocated when the consumers reach it.
+  uint64_t pushed = 0;
+  uint64_t popped = 0;
+  for (; pushed < 64; pushed++) {
+    value = pushed;
+    CHECK(ring.push(value));
+  }
+  size_t segmentBytes = ring.memoryUsage();
+  CHECK(segmentBytes != 0);
+  for (; popped < 64; popped++) {
+    CHECK(ring.pop(value) && value == popped);
+  }
+  CHECK(!ring.pop(value));
+  CHECK(ring.memoryUsage() == segmentBytes);
+
+  //Fill levels that don't divide the capacity move the wrap point through all segments.
+  for (uint32_t lap = 0; lap < 20; lap++) {
+    uint64_t fill = lap % 2 == 0 ? 256 : 37 + lap * 11;
+    for (uint64_t i = 0; i < fill; i++, pushed++) {
+      value = pushed;
+      CHECK(ring.push(value));
+    }
+    if (fill == 256) {
+      value = 12345;
+      CHECK(!ring.push(value));
+      CHECK(value == 12345);
+    }
+    CHECK(ring.size() == fill);
+    for (uint64_t i = 0; i < fill; i++, popped++) {
+      CHECK(ring.pop(value) && value == popped);
+    }
+    CHECK(!ring.pop(value));
+  }
+  CHECK(ring.pushed() == pushed);
+  CHECK(ring.popped() == popped);
+  CHECK(ring.memoryUsage() == 4 * segmentBytes);
+}
+
+void testConcurrency(uint32_t producerCount, uint32_t consumerCount, uint64_t elementsPerProducer, size_t capacity) {
+  MpmcRing<uint64_t> ring(capacity);
+  std::atomic_bool start{false};
+  std::atomic<uint64_t> consumed{0};
+  std::vector<std::atomic<uint8_t>> popCount(producerCount * elementsPerProducer);
+  for (auto &count : popCount) count = 0;
+  std::atomic<uint32_t> reordered{0};
+  const uint64_t total = producerCount * elementsPerProducer;
+
+  std::vector<std::thread> threads;
+  for (uint32_t producer = 0; producer < producerCount; producer++) {
+    threads.emplace_back([&, producer] {
+      while (!start) std::this_thread::yield();
+      for (uint64_t i = 0; i < elementsPerProducer; i++) {
+        uint64_t value = ((uint64_t)producer << 32) | i;
+        while (!ring.push(value)) std::this_thread::yield();
+      }
+    });
+  }
+  for (uint32_t consumer = 0; consumer < consumerCount; consumer++) {
+    threads.emplace_back([&] {
+      //Per consumer, the elements of each producer must arrive in order.
+      std::vector<int64_t> last(producerCount, -1);
+      while (!start) std::this_thread::yield();
+      uint64_t value = 0;
+      while (consumed < total) {
+        if (!ring.pop(value)) {
+          std::this_thread::yield();
+          continue;
+        }
+        uint32_t producer = value >> 32;
+        int64_t sequence = value & 0xFFFFFFFF;
+        if (sequence <= last[producer]) ++reordered;
+        last[producer] = sequence;
+        ++popCount[producer * elementsPerProducer + sequence];
+        ++consumed;
+      }
+    });
+  }
+  start = true;
+  for (auto &thread : threads) thread.join();
+
+  uint64_t value = 0;
+  CHECK(!ring.pop(value));
+  CHECK(consumed == total);
+  CHECK(reordered == 0);
+  uint64_t wrongCount = 0;
+  for (auto &count : popCount) {
+    if (count != 1) wrongCount++;
+  }
+  CHECK(wrongCount == 0);
+  CHECK(ring.pushed() == total && ring.popped() == total);
+}
+
+}
+
+int main() {
+  testWraparound();
+  testConcurrency(4, 4, 50000, 128);
+  testConcurrency(2, 6, 20000, 1024);
+  testConcurrency(6, 2, 20000, 64);
+  //Short runs on fresh rings, so the producers race in allocateSegment().
+  for (int32_t i = 0; i < 200 && success; i++) testConcurrency(4, 4, 300, 256);
+  return success ? 0 : 1;
+}
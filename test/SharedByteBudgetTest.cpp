@@ -0,0 +1,136 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * libhomegear-base is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * libhomegear-base is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libhomegear-base.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+/*
+ * Two queues sharing one enforced ByteBudget: When the budget is exhausted, the overload policies must not drop queued
+ * entries, because that only frees budget for the other queue. Entries are only dropped for a queue's own limits.
+ */
+
+#include "TypedQueue.h"
+
+#include <cstdio>
+
+using namespace Ipc;
+
+namespace {
+
+struct TestEntry {
+  uint32_t value = 0;
+  size_t size = 0;
+};
+
+class TestQueue : public TypedQueue<TestQueue, TestEntry> {
+  friend class TypedQueue<TestQueue, TestEntry>;
+ public:
+  TestQueue() : TypedQueue(1, 100) {}
+
+  //Keeps the processing thread busy with the first entry, so the others stay queued.
+  std::atomic_bool hold{true};
+  std::atomic_bool holding{false};
+
+  void processQueueEntry(int32_t index, TestEntry &entry) {
+    holding = true;
+    while (hold) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+ protected:
+  size_t getQueueEntrySize(int32_t index, TestEntry &entry) { return entry.size; }
+};
+
+bool success = true;
+
+#define CHECK(condition) do { if (!(condition)) { printf("Check failed in line %d: %s\n", __LINE__, #condition); success = false; } } while (0)
+
+bool enqueue(TestQueue &queue, uint32_t value, size_t size) {
+  TestEntry entry;
+  entry.value = value;
+  entry.size = size;
+  return queue.enqueue(0, std::move(entry));
+}
+
+void test(IQueueBase::OverloadPolicy policy) {
+  auto budget = std::make_shared<ByteBudget>(1000);
+  IQueueBase::OverloadOptions options;
+  options.policy = policy;
+  options.timeout = 50;
+
+  TestQueue queue1;
+  TestQueue queue2;
+  queue1.setOverloadOptions(0, options);
+  queue2.setOverloadOptions(0, options);
+  queue1.setByteBudget(0, budget);
+  queue2.setByteBudget(0, budget);
+  queue2.setByteLimit(0, 300);
+  queue1.startQueue(0, false, 1);
+  queue2.startQueue(0, false, 1);
+
+  //Wait until both processing threads hold their first entry.
+  enqueue(queue1, 0, 0);
+  enqueue(queue2, 0, 0);
+  while (!queue1.holding || !queue2.holding) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+  for (uint32_t i = 1; i <= 7; i++) CHECK(enqueue(queue1, i, 100));
+  for (uint32_t i = 1; i <= 3; i++) CHECK(enqueue(queue2, i, 100));
+  CHECK(budget->exhausted());
+
+  //Only the budget is exhausted for queue 1, so the entry is refused without dropping queued entries.
+  CHECK(!enqueue(queue1, 8, 100));
+  auto overloadMetrics1 = queue1.getOverloadMetrics(0);
+  CHECK(overloadMetrics1.evicted == 0);
+  CHECK(overloadMetrics1.shed == 0);
+  CHECK(queue1.getMetrics(0).bytes == 700);
+
+  //Queue 2 reached its own byte limit. dropOldest makes room and the freed bytes go back to the budget. shedByPriority
+  //finds no lower lane and block times out.
+  bool accepted = enqueue(queue2, 4, 100);
+  auto overloadMetrics2 = queue2.getOverloadMetrics(0);
+  if (policy == IQueueBase::OverloadPolicy::dropOldest) {
+    CHECK(accepted);
+    CHECK(overloadMetrics2.evicted == 1);
+  } else {
+    CHECK(!accepted);
+  }
+  CHECK(queue2.getMetrics(0).bytes == 300);
+  CHECK(budget->used() == 1000);
+
+  queue1.hold = false;
+  queue2.hold = false;
+  queue1.stopQueue(0);
+  queue2.stopQueue(0);
+  CHECK(budget->used() == 0);
+}
+
+}
+
+int main() {
+  test(IQueueBase::OverloadPolicy::dropOldest);
+  test(IQueueBase::OverloadPolicy::shedByPriority);
+  test(IQueueBase::OverloadPolicy::block);
+  return success ? 0 : 1;
+}